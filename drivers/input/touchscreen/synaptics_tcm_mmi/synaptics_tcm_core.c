@@ -66,6 +66,8 @@
 
 #define POLLING_DELAY_MS 5
 
+#define HYBRID_POLLING false
+
 #define RUN_WATCHDOG true
 
 #define WATCHDOG_TRIGGER_COUNT 2
@@ -164,6 +166,7 @@ SHOW_PROTOTYPE(syna_tcm, info)
 STORE_PROTOTYPE(syna_tcm, irq_en)
 STORE_PROTOTYPE(syna_tcm, reset)
 STORE_PROTOTYPE(syna_tcm, watchdog)
+SHOW_STORE_PROTOTYPE(syna_tcm, hybrid)
 SHOW_STORE_PROTOTYPE(syna_tcm, no_doze)
 SHOW_STORE_PROTOTYPE(syna_tcm, disable_noise_mitigation)
 SHOW_STORE_PROTOTYPE(syna_tcm, inhibit_frequency_shift)
@@ -186,6 +189,7 @@ static struct device_attribute *attrs[] = {
 	ATTRIFY(irq_en),
 	ATTRIFY(reset),
 	ATTRIFY(watchdog),
+	ATTRIFY(hybrid),
 	ATTRIFY(poweron),
 	ATTRIFY(flashprog),
 	ATTRIFY(productinfo),
@@ -453,6 +457,91 @@ static ssize_t syna_tcm_sysfs_watchdog_store(struct device *dev,
 	return count;
 }
 
+static ssize_t syna_tcm_sysfs_hybrid_show(struct device *dev,
+		struct device_attribute *attr, char *buf)
+{
+	int idx;
+	unsigned int count;
+	unsigned int avg[2];
+	struct device *p_dev;
+	struct kobject *p_kobj;
+	struct syna_tcm_hcd *tcm_hcd;
+	struct syna_tcm_hybrid *hybrid;
+
+	p_kobj = sysfs_dir->parent;
+	p_dev = container_of(p_kobj, struct device, kobj);
+	tcm_hcd = dev_get_drvdata(p_dev);
+	hybrid = &tcm_hcd->hybrid;
+
+	for (idx = 0; idx < 2; idx++) {
+		if (hybrid->latency_count[idx])
+			avg[idx] = div_u64(hybrid->latency_sum_us[idx],
+					hybrid->latency_count[idx]);
+		else
+			avg[idx] = 0;
+	}
+
+	count = scnprintf(buf, PAGE_SIZE,
+			"Enabled:            %d\n"
+			"Mode:               %s\n"
+			"Report period:      %u us\n"
+			"Switches to poll:   %u\n"
+			"Switches to IRQ:    %u\n"
+			"Polls:              %u (%u empty)\n"
+			"IRQ latency:        %u us avg, %u us max (%u frames)\n"
+			"Poll latency:       %u us avg, %u us max (%u frames)\n",
+			hybrid->enabled,
+			hybrid->polling ? "Polling" : "Interrupt",
+			hybrid->period_us,
+			hybrid->to_polling,
+			hybrid->to_irq,
+			hybrid->polls, hybrid->empty_polls,
+			avg[0], hybrid->latency_max_us[0],
+			hybrid->latency_count[0],
+			avg[1], hybrid->latency_max_us[1],
+			hybrid->latency_count[1]);
+
+	return count;
+}
+
+static ssize_t syna_tcm_sysfs_hybrid_store(struct device *dev,
+		struct device_attribute *attr, const char *buf, size_t count)
+{
+	unsigned int input;
+	struct device *p_dev;
+	struct kobject *p_kobj;
+	struct syna_tcm_hcd *tcm_hcd;
+	struct syna_tcm_hybrid *hybrid;
+
+	p_kobj = sysfs_dir->parent;
+	p_dev = container_of(p_kobj, struct device, kobj);
+	tcm_hcd = dev_get_drvdata(p_dev);
+	hybrid = &tcm_hcd->hybrid;
+
+	if (sscanf(buf, "%u", &input) != 1)
+		return -EINVAL;
+
+	if (input != 0 && input != 1)
+		return -EINVAL;
+
+	mutex_lock(&tcm_hcd->extif_mutex);
+
+	/* polling in progress returns to interrupt on its next poll */
+	hybrid->enabled = input;
+	hybrid->streak = 0;
+	hybrid->to_polling = 0;
+	hybrid->to_irq = 0;
+	hybrid->polls = 0;
+	hybrid->empty_polls = 0;
+	memset(hybrid->latency_count, 0, sizeof(hybrid->latency_count));
+	memset(hybrid->latency_max_us, 0, sizeof(hybrid->latency_max_us));
+	memset(hybrid->latency_sum_us, 0, sizeof(hybrid->latency_sum_us));
+
+	mutex_unlock(&tcm_hcd->extif_mutex);
+
+	return count;
+}
+
 static ssize_t syna_tcm_sysfs_poweron_show(struct device *dev,
 		struct device_attribute *attr, char *buf)
 {
@@ -588,6 +677,54 @@ exit:
 }
 EXPORT_SYMBOL(syna_tcm_add_module);
 
+/**
+ * syna_tcm_claim_report() - take over the storage of the report
+ *
+ * @tcm_hcd: handle of core module
+ * @buffer: buffer to receive the report
+ *
+ * Called from a syncbox to keep the report being dispatched without copying
+ * it. The storage of buffer is exchanged with that of the input buffer, which
+ * is grown first if smaller, and the report stays valid for the remaining
+ * syncboxes. Only one module can claim a report, later ones have to copy it.
+ *
+ * Return: offset of the report payload in buffer->buf, or a negative error
+ */
+int syna_tcm_claim_report(struct syna_tcm_hcd *tcm_hcd,
+		struct syna_tcm_buffer *buffer)
+{
+	int retval;
+	unsigned char *buf;
+	unsigned int buf_size;
+
+	if (!tcm_hcd->report_claimable)
+		return -EBUSY;
+
+	/* the input buffer must hold the next predicted read */
+	if (buffer->buf_size < tcm_hcd->in.buf_size) {
+		retval = syna_tcm_alloc_mem(tcm_hcd,
+				buffer,
+				tcm_hcd->in.buf_size);
+		if (retval < 0)
+			return retval;
+	}
+
+	buf = buffer->buf;
+	buf_size = buffer->buf_size;
+
+	buffer->buf = tcm_hcd->in.buf;
+	buffer->buf_size = tcm_hcd->in.buf_size;
+	buffer->data_length = tcm_hcd->report.buffer.data_length;
+
+	tcm_hcd->in.buf = buf;
+	tcm_hcd->in.buf_size = buf_size;
+
+	tcm_hcd->report_claimable = false;
+
+	return MESSAGE_HEADER_SIZE;
+}
+EXPORT_SYMBOL(syna_tcm_claim_report);
+
 #include <linux/major.h>
 #include <linux/kdev_t.h>
 
@@ -753,7 +890,7 @@ static void syna_tcm_module_work(struct work_struct *work)
  * @data: handle of core module
  *
  * The occurrence of the report generated by the device is forwarded to the
- * asynchronous inbox of each registered application module.
+ * asynchronous inbox of each registered application module subscribed to it.
  */
 static int syna_tcm_report_notifier(void *data)
 {
@@ -779,7 +916,9 @@ static int syna_tcm_report_notifier(void *data)
 			list_for_each_entry(mod_handler, &mod_pool.list, link) {
 				if (!mod_handler->insert &&
 						!mod_handler->detach &&
-						(mod_handler->mod_cb->asyncbox))
+						(mod_handler->mod_cb->asyncbox) &&
+						test_bit(tcm_hcd->async_report_id,
+						mod_handler->mod_cb->async_mask))
 					mod_handler->mod_cb->asyncbox(tcm_hcd);
 			}
 		}
@@ -792,18 +931,84 @@ static int syna_tcm_report_notifier(void *data)
 	return 0;
 }
 
+/**
+ * syna_tcm_hybrid_account() - account touch report for hybrid polling
+ *
+ * @hybrid: hybrid polling state
+ * @frame_time: time of the attention of the frame
+ * @now: time the dispatch of the frame ended
+ *
+ * Record the latency of the frame and track the report period and the
+ * number of consecutive fast reports used to decide when to switch to
+ * polling.
+ */
+SYNA_TCM_VISIBLE_IF_KUNIT void syna_tcm_hybrid_account(
+		struct syna_tcm_hybrid *hybrid, ktime_t frame_time, ktime_t now)
+{
+	unsigned int mode;
+	unsigned int latency;
+	unsigned int interval;
+
+	mode = hybrid->polling ? 1 : 0;
+	latency = ktime_us_delta(now, frame_time);
+
+	hybrid->latency_count[mode]++;
+	hybrid->latency_sum_us[mode] += latency;
+	if (latency > hybrid->latency_max_us[mode])
+		hybrid->latency_max_us[mode] = latency;
+
+	interval = ktime_us_delta(frame_time, hybrid->last_frame_time);
+	hybrid->last_frame_time = frame_time;
+
+	if (interval == 0 || interval > HYBRID_MAX_PERIOD_US) {
+		hybrid->streak = 0;
+		return;
+	}
+
+	if (hybrid->streak == 0 || hybrid->period_us == 0)
+		hybrid->period_us = interval;
+	else
+		hybrid->period_us = (hybrid->period_us * 7 + interval) / 8;
+
+	hybrid->streak++;
+
+	return;
+}
+SYNA_TCM_EXPORT_IF_KUNIT(syna_tcm_hybrid_account);
+
+/**
+ * syna_tcm_hybrid_update() - account touch report for hybrid polling
+ *
+ * @tcm_hcd: handle of core module
+ *
+ * Called at the end of the dispatch of the frame, by which the touch module
+ * has synced its input events.
+ */
+static void syna_tcm_hybrid_update(struct syna_tcm_hcd *tcm_hcd)
+{
+	syna_tcm_hybrid_account(&tcm_hcd->hybrid, tcm_hcd->frame_time,
+			ktime_get());
+
+	return;
+}
+
 /**
  * syna_tcm_dispatch_report() - dispatch report received from device
  *
  * @tcm_hcd: handle of core module
+ * @pool: application modules to dispatch to
  *
  * The report generated by the device is forwarded to the synchronous inbox of
- * each registered application module for further processing. In addition, the
- * report notifier thread is woken up for asynchronous notification of the
- * report occurrence.
+ * each registered application module subscribed to its report code for further
+ * processing. In addition, the report notifier thread is woken up for
+ * asynchronous notification of the report occurrence if any module subscribes
+ * its asynchronous inbox to the report code.
  */
-static void syna_tcm_dispatch_report(struct syna_tcm_hcd *tcm_hcd)
+SYNA_TCM_VISIBLE_IF_KUNIT void syna_tcm_dispatch_report(
+		struct syna_tcm_hcd *tcm_hcd, struct syna_tcm_module_pool *pool)
 {
+	bool notify;
+	struct syna_tcm_module_cb *mod_cb;
 	struct syna_tcm_module_handler *mod_handler;
 
 	LOCK_BUFFER(tcm_hcd->in);
@@ -818,29 +1023,46 @@ static void syna_tcm_dispatch_report(struct syna_tcm_hcd *tcm_hcd)
 
 	tcm_hcd->report.id = tcm_hcd->status_report_code;
 
-	mutex_lock(&mod_pool.mutex);
+	tcm_hcd->report_claimable = true;
 
-	if (!list_empty(&mod_pool.list)) {
-		list_for_each_entry(mod_handler, &mod_pool.list, link) {
-			if (!mod_handler->insert &&
-					!mod_handler->detach &&
-					(mod_handler->mod_cb->syncbox))
-				mod_handler->mod_cb->syncbox(tcm_hcd);
+	notify = false;
+
+	mutex_lock(&pool->mutex);
+
+	if (!list_empty(&pool->list)) {
+		list_for_each_entry(mod_handler, &pool->list, link) {
+			mod_cb = mod_handler->mod_cb;
+			if (mod_handler->insert || mod_handler->detach)
+				continue;
+			if (mod_cb->syncbox && test_bit(tcm_hcd->report.id,
+					mod_cb->report_mask))
+				mod_cb->syncbox(tcm_hcd);
+			if (mod_cb->asyncbox && test_bit(tcm_hcd->report.id,
+					mod_cb->async_mask))
+				notify = true;
 		}
 	}
 
+	/* leave the id of a report still pending for the notifier alone */
+	if (notify)
+		tcm_hcd->async_report_id = tcm_hcd->status_report_code;
 
-	tcm_hcd->async_report_id = tcm_hcd->status_report_code;
+	mutex_unlock(&pool->mutex);
 
-	mutex_unlock(&mod_pool.mutex);
+	tcm_hcd->report_claimable = false;
 
 	UNLOCK_BUFFER(tcm_hcd->report.buffer);
 	UNLOCK_BUFFER(tcm_hcd->in);
 
-	wake_up_process(tcm_hcd->notifier_thread);
+	if (tcm_hcd->report.id == REPORT_TOUCH)
+		syna_tcm_hybrid_update(tcm_hcd);
+
+	if (notify)
+		wake_up_process(tcm_hcd->notifier_thread);
 
 	return;
 }
+SYNA_TCM_EXPORT_IF_KUNIT(syna_tcm_dispatch_report);
 
 /**
  * syna_tcm_dispatch_response() - dispatch response received from device
@@ -991,7 +1213,7 @@ static void syna_tcm_dispatch_message(struct syna_tcm_hcd *tcm_hcd)
 	}
 
 	if (tcm_hcd->status_report_code >= REPORT_IDENTIFY)
-		syna_tcm_dispatch_report(tcm_hcd);
+		syna_tcm_dispatch_report(tcm_hcd, &mod_pool);
 	else
 		syna_tcm_dispatch_response(tcm_hcd);
 
@@ -1011,6 +1233,7 @@ static int syna_tcm_continued_read(struct syna_tcm_hcd *tcm_hcd)
 	int retval;
 	unsigned char marker;
 	unsigned char code;
+	unsigned char saved[2];
 	unsigned int idx;
 	unsigned int offset;
 	unsigned int chunks;
@@ -1048,8 +1271,6 @@ static int syna_tcm_continued_read(struct syna_tcm_hcd *tcm_hcd)
 
 	offset = tcm_hcd->read_length;
 
-	LOCK_BUFFER(tcm_hcd->temp);
-
 	for (idx = 0; idx < chunks; idx++) {
 		if (remaining_length > chunk_space)
 			xfer_length = chunk_space;
@@ -1063,36 +1284,31 @@ static int syna_tcm_continued_read(struct syna_tcm_hcd *tcm_hcd)
 			continue;
 		}
 
-		retval = syna_tcm_alloc_mem(tcm_hcd,
-				&tcm_hcd->temp,
-				xfer_length + 2);
-		if (retval < 0) {
-			LOGE(tcm_hcd->pdev->dev.parent,
-					"Failed to allocate memory for tcm_hcd->temp.buf\n");
-			UNLOCK_BUFFER(tcm_hcd->temp);
-			UNLOCK_BUFFER(tcm_hcd->in);
-			return retval;
-		}
+		/* read the chunk in place, its marker and code bytes land on
+		 * the last two bytes already read and are put back after */
+		saved[0] = tcm_hcd->in.buf[offset - 2];
+		saved[1] = tcm_hcd->in.buf[offset - 1];
 
 		retval = syna_tcm_read(tcm_hcd,
-				tcm_hcd->temp.buf,
+				&tcm_hcd->in.buf[offset - 2],
 				xfer_length + 2);
 		if (retval < 0) {
 			LOGE(tcm_hcd->pdev->dev.parent,
 					"Failed to read from device\n");
-			UNLOCK_BUFFER(tcm_hcd->temp);
 			UNLOCK_BUFFER(tcm_hcd->in);
 			return retval;
 		}
 
-		marker = tcm_hcd->temp.buf[0];
-		code = tcm_hcd->temp.buf[1];
+		marker = tcm_hcd->in.buf[offset - 2];
+		code = tcm_hcd->in.buf[offset - 1];
+
+		tcm_hcd->in.buf[offset - 2] = saved[0];
+		tcm_hcd->in.buf[offset - 1] = saved[1];
 
 		if (marker != MESSAGE_MARKER) {
 			LOGE(tcm_hcd->pdev->dev.parent,
 					"Incorrect header marker (0x%02x)\n",
 					marker);
-			UNLOCK_BUFFER(tcm_hcd->temp);
 			UNLOCK_BUFFER(tcm_hcd->in);
 			return -EIO;
 		}
@@ -1101,30 +1317,15 @@ static int syna_tcm_continued_read(struct syna_tcm_hcd *tcm_hcd)
 			LOGE(tcm_hcd->pdev->dev.parent,
 					"Incorrect header code (0x%02x)\n",
 					code);
-			UNLOCK_BUFFER(tcm_hcd->temp);
 			UNLOCK_BUFFER(tcm_hcd->in);
 			return -EIO;
 		}
 
-		retval = secure_memcpy(&tcm_hcd->in.buf[offset],
-				tcm_hcd->in.buf_size - offset,
-				&tcm_hcd->temp.buf[2],
-				tcm_hcd->temp.buf_size - 2,
-				xfer_length);
-		if (retval < 0) {
-			LOGE(tcm_hcd->pdev->dev.parent,
-					"Failed to copy payload\n");
-			UNLOCK_BUFFER(tcm_hcd->temp);
-			UNLOCK_BUFFER(tcm_hcd->in);
-			return retval;
-		}
-
 		offset += xfer_length;
 
 		remaining_length -= xfer_length;
 	}
 
-	UNLOCK_BUFFER(tcm_hcd->temp);
 	UNLOCK_BUFFER(tcm_hcd->in);
 
 	return 0;
@@ -1491,10 +1692,15 @@ check_padding:
 	UNLOCK_BUFFER(tcm_hcd->in);
 
 #ifdef PREDICTIVE_READING
-	total_length = MAX(total_length, MIN_READ_LENGTH);
-	tcm_hcd->read_length = MIN(total_length, tcm_hcd->rd_chunk_size);
-	if (tcm_hcd->rd_chunk_size == 0)
-		tcm_hcd->read_length = total_length;
+	/* the next read is sized for a report like this one, so a stream of
+	 * reports takes one transaction each; responses to commands are
+	 * read on demand and do not change the prediction */
+	if (tcm_hcd->status_report_code >= REPORT_IDENTIFY) {
+		total_length = MAX(total_length, MIN_READ_LENGTH);
+		tcm_hcd->read_length = MIN(total_length, tcm_hcd->rd_chunk_size);
+		if (tcm_hcd->rd_chunk_size == 0)
+			tcm_hcd->read_length = total_length;
+	}
 #endif
 
 	syna_tcm_dispatch_message(tcm_hcd);
@@ -1781,7 +1987,9 @@ static void syna_tcm_check_hdl(struct syna_tcm_hcd *tcm_hcd)
 		list_for_each_entry(mod_handler, &mod_pool.list, link) {
 			if (!mod_handler->insert &&
 					!mod_handler->detach &&
-					(mod_handler->mod_cb->syncbox))
+					(mod_handler->mod_cb->syncbox) &&
+					test_bit(REPORT_HDL,
+					mod_handler->mod_cb->report_mask))
 				mod_handler->mod_cb->syncbox(tcm_hcd);
 		}
 	}
@@ -1871,6 +2079,8 @@ static void syna_tcm_polling_work(struct work_struct *work)
 	if (!tcm_hcd->do_polling)
 		return;
 
+	tcm_hcd->frame_time = ktime_get();
+
 	retval = tcm_hcd->read_message(tcm_hcd,
 			NULL,
 			0);
@@ -1890,6 +2100,223 @@ static void syna_tcm_polling_work(struct work_struct *work)
 	return;
 }
 
+static enum hrtimer_restart syna_tcm_hybrid_timer(struct hrtimer *timer)
+{
+	struct syna_tcm_hcd *tcm_hcd =
+			container_of(timer, struct syna_tcm_hcd, hybrid.timer);
+
+	queue_work(tcm_hcd->hybrid.workqueue, &tcm_hcd->hybrid.work);
+
+	return HRTIMER_NORESTART;
+}
+
+static unsigned int syna_tcm_hybrid_retry_us(struct syna_tcm_hybrid *hybrid)
+{
+	return MAX(hybrid->period_us / HYBRID_RETRY_DIVISOR,
+			HYBRID_MIN_RETRY_US);
+}
+
+/**
+ * syna_tcm_hybrid_first_poll() - decide whether to switch to polling
+ *
+ * @hybrid: hybrid polling state
+ * @first: time of the first poll, shortly before the next report is due
+ *
+ * Return true once HYBRID_ENTER_FRAMES touch reports have arrived back to
+ * back.
+ */
+SYNA_TCM_VISIBLE_IF_KUNIT bool syna_tcm_hybrid_first_poll(
+		struct syna_tcm_hybrid *hybrid, ktime_t *first)
+{
+	unsigned int lead;
+
+	if (!hybrid->enabled || hybrid->polling ||
+			hybrid->streak < HYBRID_ENTER_FRAMES)
+		return false;
+
+	lead = syna_tcm_hybrid_retry_us(hybrid);
+	*first = ktime_add_us(hybrid->last_frame_time,
+			hybrid->period_us - MIN(lead, hybrid->period_us));
+
+	return true;
+}
+SYNA_TCM_EXPORT_IF_KUNIT(syna_tcm_hybrid_first_poll);
+
+/**
+ * syna_tcm_hybrid_next_poll() - schedule the next poll
+ *
+ * @hybrid: hybrid polling state
+ * @now: time of the current poll
+ * @attn: a report was read at this poll
+ * @next: time of the next poll
+ *
+ * Come back one report period after a report, less the retry interval, and
+ * after the retry interval otherwise. Return true if polling should end
+ * because no report has arrived for HYBRID_IDLE_PERIODS report periods, in
+ * which case @next is where to poll if it cannot end yet.
+ */
+SYNA_TCM_VISIBLE_IF_KUNIT bool syna_tcm_hybrid_next_poll(
+		struct syna_tcm_hybrid *hybrid, ktime_t now, bool attn,
+		ktime_t *next)
+{
+	unsigned int retry = syna_tcm_hybrid_retry_us(hybrid);
+
+	hybrid->polls++;
+
+	if (attn) {
+		*next = ktime_add_us(now,
+				hybrid->period_us - MIN(retry, hybrid->period_us));
+		return false;
+	}
+
+	hybrid->empty_polls++;
+	*next = ktime_add_us(now, retry);
+
+	return !hybrid->enabled || ktime_us_delta(now,
+			hybrid->last_frame_time) >
+			hybrid->period_us * HYBRID_IDLE_PERIODS;
+}
+SYNA_TCM_EXPORT_IF_KUNIT(syna_tcm_hybrid_next_poll);
+
+/**
+ * syna_tcm_hybrid_enter() - switch from interrupt to polling
+ *
+ * @tcm_hcd: handle of core module
+ *
+ * Called by the interrupt thread. Once HYBRID_ENTER_FRAMES touch reports
+ * have arrived back to back, the interrupt is masked and the attention line
+ * is polled instead, starting shortly before the next report is due.
+ */
+static void syna_tcm_hybrid_enter(struct syna_tcm_hcd *tcm_hcd)
+{
+	ktime_t first;
+	struct syna_tcm_hybrid *hybrid = &tcm_hcd->hybrid;
+
+	if (!syna_tcm_hybrid_first_poll(hybrid, &first))
+		return;
+
+	/* the holder may be waiting for this thread in disable_irq() */
+	if (!mutex_trylock(&tcm_hcd->irq_en_mutex))
+		return;
+
+	if (tcm_hcd->irq_enabled && !tcm_hcd->do_polling) {
+		disable_irq_nosync(tcm_hcd->irq);
+		hybrid->polling = true;
+		hybrid->to_polling++;
+
+		hrtimer_start(&hybrid->timer, first, HRTIMER_MODE_ABS);
+
+		LOGD(tcm_hcd->pdev->dev.parent,
+				"Switched to polling (report period %u us)\n",
+				hybrid->period_us);
+	}
+
+	mutex_unlock(&tcm_hcd->irq_en_mutex);
+
+	return;
+}
+
+/**
+ * syna_tcm_hybrid_stop() - switch from polling back to interrupt
+ *
+ * @tcm_hcd: handle of core module
+ * @ns: do not wait for the polling work to finish
+ *
+ * Called with irq_en_mutex held.
+ */
+static void syna_tcm_hybrid_stop(struct syna_tcm_hcd *tcm_hcd, bool ns)
+{
+	struct syna_tcm_hybrid *hybrid = &tcm_hcd->hybrid;
+
+	hybrid->streak = 0;
+
+	if (hybrid->polling) {
+		hybrid->polling = false;
+		hybrid->to_irq++;
+		enable_irq(tcm_hcd->irq);
+
+		LOGD(tcm_hcd->pdev->dev.parent,
+				"Switched to interrupt\n");
+	}
+
+	hrtimer_cancel(&hybrid->timer);
+
+	if (!ns) {
+		cancel_work_sync(&hybrid->work);
+		/* the work may have rearmed the timer before seeing polling */
+		hrtimer_cancel(&hybrid->timer);
+	}
+
+	return;
+}
+
+/**
+ * syna_tcm_hybrid_work() - poll attention line
+ *
+ * @work: pointer to work_struct
+ *
+ * Read the report if the attention line is asserted and come back one
+ * report period later, less the retry interval. Otherwise try again after
+ * the retry interval, and return to interrupt once no report has arrived
+ * for HYBRID_IDLE_PERIODS report periods.
+ */
+static void syna_tcm_hybrid_work(struct work_struct *work)
+{
+	int retval;
+	bool attn;
+	ktime_t now;
+	ktime_t next;
+	struct syna_tcm_hcd *tcm_hcd =
+			container_of(work, struct syna_tcm_hcd, hybrid.work);
+	struct syna_tcm_hybrid *hybrid = &tcm_hcd->hybrid;
+	const struct syna_tcm_board_data *bdata = tcm_hcd->hw_if->bdata;
+
+	if (!hybrid->polling)
+		return;
+
+	now = ktime_get();
+
+	attn = hybrid->enabled &&
+			gpio_get_value(bdata->irq_gpio) == bdata->irq_on_state;
+	if (attn) {
+		tcm_hcd->isr_pid = current->pid;
+		tcm_hcd->frame_time = now;
+
+		retval = tcm_hcd->read_message(tcm_hcd,
+				NULL,
+				0);
+		if (retval < 0) {
+			LOGE(tcm_hcd->pdev->dev.parent,
+					"Failed to read message\n");
+			if (retval == -ENXIO &&
+					tcm_hcd->hw_if->bus_io->type == BUS_SPI)
+				syna_tcm_check_hdl(tcm_hcd);
+		}
+	}
+
+	if (syna_tcm_hybrid_next_poll(hybrid, now, attn, &next)) {
+		if (mutex_trylock(&tcm_hcd->irq_en_mutex)) {
+			syna_tcm_hybrid_stop(tcm_hcd, true);
+			mutex_unlock(&tcm_hcd->irq_en_mutex);
+			return;
+		}
+	}
+
+	if (hybrid->polling)
+		hrtimer_start(&hybrid->timer, next, HRTIMER_MODE_ABS);
+
+	return;
+}
+
+static irqreturn_t syna_tcm_isr_primary(int irq, void *data)
+{
+	struct syna_tcm_hcd *tcm_hcd = data;
+
+	tcm_hcd->frame_time = ktime_get();
+
+	return IRQ_WAKE_THREAD;
+}
+
 static irqreturn_t syna_tcm_isr(int irq, void *data)
 {
 	int retval;
@@ -1911,6 +2338,8 @@ static irqreturn_t syna_tcm_isr(int irq, void *data)
 			syna_tcm_check_hdl(tcm_hcd);
 	}
 
+	syna_tcm_hybrid_enter(tcm_hcd);
+
 exit:
 	return IRQ_HANDLED;
 }
@@ -1939,7 +2368,8 @@ static int syna_tcm_enable_irq(struct syna_tcm_hcd *tcm_hcd, bool en, bool ns)
 		}
 
 		if (irq_freed) {
-			retval = request_threaded_irq(tcm_hcd->irq, NULL,
+			retval = request_threaded_irq(tcm_hcd->irq,
+					syna_tcm_isr_primary,
 					syna_tcm_isr, bdata->irq_flags,
 					PLATFORM_DRIVER_NAME, tcm_hcd);
 			if (retval < 0) {
@@ -1974,6 +2404,8 @@ queue_polling_work:
 			goto exit;
 		}
 
+		syna_tcm_hybrid_stop(tcm_hcd, ns);
+
 		if (bdata->irq_gpio >= 0) {
 			if (ns) {
 				disable_irq_nosync(tcm_hcd->irq);
@@ -3348,6 +3780,13 @@ static int syna_tcm_probe(struct platform_device *pdev)
 	tcm_hcd->rd_chunk_size = RD_CHUNK_SIZE;
 	tcm_hcd->wr_chunk_size = WR_CHUNK_SIZE;
 
+	/* keep each read within what the bus can do in one transfer */
+	if (hw_if->bus_io->max_read_size >= MIN_READ_LENGTH) {
+		if (tcm_hcd->rd_chunk_size == 0 ||
+				tcm_hcd->rd_chunk_size > hw_if->bus_io->max_read_size)
+			tcm_hcd->rd_chunk_size = hw_if->bus_io->max_read_size;
+	}
+
 #ifdef PREDICTIVE_READING
 	tcm_hcd->read_length = MIN_READ_LENGTH;
 #else
@@ -3355,6 +3794,7 @@ static int syna_tcm_probe(struct platform_device *pdev)
 #endif
 
 	tcm_hcd->watchdog.run = RUN_WATCHDOG;
+	tcm_hcd->hybrid.enabled = HYBRID_POLLING;
 	tcm_hcd->update_watchdog = syna_tcm_update_watchdog;
 
 	if (bdata->irq_gpio >= 0)
@@ -3498,6 +3938,12 @@ static int syna_tcm_probe(struct platform_device *pdev)
 			create_singlethread_workqueue("syna_tcm_polling");
 	INIT_DELAYED_WORK(&tcm_hcd->polling_work, syna_tcm_polling_work);
 
+	tcm_hcd->hybrid.workqueue =
+			alloc_ordered_workqueue("syna_tcm_hybrid", WQ_HIGHPRI);
+	INIT_WORK(&tcm_hcd->hybrid.work, syna_tcm_hybrid_work);
+	hrtimer_init(&tcm_hcd->hybrid.timer, CLOCK_MONOTONIC, HRTIMER_MODE_ABS);
+	tcm_hcd->hybrid.timer.function = syna_tcm_hybrid_timer;
+
 	retval = tcm_hcd->enable_irq(tcm_hcd, true, NULL);
 	if (retval < 0) {
 		LOGE(tcm_hcd->pdev->dev.parent,
@@ -3535,6 +3981,10 @@ static int syna_tcm_probe(struct platform_device *pdev)
 err_reset:
 #endif
 err_enable_irq:
+	hrtimer_cancel(&tcm_hcd->hybrid.timer);
+	cancel_work_sync(&tcm_hcd->hybrid.work);
+	destroy_workqueue(tcm_hcd->hybrid.workqueue);
+
 	cancel_delayed_work_sync(&tcm_hcd->polling_work);
 	flush_workqueue(tcm_hcd->polling_workqueue);
 	destroy_workqueue(tcm_hcd->polling_workqueue);
@@ -3624,10 +4074,26 @@ static int syna_tcm_remove(struct platform_device *pdev)
 
 	mutex_unlock(&mod_pool.mutex);
 
-	if (tcm_hcd->irq_enabled && bdata->irq_gpio >= 0) {
+	/* keep the interrupt thread from switching to polling again */
+	mutex_lock(&tcm_hcd->extif_mutex);
+	tcm_hcd->hybrid.enabled = false;
+	mutex_unlock(&tcm_hcd->extif_mutex);
+
+	if (tcm_hcd->irq_enabled && bdata->irq_gpio >= 0)
 		disable_irq(tcm_hcd->irq);
+
+	/*
+	 * stopping polling balances the disable_irq_nosync() that entered it,
+	 * so the interrupt is only freed once the polling work is gone
+	 */
+	mutex_lock(&tcm_hcd->irq_en_mutex);
+	syna_tcm_hybrid_stop(tcm_hcd, false);
+	mutex_unlock(&tcm_hcd->irq_en_mutex);
+
+	destroy_workqueue(tcm_hcd->hybrid.workqueue);
+
+	if (tcm_hcd->irq_enabled && bdata->irq_gpio >= 0)
 		free_irq(tcm_hcd->irq, tcm_hcd);
-	}
 
 	cancel_delayed_work_sync(&tcm_hcd->polling_work);
 	flush_workqueue(tcm_hcd->polling_workqueue);
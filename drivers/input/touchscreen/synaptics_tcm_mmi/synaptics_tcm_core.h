@@ -38,6 +38,8 @@
 #include <linux/module.h>
 #include <linux/input.h>
 #include <linux/delay.h>
+#include <linux/bitops.h>
+#include <linux/hrtimer.h>
 #include <linux/platform_device.h>
 #include <linux/input/synaptics_tcm.h>
 #ifdef CONFIG_FB
@@ -61,6 +63,21 @@
 #define MESSAGE_MARKER 0xa5
 #define MESSAGE_PADDING 0x5a
 
+#define HYBRID_ENTER_FRAMES 8
+#define HYBRID_MAX_PERIOD_US 20000
+#define HYBRID_RETRY_DIVISOR 8
+#define HYBRID_MIN_RETRY_US 250
+#define HYBRID_IDLE_PERIODS 3
+
+/* core internals the KUnit tests reach from their own module */
+#ifdef CONFIG_TOUCHSCREEN_SYNAPTICS_TCM_KUNIT_TEST
+#define SYNA_TCM_VISIBLE_IF_KUNIT
+#define SYNA_TCM_EXPORT_IF_KUNIT(symbol) EXPORT_SYMBOL(symbol)
+#else
+#define SYNA_TCM_VISIBLE_IF_KUNIT static
+#define SYNA_TCM_EXPORT_IF_KUNIT(symbol)
+#endif
+
 #define LOGx(func, dev, log, ...) \
 	func(dev, "%s: " log, __func__, ##__VA_ARGS__)
 
@@ -255,6 +272,8 @@ enum report_type {
 	REPORT_HDL = 0xfe,
 };
 
+#define REPORT_CODES 256
+
 enum command_status {
 	CMD_IDLE = 0,
 	CMD_BUSY = 1,
@@ -298,6 +317,24 @@ struct syna_tcm_watchdog {
 	struct workqueue_struct *workqueue;
 };
 
+struct syna_tcm_hybrid {
+	bool enabled;
+	bool polling;
+	unsigned int streak;
+	unsigned int period_us;
+	unsigned int to_polling;
+	unsigned int to_irq;
+	unsigned int polls;
+	unsigned int empty_polls;
+	unsigned int latency_count[2];
+	unsigned int latency_max_us[2];
+	unsigned long long latency_sum_us[2];
+	ktime_t last_frame_time;
+	struct hrtimer timer;
+	struct work_struct work;
+	struct workqueue_struct *workqueue;
+};
+
 struct syna_tcm_buffer {
 	bool clone;
 	unsigned char *buf;
@@ -400,6 +437,9 @@ struct syna_tcm_hcd {
 	unsigned int rd_chunk_size;
 	unsigned int wr_chunk_size;
 	unsigned int app_status;
+	unsigned int config_seq;
+	bool report_claimable;
+	ktime_t frame_time;
 	struct platform_device *pdev;
 	struct regulator *pwr_reg;
 	struct regulator *bus_reg;
@@ -431,6 +471,7 @@ struct syna_tcm_hcd {
 	struct syna_tcm_identification id_info;
 	struct syna_tcm_helper helper;
 	struct syna_tcm_watchdog watchdog;
+	struct syna_tcm_hybrid hybrid;
 	struct syna_tcm_features features;
 	const struct syna_tcm_hw_interface *hw_if;
 	int (*reset)(struct syna_tcm_hcd *tcm_hcd, bool hw, bool update_wd);
@@ -470,6 +511,8 @@ struct syna_tcm_module_cb {
 	int (*suspend)(struct syna_tcm_hcd *tcm_hcd);
 	int (*resume)(struct syna_tcm_hcd *tcm_hcd);
 	int (*early_suspend)(struct syna_tcm_hcd *tcm_hcd);
+	DECLARE_BITMAP(report_mask, REPORT_CODES);
+	DECLARE_BITMAP(async_mask, REPORT_CODES);
 };
 
 struct syna_tcm_module_handler {
@@ -491,6 +534,7 @@ struct syna_tcm_module_pool {
 
 struct syna_tcm_bus_io {
 	unsigned char type;
+	unsigned int max_read_size; /* bus transfer limit in bytes, 0 = none */
 	int (*rmi_read)(struct syna_tcm_hcd *tcm_hcd, unsigned short addr,
 			unsigned char *data, unsigned int length);
 	int (*rmi_write)(struct syna_tcm_hcd *tcm_hcd, unsigned short addr,
@@ -512,6 +556,43 @@ void syna_tcm_bus_exit(void);
 
 int syna_tcm_add_module(struct syna_tcm_module_cb *mod_cb, bool insert);
 
+int syna_tcm_claim_report(struct syna_tcm_hcd *tcm_hcd,
+		struct syna_tcm_buffer *buffer);
+
+/* syncbox is only called for the report codes subscribed */
+static inline void syna_tcm_subscribe_report(struct syna_tcm_module_cb *mod_cb,
+		unsigned char code, bool en)
+{
+	if (en)
+		set_bit(code, mod_cb->report_mask);
+	else
+		clear_bit(code, mod_cb->report_mask);
+}
+
+/* asyncbox is only notified of the report codes subscribed */
+static inline void syna_tcm_subscribe_async(struct syna_tcm_module_cb *mod_cb,
+		unsigned char code, bool en)
+{
+	if (en)
+		set_bit(code, mod_cb->async_mask);
+	else
+		clear_bit(code, mod_cb->async_mask);
+}
+
+#ifdef CONFIG_TOUCHSCREEN_SYNAPTICS_TCM_KUNIT_TEST
+void syna_tcm_hybrid_account(struct syna_tcm_hybrid *hybrid,
+		ktime_t frame_time, ktime_t now);
+
+bool syna_tcm_hybrid_first_poll(struct syna_tcm_hybrid *hybrid,
+		ktime_t *first);
+
+bool syna_tcm_hybrid_next_poll(struct syna_tcm_hybrid *hybrid,
+		ktime_t now, bool attn, ktime_t *next);
+
+void syna_tcm_dispatch_report(struct syna_tcm_hcd *tcm_hcd,
+		struct syna_tcm_module_pool *pool);
+#endif
+
 static inline int syna_tcm_rmi_read(struct syna_tcm_hcd *tcm_hcd,
 		unsigned short addr, unsigned char *data, unsigned int length)
 {
@@ -0,0 +1,562 @@
+/*
+ * Synaptics TCM touchscreen driver
+ *
+ * KUnit tests of hybrid polling and report dispatch, built as their own
+ * module when CONFIG_TOUCHSCREEN_SYNAPTICS_TCM_KUNIT_TEST is set.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ */
+
+#include <kunit/test.h>
+#include <linux/module.h>
+#include <linux/platform_device.h>
+#include <linux/sched.h>
+#include "synaptics_tcm_core.h"
+
+/* 120 Hz reports */
+#define TEST_PERIOD_US 8333
+
+#define TEST_LATENCY_US 1500
+
+/* far enough from zero that the first frame has no previous one */
+#define TEST_START_US 1000000
+
+struct hybrid_test_ctx {
+	struct syna_tcm_hybrid hybrid;
+	ktime_t now;
+};
+
+static void hybrid_test_advance(struct hybrid_test_ctx *ctx, unsigned int us)
+{
+	ctx->now = ktime_add_us(ctx->now, us);
+}
+
+/**
+ * hybrid_test_frame() - Deliver one report at the fake clock
+ *
+ * The report is dispatched latency_us after its attention, which is where
+ * the fake clock is left.
+ */
+static void hybrid_test_frame(struct hybrid_test_ctx *ctx,
+		unsigned int latency_us)
+{
+	ktime_t frame_time = ctx->now;
+
+	hybrid_test_advance(ctx, latency_us);
+	syna_tcm_hybrid_account(&ctx->hybrid, frame_time, ctx->now);
+}
+
+/* deliver frames every TEST_PERIOD_US until polling would be entered */
+static void hybrid_test_streak(struct hybrid_test_ctx *ctx)
+{
+	unsigned int idx;
+
+	for (idx = 0; idx <= HYBRID_ENTER_FRAMES; idx++) {
+		hybrid_test_frame(ctx, TEST_LATENCY_US);
+		hybrid_test_advance(ctx, TEST_PERIOD_US - TEST_LATENCY_US);
+	}
+}
+
+static void hybrid_test_update(struct kunit *test)
+{
+	unsigned int idx;
+	struct hybrid_test_ctx *ctx = test->priv;
+	struct syna_tcm_hybrid *hybrid = &ctx->hybrid;
+
+	for (idx = 0; idx < 4; idx++) {
+		hybrid_test_frame(ctx, TEST_LATENCY_US + idx * 100);
+		hybrid_test_advance(ctx, TEST_PERIOD_US -
+				(TEST_LATENCY_US + idx * 100));
+	}
+
+	/* the first frame has nothing to measure the period against */
+	KUNIT_EXPECT_EQ(test, hybrid->streak, 3u);
+	KUNIT_EXPECT_EQ(test, hybrid->period_us, (unsigned int)TEST_PERIOD_US);
+	KUNIT_EXPECT_EQ(test, hybrid->latency_count[0], 4u);
+	KUNIT_EXPECT_EQ(test, hybrid->latency_count[1], 0u);
+	KUNIT_EXPECT_EQ(test, hybrid->latency_max_us[0],
+			(unsigned int)TEST_LATENCY_US + 300);
+	KUNIT_EXPECT_EQ(test, hybrid->latency_sum_us[0],
+			4ull * TEST_LATENCY_US + 600);
+
+	/* the period follows slower reports a quarter of the way */
+	hybrid_test_advance(ctx, 1600);
+	hybrid_test_frame(ctx, TEST_LATENCY_US);
+	KUNIT_EXPECT_EQ(test, hybrid->streak, 4u);
+	KUNIT_EXPECT_EQ(test, hybrid->period_us,
+			(TEST_PERIOD_US * 7 + TEST_PERIOD_US + 1600) / 8u);
+
+	/* reports received while polling are accounted separately */
+	hybrid->polling = true;
+	hybrid_test_advance(ctx, TEST_PERIOD_US - TEST_LATENCY_US);
+	hybrid_test_frame(ctx, 200);
+	KUNIT_EXPECT_EQ(test, hybrid->latency_count[0], 5u);
+	KUNIT_EXPECT_EQ(test, hybrid->latency_count[1], 1u);
+	KUNIT_EXPECT_EQ(test, hybrid->latency_max_us[1], 200u);
+}
+
+static void hybrid_test_update_gap(struct kunit *test)
+{
+	struct hybrid_test_ctx *ctx = test->priv;
+	struct syna_tcm_hybrid *hybrid = &ctx->hybrid;
+
+	hybrid_test_streak(ctx);
+	KUNIT_EXPECT_EQ(test, hybrid->streak,
+			(unsigned int)HYBRID_ENTER_FRAMES);
+
+	/* a pause longer than the slowest report period ends the streak */
+	hybrid_test_advance(ctx, HYBRID_MAX_PERIOD_US);
+	hybrid_test_frame(ctx, TEST_LATENCY_US);
+	KUNIT_EXPECT_EQ(test, hybrid->streak, 0u);
+
+	/* and the period is measured afresh */
+	hybrid_test_advance(ctx, 5000 - TEST_LATENCY_US);
+	hybrid_test_frame(ctx, TEST_LATENCY_US);
+	KUNIT_EXPECT_EQ(test, hybrid->streak, 1u);
+	KUNIT_EXPECT_EQ(test, hybrid->period_us, 5000u);
+
+	/* a report stamped with the same time as the last is not a period */
+	syna_tcm_hybrid_account(hybrid, hybrid->last_frame_time, ctx->now);
+	KUNIT_EXPECT_EQ(test, hybrid->streak, 0u);
+}
+
+static void hybrid_test_enter(struct kunit *test)
+{
+	ktime_t first;
+	unsigned int idx;
+	struct hybrid_test_ctx *ctx = test->priv;
+	struct syna_tcm_hybrid *hybrid = &ctx->hybrid;
+
+	for (idx = 0; idx < HYBRID_ENTER_FRAMES; idx++) {
+		hybrid_test_frame(ctx, TEST_LATENCY_US);
+		KUNIT_EXPECT_FALSE(test,
+				syna_tcm_hybrid_first_poll(hybrid, &first));
+		hybrid_test_advance(ctx, TEST_PERIOD_US - TEST_LATENCY_US);
+	}
+
+	hybrid_test_frame(ctx, TEST_LATENCY_US);
+	KUNIT_ASSERT_TRUE(test, syna_tcm_hybrid_first_poll(hybrid, &first));
+
+	/* the first poll leads the next report by the retry interval */
+	KUNIT_EXPECT_EQ(test, ktime_us_delta(first, hybrid->last_frame_time),
+			(s64)(TEST_PERIOD_US - TEST_PERIOD_US /
+			HYBRID_RETRY_DIVISOR));
+	KUNIT_EXPECT_GT(test, ktime_us_delta(first, ctx->now), (s64)0);
+
+	hybrid->polling = true;
+	KUNIT_EXPECT_FALSE(test, syna_tcm_hybrid_first_poll(hybrid, &first));
+
+	hybrid->polling = false;
+	hybrid->enabled = false;
+	KUNIT_EXPECT_FALSE(test, syna_tcm_hybrid_first_poll(hybrid, &first));
+}
+
+static void hybrid_test_enter_fast(struct kunit *test)
+{
+	ktime_t first;
+	unsigned int idx;
+	struct hybrid_test_ctx *ctx = test->priv;
+	struct syna_tcm_hybrid *hybrid = &ctx->hybrid;
+
+	/* reports faster than the minimum retry interval are polled at once */
+	for (idx = 0; idx <= HYBRID_ENTER_FRAMES; idx++) {
+		hybrid_test_frame(ctx, 100);
+		hybrid_test_advance(ctx, HYBRID_MIN_RETRY_US - 150);
+	}
+
+	KUNIT_ASSERT_TRUE(test, syna_tcm_hybrid_first_poll(hybrid, &first));
+	KUNIT_EXPECT_EQ(test, ktime_us_delta(first, hybrid->last_frame_time),
+			(s64)0);
+}
+
+static void hybrid_test_work(struct kunit *test)
+{
+	ktime_t poll;
+	ktime_t next;
+	unsigned int idx;
+	unsigned int retry;
+	struct hybrid_test_ctx *ctx = test->priv;
+	struct syna_tcm_hybrid *hybrid = &ctx->hybrid;
+
+	hybrid_test_streak(ctx);
+	KUNIT_ASSERT_TRUE(test, syna_tcm_hybrid_first_poll(hybrid, &next));
+	hybrid->polling = true;
+
+	retry = TEST_PERIOD_US / HYBRID_RETRY_DIVISOR;
+
+	/* the first poll is early, so it finds nothing and retries */
+	ctx->now = next;
+	KUNIT_EXPECT_FALSE(test,
+			syna_tcm_hybrid_next_poll(hybrid, ctx->now, false, &next));
+	KUNIT_EXPECT_EQ(test, ktime_us_delta(next, ctx->now), (s64)retry);
+	KUNIT_EXPECT_EQ(test, hybrid->polls, 1u);
+	KUNIT_EXPECT_EQ(test, hybrid->empty_polls, 1u);
+
+	/* the retry finds the report, which is read at the poll */
+	ctx->now = next;
+	poll = ctx->now;
+	hybrid_test_frame(ctx, 300);
+	KUNIT_EXPECT_FALSE(test,
+			syna_tcm_hybrid_next_poll(hybrid, poll, true, &next));
+	KUNIT_EXPECT_EQ(test, ktime_us_delta(next, poll),
+			(s64)(hybrid->period_us - retry));
+	KUNIT_EXPECT_EQ(test, hybrid->polls, 2u);
+	KUNIT_EXPECT_EQ(test, hybrid->empty_polls, 1u);
+	KUNIT_EXPECT_EQ(test, hybrid->latency_count[1], 1u);
+
+	/* the finger lifts, and polling ends after HYBRID_IDLE_PERIODS */
+	for (idx = 0; ; idx++) {
+		ctx->now = next;
+		if (syna_tcm_hybrid_next_poll(hybrid, ctx->now, false, &next))
+			break;
+		KUNIT_ASSERT_LT(test, idx, 100u);
+	}
+
+	KUNIT_EXPECT_GT(test, ktime_us_delta(ctx->now,
+			hybrid->last_frame_time),
+			(s64)hybrid->period_us * HYBRID_IDLE_PERIODS);
+	KUNIT_EXPECT_LE(test, ktime_us_delta(ctx->now,
+			hybrid->last_frame_time),
+			(s64)hybrid->period_us * HYBRID_IDLE_PERIODS + retry);
+
+	/* a poll that cannot stop yet retries */
+	KUNIT_EXPECT_EQ(test, ktime_us_delta(next, ctx->now), (s64)retry);
+}
+
+static void hybrid_test_work_disabled(struct kunit *test)
+{
+	ktime_t next;
+	struct hybrid_test_ctx *ctx = test->priv;
+	struct syna_tcm_hybrid *hybrid = &ctx->hybrid;
+
+	hybrid_test_streak(ctx);
+	hybrid->polling = true;
+
+	/* disabling through sysfs ends polling at the next poll */
+	hybrid->enabled = false;
+	KUNIT_EXPECT_TRUE(test,
+			syna_tcm_hybrid_next_poll(hybrid, ctx->now, false, &next));
+	KUNIT_EXPECT_EQ(test, hybrid->empty_polls, 1u);
+}
+
+static int hybrid_test_init(struct kunit *test)
+{
+	struct hybrid_test_ctx *ctx;
+
+	ctx = kunit_kzalloc(test, sizeof(*ctx), GFP_KERNEL);
+	if (!ctx)
+		return -ENOMEM;
+
+	ctx->hybrid.enabled = true;
+	ctx->now = us_to_ktime(TEST_START_US);
+
+	test->priv = ctx;
+
+	return 0;
+}
+
+static struct kunit_case hybrid_test_cases[] = {
+	KUNIT_CASE(hybrid_test_update),
+	KUNIT_CASE(hybrid_test_update_gap),
+	KUNIT_CASE(hybrid_test_enter),
+	KUNIT_CASE(hybrid_test_enter_fast),
+	KUNIT_CASE(hybrid_test_work),
+	KUNIT_CASE(hybrid_test_work_disabled),
+	{}
+};
+
+static struct kunit_suite hybrid_test_suite = {
+	.name = "synaptics_tcm_hybrid",
+	.init = hybrid_test_init,
+	.test_cases = hybrid_test_cases,
+};
+
+/* not a report code, so that a notification shows up */
+#define TEST_NO_REPORT 0xff
+
+#define TEST_IN_SIZE 64
+
+enum dispatch_test_module {
+	TEST_MOD_SYNC,
+	TEST_MOD_BOTH,
+	TEST_MOD_IDLE,
+	TEST_MODS,
+};
+
+struct dispatch_test_ctx {
+	struct syna_tcm_hcd hcd;
+	struct syna_tcm_module_pool pool;
+	struct syna_tcm_module_handler handlers[TEST_MODS];
+	unsigned int sync_calls[TEST_MODS];
+	unsigned char sync_ids[TEST_MODS];
+	bool claim;
+	int claim_retval[TEST_MODS];
+	bool report_intact[TEST_MODS];
+	unsigned char *in_buf;
+	struct syna_tcm_buffer kept;
+	unsigned char payload[16];
+	unsigned int payload_length;
+};
+
+static void dispatch_test_syncbox(struct syna_tcm_hcd *tcm_hcd,
+		enum dispatch_test_module mod)
+{
+	struct dispatch_test_ctx *ctx =
+			container_of(tcm_hcd, struct dispatch_test_ctx, hcd);
+
+	ctx->sync_calls[mod]++;
+	ctx->sync_ids[mod] = tcm_hcd->report.id;
+
+	/* an earlier claim must leave the report in place */
+	ctx->report_intact[mod] =
+			tcm_hcd->report.buffer.data_length ==
+			ctx->payload_length &&
+			!memcmp(tcm_hcd->report.buffer.buf, ctx->payload,
+			ctx->payload_length);
+
+	if (ctx->claim)
+		ctx->claim_retval[mod] = syna_tcm_claim_report(tcm_hcd,
+				&ctx->kept);
+}
+
+static int dispatch_test_sync_syncbox(struct syna_tcm_hcd *tcm_hcd)
+{
+	dispatch_test_syncbox(tcm_hcd, TEST_MOD_SYNC);
+
+	return 0;
+}
+
+static int dispatch_test_both_syncbox(struct syna_tcm_hcd *tcm_hcd)
+{
+	dispatch_test_syncbox(tcm_hcd, TEST_MOD_BOTH);
+
+	return 0;
+}
+
+static int dispatch_test_idle_syncbox(struct syna_tcm_hcd *tcm_hcd)
+{
+	dispatch_test_syncbox(tcm_hcd, TEST_MOD_IDLE);
+
+	return 0;
+}
+
+/* asyncbox is run by the notifier thread, never by the dispatch */
+static int dispatch_test_asyncbox(struct syna_tcm_hcd *tcm_hcd)
+{
+	return 0;
+}
+
+static struct syna_tcm_module_cb dispatch_test_modules[TEST_MODS] = {
+	[TEST_MOD_SYNC] = {
+		.syncbox = dispatch_test_sync_syncbox,
+	},
+	[TEST_MOD_BOTH] = {
+		.syncbox = dispatch_test_both_syncbox,
+		.asyncbox = dispatch_test_asyncbox,
+	},
+	[TEST_MOD_IDLE] = {
+		.syncbox = dispatch_test_idle_syncbox,
+		.asyncbox = dispatch_test_asyncbox,
+	},
+};
+
+/**
+ * dispatch_test_send() - Dispatch a report through the fake modules
+ *
+ * The payload is written to the input buffer as read_message() would have
+ * left it, after the message header.
+ */
+static void dispatch_test_send(struct dispatch_test_ctx *ctx,
+		unsigned char code, unsigned char fill)
+{
+	struct syna_tcm_hcd *tcm_hcd = &ctx->hcd;
+
+	ctx->payload_length = sizeof(ctx->payload);
+	memset(ctx->payload, fill, ctx->payload_length);
+
+	memcpy(&tcm_hcd->in.buf[MESSAGE_HEADER_SIZE], ctx->payload,
+			ctx->payload_length);
+	tcm_hcd->status_report_code = code;
+	tcm_hcd->payload_length = ctx->payload_length;
+
+	syna_tcm_dispatch_report(tcm_hcd, &ctx->pool);
+}
+
+static void dispatch_test_deliver(struct kunit *test)
+{
+	struct dispatch_test_ctx *ctx = test->priv;
+	struct syna_tcm_hcd *tcm_hcd = &ctx->hcd;
+
+	/* subscribed the way the touch module is */
+	syna_tcm_subscribe_report(&dispatch_test_modules[TEST_MOD_SYNC],
+			REPORT_TOUCH, true);
+	syna_tcm_subscribe_report(&dispatch_test_modules[TEST_MOD_BOTH],
+			REPORT_TOUCH, true);
+	syna_tcm_subscribe_report(&dispatch_test_modules[TEST_MOD_BOTH],
+			REPORT_IDENTIFY, true);
+	syna_tcm_subscribe_async(&dispatch_test_modules[TEST_MOD_BOTH],
+			REPORT_IDENTIFY, true);
+	syna_tcm_subscribe_report(&dispatch_test_modules[TEST_MOD_IDLE],
+			REPORT_STATUS, true);
+	syna_tcm_subscribe_async(&dispatch_test_modules[TEST_MOD_IDLE],
+			REPORT_STATUS, true);
+
+	/* touch reports reach the syncboxes without waking the notifier */
+	dispatch_test_send(ctx, REPORT_TOUCH, 0x11);
+	KUNIT_EXPECT_EQ(test, ctx->sync_calls[TEST_MOD_SYNC], 1u);
+	KUNIT_EXPECT_EQ(test, ctx->sync_calls[TEST_MOD_BOTH], 1u);
+	KUNIT_EXPECT_EQ(test, ctx->sync_calls[TEST_MOD_IDLE], 0u);
+	KUNIT_EXPECT_TRUE(test, ctx->report_intact[TEST_MOD_BOTH]);
+	KUNIT_EXPECT_EQ(test, tcm_hcd->async_report_id,
+			(unsigned char)TEST_NO_REPORT);
+
+	dispatch_test_send(ctx, REPORT_IDENTIFY, 0x10);
+	KUNIT_EXPECT_EQ(test, ctx->sync_calls[TEST_MOD_SYNC], 1u);
+	KUNIT_EXPECT_EQ(test, ctx->sync_calls[TEST_MOD_BOTH], 2u);
+	KUNIT_EXPECT_EQ(test, ctx->sync_ids[TEST_MOD_BOTH],
+			(unsigned char)REPORT_IDENTIFY);
+	KUNIT_EXPECT_EQ(test, tcm_hcd->async_report_id,
+			(unsigned char)REPORT_IDENTIFY);
+
+	/* a module still being inserted gets nothing */
+	tcm_hcd->async_report_id = TEST_NO_REPORT;
+	ctx->handlers[TEST_MOD_IDLE].insert = true;
+	dispatch_test_send(ctx, REPORT_STATUS, 0x1b);
+	KUNIT_EXPECT_EQ(test, ctx->sync_calls[TEST_MOD_IDLE], 0u);
+	KUNIT_EXPECT_EQ(test, tcm_hcd->async_report_id,
+			(unsigned char)TEST_NO_REPORT);
+
+	ctx->handlers[TEST_MOD_IDLE].insert = false;
+	dispatch_test_send(ctx, REPORT_STATUS, 0x1b);
+	KUNIT_EXPECT_EQ(test, ctx->sync_calls[TEST_MOD_IDLE], 1u);
+	KUNIT_EXPECT_EQ(test, tcm_hcd->async_report_id,
+			(unsigned char)REPORT_STATUS);
+}
+
+static void dispatch_test_claim(struct kunit *test)
+{
+	unsigned int in_size;
+	struct dispatch_test_ctx *ctx = test->priv;
+	struct syna_tcm_hcd *tcm_hcd = &ctx->hcd;
+
+	syna_tcm_subscribe_report(&dispatch_test_modules[TEST_MOD_SYNC],
+			REPORT_TOUCH, true);
+	syna_tcm_subscribe_report(&dispatch_test_modules[TEST_MOD_BOTH],
+			REPORT_TOUCH, true);
+
+	in_size = tcm_hcd->in.buf_size;
+
+	/* the first module keeps the report, the second still reads it */
+	ctx->claim = true;
+	dispatch_test_send(ctx, REPORT_TOUCH, 0xa5);
+	ctx->claim = false;
+
+	KUNIT_EXPECT_EQ(test, ctx->claim_retval[TEST_MOD_SYNC],
+			MESSAGE_HEADER_SIZE);
+	KUNIT_EXPECT_EQ(test, ctx->claim_retval[TEST_MOD_BOTH], -EBUSY);
+	KUNIT_EXPECT_TRUE(test, ctx->report_intact[TEST_MOD_BOTH]);
+
+	/* the storage was exchanged, not copied */
+	KUNIT_EXPECT_PTR_EQ(test, ctx->kept.buf, ctx->in_buf);
+	KUNIT_EXPECT_PTR_NE(test, tcm_hcd->in.buf, ctx->in_buf);
+	KUNIT_EXPECT_GE(test, tcm_hcd->in.buf_size, in_size);
+	KUNIT_EXPECT_EQ(test, ctx->kept.data_length, ctx->payload_length);
+
+	/* outside of a dispatch there is nothing to claim */
+	KUNIT_EXPECT_EQ(test, syna_tcm_claim_report(tcm_hcd, &ctx->kept),
+			-EBUSY);
+
+	/* the next report goes to the new input buffer */
+	dispatch_test_send(ctx, REPORT_TOUCH, 0x5a);
+	KUNIT_EXPECT_TRUE(test, ctx->report_intact[TEST_MOD_SYNC]);
+	KUNIT_EXPECT_TRUE(test, ctx->report_intact[TEST_MOD_BOTH]);
+
+	/* while the claimed one is left alone */
+	KUNIT_EXPECT_EQ(test, ctx->kept.buf[MESSAGE_HEADER_SIZE],
+			(unsigned char)0xa5);
+	KUNIT_EXPECT_EQ(test,
+			ctx->kept.buf[MESSAGE_HEADER_SIZE + ctx->payload_length - 1],
+			(unsigned char)0xa5);
+}
+
+static int dispatch_test_init(struct kunit *test)
+{
+	unsigned int idx;
+	struct dispatch_test_ctx *ctx;
+	struct syna_tcm_hcd *tcm_hcd;
+
+	ctx = kunit_kzalloc(test, sizeof(*ctx), GFP_KERNEL);
+	if (!ctx)
+		return -ENOMEM;
+
+	tcm_hcd = &ctx->hcd;
+
+	tcm_hcd->pdev = kunit_kzalloc(test, sizeof(*tcm_hcd->pdev),
+			GFP_KERNEL);
+	if (!tcm_hcd->pdev)
+		return -ENOMEM;
+
+	/* swapped with the kept buffer, so not owned by the test */
+	ctx->in_buf = kzalloc(TEST_IN_SIZE, GFP_KERNEL);
+	if (!ctx->in_buf)
+		return -ENOMEM;
+
+	INIT_BUFFER(tcm_hcd->in, false);
+	INIT_BUFFER(tcm_hcd->report.buffer, true);
+	INIT_BUFFER(ctx->kept, false);
+	tcm_hcd->in.buf = ctx->in_buf;
+	tcm_hcd->in.buf_size = TEST_IN_SIZE;
+	tcm_hcd->async_report_id = TEST_NO_REPORT;
+	tcm_hcd->notifier_thread = current;
+
+	/* a pool of its own, the registered modules are left alone */
+	mutex_init(&ctx->pool.mutex);
+	INIT_LIST_HEAD(&ctx->pool.list);
+
+	for (idx = 0; idx < TEST_MODS; idx++) {
+		bitmap_zero(dispatch_test_modules[idx].report_mask,
+				REPORT_CODES);
+		bitmap_zero(dispatch_test_modules[idx].async_mask,
+				REPORT_CODES);
+		ctx->handlers[idx].mod_cb = &dispatch_test_modules[idx];
+		list_add_tail(&ctx->handlers[idx].link, &ctx->pool.list);
+	}
+
+	test->priv = ctx;
+
+	return 0;
+}
+
+static void dispatch_test_exit(struct kunit *test)
+{
+	struct dispatch_test_ctx *ctx = test->priv;
+
+	kfree(ctx->hcd.in.buf);
+	kfree(ctx->kept.buf);
+}
+
+static struct kunit_case dispatch_test_cases[] = {
+	KUNIT_CASE(dispatch_test_deliver),
+	KUNIT_CASE(dispatch_test_claim),
+	{}
+};
+
+static struct kunit_suite dispatch_test_suite = {
+	.name = "synaptics_tcm_dispatch",
+	.init = dispatch_test_init,
+	.exit = dispatch_test_exit,
+	.test_cases = dispatch_test_cases,
+};
+
+kunit_test_suites(&hybrid_test_suite, &dispatch_test_suite);
+
+MODULE_DESCRIPTION("Synaptics TCM Core Module KUnit Tests");
+MODULE_LICENSE("GPL v2");
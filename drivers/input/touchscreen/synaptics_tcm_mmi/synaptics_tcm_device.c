@@ -32,7 +32,11 @@
 
 #include <linux/cdev.h>
 #include <linux/gpio.h>
+#include <linux/log2.h>
+#include <linux/mm.h>
+#include <linux/poll.h>
 #include <linux/uaccess.h>
+#include <linux/vmalloc.h>
 #include "synaptics_tcm_core.h"
 
 #define CHAR_DEVICE_NAME "tcm"
@@ -44,12 +48,54 @@
 #define DEVICE_IOC_IRQ _IOW(DEVICE_IOC_MAGIC, 1, int) /* 0x40047301 */
 #define DEVICE_IOC_RAW _IOW(DEVICE_IOC_MAGIC, 2, int) /* 0x40047302 */
 #define DEVICE_IOC_CONCURRENT _IOW(DEVICE_IOC_MAGIC, 3, int) /* 0x40047303 */
+#define DEVICE_IOC_RING _IOW(DEVICE_IOC_MAGIC, 4, struct device_ring_setup) /* 0x40087304 */
+
+#define RING_MAX_SIZE (16 * 1024 * 1024)
+
+/*
+ * Report ring shared with user space through mmap() of the char device
+ *
+ * DEVICE_IOC_RING allocates the ring once per open: a header page followed
+ * by frames slots of frame_size bytes each, frames being a power of two.
+ * Every report received from the device is stored in slot head % frames as
+ * a struct device_ring_frame and head is advanced. The reader consumes the
+ * slots up to head and then advances tail. When the ring is full, reports
+ * are counted in dropped instead. poll() reports POLLIN while head != tail.
+ * timestamp_ns is the CLOCK_MONOTONIC time the attention of the report was
+ * seen.
+ */
+struct device_ring_setup {
+	__u32 frames;
+	__u32 frame_size;
+};
+
+struct device_ring_header {
+	__u32 head;
+	__u32 tail;
+	__u32 frames;
+	__u32 frame_size;
+	__u32 dropped;
+};
+
+struct device_ring_frame {
+	__u64 timestamp_ns;
+	__u32 length;
+	__u8 id;
+	__u8 reserved[3];
+	__u8 data[];
+};
 
 struct device_hcd {
 	dev_t dev_num;
 	bool raw_mode;
 	bool concurrent;
 	unsigned int ref_count;
+	unsigned int ring_head;
+	unsigned int ring_frames;
+	unsigned int ring_frame_size;
+	struct device_ring_header *ring;
+	struct mutex ring_mutex;
+	wait_queue_head_t ring_wq;
 	struct cdev char_dev;
 	struct class *class;
 	struct device *device;
@@ -63,6 +109,8 @@ DECLARE_COMPLETION(device_remove_complete);
 
 static struct device_hcd *device_hcd;
 
+static struct syna_tcm_module_cb device_module;
+
 static int rmidev_major_num;
 
 static void device_capture_touch_report(unsigned int count)
@@ -228,12 +276,104 @@ static int device_capture_touch_report_config(unsigned int count)
 	}
 
 	tcm_hcd->config.data_length = size;
+	tcm_hcd->config_seq++;
 
 	UNLOCK_BUFFER(tcm_hcd->config);
 
 	return 0;
 }
 
+/**
+ * device_alloc_ring() - Allocate report ring
+ *
+ * Allocate the report ring described by the struct device_ring_setup at arg
+ * in user space. The ring is freed when the char device is released.
+ */
+static int device_alloc_ring(unsigned long arg)
+{
+	unsigned long size;
+	struct device_ring_setup setup;
+	struct device_ring_header *ring;
+	struct syna_tcm_hcd *tcm_hcd = device_hcd->tcm_hcd;
+
+	if (copy_from_user(&setup, (void __user *)arg, sizeof(setup)))
+		return -EFAULT;
+
+	if (device_hcd->ring)
+		return -EBUSY;
+
+	if (!is_power_of_2(setup.frames) ||
+			setup.frame_size <= sizeof(struct device_ring_frame) ||
+			setup.frame_size % sizeof(__u64))
+		return -EINVAL;
+
+	if ((unsigned long)setup.frames * setup.frame_size >
+			RING_MAX_SIZE - PAGE_SIZE)
+		return -EINVAL;
+
+	size = PAGE_SIZE + (unsigned long)setup.frames * setup.frame_size;
+
+	ring = vmalloc_user(size);
+	if (!ring) {
+		LOGE(tcm_hcd->pdev->dev.parent,
+				"Failed to allocate memory for report ring\n");
+		return -ENOMEM;
+	}
+
+	ring->frames = setup.frames;
+	ring->frame_size = setup.frame_size;
+
+	LOCK_BUFFER(tcm_hcd->report.buffer);
+
+	device_hcd->ring_head = 0;
+	device_hcd->ring_frames = setup.frames;
+	device_hcd->ring_frame_size = setup.frame_size;
+
+	/* pairs with the acquire in device_poll() and device_mmap() */
+	smp_store_release(&device_hcd->ring, ring);
+
+	/* REPORT_HDL carries no data and is dispatched without the report
+	 * buffer lock, which device_free_ring() relies on */
+	bitmap_fill(device_module.report_mask, REPORT_CODES);
+	clear_bit(REPORT_HDL, device_module.report_mask);
+
+	UNLOCK_BUFFER(tcm_hcd->report.buffer);
+
+	return 0;
+}
+
+/**
+ * device_free_ring() - Free report ring
+ *
+ * Unpublish the ring under ring_mutex, which keeps device_poll() and
+ * device_mmap() off it, then free it once device_syncbox() is done with it.
+ * While reports are dispatched, a device_syncbox() still running holds the
+ * report buffer lock, so taking that lock waits for it. device_remove() runs
+ * with the module pool locked, where no syncbox runs and the report buffer
+ * lock must not be taken, so it passes dispatching as false.
+ */
+static void device_free_ring(bool dispatching)
+{
+	struct device_ring_header *ring;
+	struct syna_tcm_hcd *tcm_hcd = device_hcd->tcm_hcd;
+
+	mutex_lock(&device_hcd->ring_mutex);
+
+	ring = device_hcd->ring;
+	WRITE_ONCE(device_hcd->ring, NULL);
+
+	bitmap_zero(device_module.report_mask, REPORT_CODES);
+
+	mutex_unlock(&device_hcd->ring_mutex);
+
+	if (dispatching) {
+		LOCK_BUFFER(tcm_hcd->report.buffer);
+		UNLOCK_BUFFER(tcm_hcd->report.buffer);
+	}
+
+	vfree(ring);
+}
+
 #ifdef HAVE_UNLOCKED_IOCTL
 static long device_ioctl(struct file *filp, unsigned int cmd, unsigned long arg)
 #else
@@ -270,6 +410,9 @@ static int device_ioctl(struct inode *inp, struct file *filp, unsigned int cmd,
 		else if (arg == 1)
 			device_hcd->concurrent = true;
 		break;
+	case DEVICE_IOC_RING:
+		retval = device_alloc_ring(arg);
+		break;
 	default:
 		retval = -ENOTTY;
 		break;
@@ -359,6 +502,52 @@ exit:
 	return retval;
 }
 
+static unsigned int device_poll(struct file *filp, poll_table *wait)
+{
+	unsigned int mask = 0;
+	struct device_ring_header *ring;
+
+	mutex_lock(&device_hcd->ring_mutex);
+
+	/* without a ring, answer as for a device without poll() */
+	ring = smp_load_acquire(&device_hcd->ring);
+	if (!ring) {
+		mask = DEFAULT_POLLMASK;
+		goto exit;
+	}
+
+	poll_wait(filp, &device_hcd->ring_wq, wait);
+
+	/* writes never block */
+	mask = POLLOUT | POLLWRNORM;
+
+	if (smp_load_acquire(&ring->head) != READ_ONCE(ring->tail))
+		mask |= POLLIN | POLLRDNORM;
+
+exit:
+	mutex_unlock(&device_hcd->ring_mutex);
+
+	return mask;
+}
+
+static int device_mmap(struct file *filp, struct vm_area_struct *vma)
+{
+	int retval;
+	struct device_ring_header *ring;
+
+	mutex_lock(&device_hcd->ring_mutex);
+
+	ring = smp_load_acquire(&device_hcd->ring);
+	if (ring)
+		retval = remap_vmalloc_range(vma, ring, vma->vm_pgoff);
+	else
+		retval = -EINVAL;
+
+	mutex_unlock(&device_hcd->ring_mutex);
+
+	return retval;
+}
+
 static ssize_t device_write(struct file *filp, const char __user *buf,
 		size_t count, loff_t *f_pos)
 {
@@ -475,6 +664,10 @@ static int device_release(struct inode *inp, struct file *filp)
 	if (device_hcd->ref_count)
 		device_hcd->ref_count--;
 
+	/* the file stays open while the ring is mapped */
+	if (device_hcd->ring)
+		device_free_ring(true);
+
 	mutex_unlock(&tcm_hcd->extif_mutex);
 
 	return 0;
@@ -524,6 +717,8 @@ static const struct file_operations device_fops = {
 	.llseek = device_llseek,
 	.read = device_read,
 	.write = device_write,
+	.poll = device_poll,
+	.mmap = device_mmap,
 	.open = device_open,
 	.release = device_release,
 };
@@ -549,6 +744,9 @@ static int device_init(struct syna_tcm_hcd *tcm_hcd)
 	INIT_BUFFER(device_hcd->resp, false);
 	INIT_BUFFER(device_hcd->report, false);
 
+	mutex_init(&device_hcd->ring_mutex);
+	init_waitqueue_head(&device_hcd->ring_wq);
+
 	if (rmidev_major_num) {
 		dev_num = MKDEV(rmidev_major_num, 0);
 		retval = register_chrdev_region(dev_num, 1,
@@ -649,6 +847,8 @@ static int device_remove(struct syna_tcm_hcd *tcm_hcd)
 
 	unregister_chrdev_region(device_hcd->dev_num, 1);
 
+	device_free_ring(false);
+
 	RELEASE_BUFFER(device_hcd->report);
 	RELEASE_BUFFER(device_hcd->resp);
 	RELEASE_BUFFER(device_hcd->out);
@@ -662,6 +862,58 @@ exit:
 	return 0;
 }
 
+/**
+ * device_syncbox() - Store report in report ring
+ *
+ * Called for every report with the report buffer and the module pool locked,
+ * which keeps device_free_ring() from freeing the ring under it. Only head is
+ * written here and only tail is read, so the reader needs no lock and no
+ * system call per report.
+ */
+static int device_syncbox(struct syna_tcm_hcd *tcm_hcd)
+{
+	unsigned int tail;
+	unsigned int length;
+	struct device_ring_header *ring;
+	struct device_ring_frame *frame;
+
+	if (!device_hcd)
+		return 0;
+
+	ring = READ_ONCE(device_hcd->ring);
+	if (!ring)
+		return 0;
+
+	tail = smp_load_acquire(&ring->tail);
+
+	if (device_hcd->ring_head - tail >= device_hcd->ring_frames) {
+		ring->dropped++;
+		return 0;
+	}
+
+	frame = (struct device_ring_frame *)((unsigned char *)ring + PAGE_SIZE +
+			(device_hcd->ring_head & (device_hcd->ring_frames - 1)) *
+			device_hcd->ring_frame_size);
+
+	length = MIN(tcm_hcd->report.buffer.data_length,
+			device_hcd->ring_frame_size - sizeof(*frame));
+
+	frame->timestamp_ns = ktime_to_ns(tcm_hcd->frame_time);
+	frame->length = length;
+	frame->id = tcm_hcd->report.id;
+	memcpy(frame->data, tcm_hcd->report.buffer.buf, length);
+
+	device_hcd->ring_head++;
+	smp_store_release(&ring->head, device_hcd->ring_head);
+
+	/* pairs with the barrier in poll_wait() of a reader going to sleep */
+	smp_mb();
+	if (waitqueue_active(&device_hcd->ring_wq))
+		wake_up_interruptible(&device_hcd->ring_wq);
+
+	return 0;
+}
+
 static int device_reset(struct syna_tcm_hcd *tcm_hcd)
 {
 	int retval;
@@ -678,7 +930,7 @@ static struct syna_tcm_module_cb device_module = {
 	.type = TCM_DEVICE,
 	.init = device_init,
 	.remove = device_remove,
-	.syncbox = NULL,
+	.syncbox = device_syncbox,
 	.asyncbox = NULL,
 	.reset = device_reset,
 	.suspend = NULL,
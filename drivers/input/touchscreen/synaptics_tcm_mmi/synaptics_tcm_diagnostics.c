@@ -42,6 +42,8 @@ enum pingpong_state {
 struct diag_hcd {
 	pid_t pid;
 	unsigned char report_type;
+	unsigned int ping_offset;
+	unsigned int pong_offset;
 	enum pingpong_state state;
 	struct kobject *sysfs_dir;
 	struct siginfo sigio;
@@ -55,6 +57,8 @@ DECLARE_COMPLETION(diag_remove_complete);
 
 static struct diag_hcd *diag_hcd;
 
+static struct syna_tcm_module_cb diag_module;
+
 STORE_PROTOTYPE(diag, pid)
 SHOW_PROTOTYPE(diag, size)
 STORE_PROTOTYPE(diag, type)
@@ -161,8 +165,12 @@ static ssize_t diag_sysfs_type_store(struct device *dev,
 
 	mutex_lock(&tcm_hcd->extif_mutex);
 
+	syna_tcm_subscribe_report(&diag_module, diag_hcd->report_type, false);
+
 	diag_hcd->report_type = (unsigned char)input;
 
+	syna_tcm_subscribe_report(&diag_module, diag_hcd->report_type, true);
+
 	mutex_unlock(&tcm_hcd->extif_mutex);
 
 	return count;
@@ -301,8 +309,9 @@ static ssize_t diag_sysfs_data_show(struct file *data_file,
 		if (diag_hcd->ping.data_length) {
 			retval = secure_memcpy(buf,
 					count,
-					&diag_hcd->ping.buf[pos],
-					diag_hcd->ping.buf_size - pos,
+					&diag_hcd->ping.buf[diag_hcd->ping_offset + pos],
+					diag_hcd->ping.buf_size -
+					diag_hcd->ping_offset - pos,
 					readlen);
 		}
 
@@ -320,8 +329,9 @@ static ssize_t diag_sysfs_data_show(struct file *data_file,
 		if (diag_hcd->pong.data_length) {
 			retval = secure_memcpy(buf,
 					count,
-					&diag_hcd->pong.buf[pos],
-					diag_hcd->pong.buf_size - pos,
+					&diag_hcd->pong.buf[diag_hcd->pong_offset + pos],
+					diag_hcd->pong.buf_size -
+					diag_hcd->pong_offset - pos,
 					readlen);
 		}
 
@@ -341,72 +351,79 @@ exit:
 	return retval;
 }
 
+/**
+ * diag_store_report() - keep report for retrieval through sysfs
+ *
+ * Take over the report from the core if possible, or copy it otherwise.
+ * offset is set to where the report payload starts in buffer.
+ */
+static int diag_store_report(struct syna_tcm_buffer *buffer,
+		unsigned int *offset)
+{
+	int retval;
+	struct syna_tcm_hcd *tcm_hcd = diag_hcd->tcm_hcd;
+
+	retval = syna_tcm_claim_report(tcm_hcd, buffer);
+	if (retval >= 0) {
+		*offset = retval;
+		return 0;
+	}
+
+	retval = syna_tcm_alloc_mem(tcm_hcd,
+			buffer,
+			tcm_hcd->report.buffer.data_length);
+	if (retval < 0) {
+		LOGE(tcm_hcd->pdev->dev.parent,
+				"Failed to allocate memory for report buffer\n");
+		return retval;
+	}
+
+	retval = secure_memcpy(buffer->buf,
+			buffer->buf_size,
+			tcm_hcd->report.buffer.buf,
+			tcm_hcd->report.buffer.buf_size,
+			tcm_hcd->report.buffer.data_length);
+	if (retval < 0) {
+		LOGE(tcm_hcd->pdev->dev.parent,
+				"Failed to copy report data\n");
+		return retval;
+	}
+
+	buffer->data_length = tcm_hcd->report.buffer.data_length;
+	*offset = 0;
+
+	return 0;
+}
+
 static void diag_report(void)
 {
 	int retval;
 	static enum pingpong_state state = PING;
-	struct syna_tcm_hcd *tcm_hcd = diag_hcd->tcm_hcd;
 
 	if (state == PING) {
 		LOCK_BUFFER(diag_hcd->ping);
 
-		retval = syna_tcm_alloc_mem(tcm_hcd,
-				&diag_hcd->ping,
-				tcm_hcd->report.buffer.data_length);
-		if (retval < 0) {
-			LOGE(tcm_hcd->pdev->dev.parent,
-					"Failed to allocate memory for diag_hcd->ping.buf\n");
-			UNLOCK_BUFFER(diag_hcd->ping);
-			return;
-		}
-
-		retval = secure_memcpy(diag_hcd->ping.buf,
-				diag_hcd->ping.buf_size,
-				tcm_hcd->report.buffer.buf,
-				tcm_hcd->report.buffer.buf_size,
-				tcm_hcd->report.buffer.data_length);
-		if (retval < 0) {
-			LOGE(tcm_hcd->pdev->dev.parent,
-					"Failed to copy report data\n");
-			UNLOCK_BUFFER(diag_hcd->ping);
-			return;
-		}
-
-		diag_hcd->ping.data_length = tcm_hcd->report.buffer.data_length;
+		retval = diag_store_report(&diag_hcd->ping,
+				&diag_hcd->ping_offset);
 
 		UNLOCK_BUFFER(diag_hcd->ping);
 
+		if (retval < 0)
+			return;
+
 		diag_hcd->state = state;
 		state = PONG;
 	} else {
 		LOCK_BUFFER(diag_hcd->pong);
 
-		retval = syna_tcm_alloc_mem(tcm_hcd,
-				&diag_hcd->pong,
-				tcm_hcd->report.buffer.data_length);
-		if (retval < 0) {
-			LOGE(tcm_hcd->pdev->dev.parent,
-					"Failed to allocate memory for diag_hcd->pong.buf\n");
-			UNLOCK_BUFFER(diag_hcd->pong);
-			return;
-		}
-
-		retval = secure_memcpy(diag_hcd->pong.buf,
-				diag_hcd->pong.buf_size,
-				tcm_hcd->report.buffer.buf,
-				tcm_hcd->report.buffer.buf_size,
-				tcm_hcd->report.buffer.data_length);
-		if (retval < 0) {
-			LOGE(tcm_hcd->pdev->dev.parent,
-					"Failed to copy report data\n");
-			UNLOCK_BUFFER(diag_hcd->pong);
-			return;
-		}
-
-		diag_hcd->pong.data_length = tcm_hcd->report.buffer.data_length;
+		retval = diag_store_report(&diag_hcd->pong,
+				&diag_hcd->pong_offset);
 
 		UNLOCK_BUFFER(diag_hcd->pong);
 
+		if (retval < 0)
+			return;
+
 		diag_hcd->state = state;
 		state = PING;
 	}
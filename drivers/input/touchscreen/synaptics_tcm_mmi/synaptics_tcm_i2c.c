@@ -431,6 +431,10 @@ static int syna_tcm_i2c_probe(struct i2c_client *i2c,
 #endif
 
 	bus_io.type = BUS_I2C;
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 1, 0))
+	if (i2c->adapter->quirks)
+		bus_io.max_read_size = i2c->adapter->quirks->max_read_len;
+#endif
 	bus_io.read = syna_tcm_i2c_read;
 	bus_io.write = syna_tcm_i2c_write;
 	bus_io.rmi_read = syna_tcm_i2c_rmi_read;
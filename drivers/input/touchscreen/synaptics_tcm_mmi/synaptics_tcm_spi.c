@@ -594,6 +594,11 @@ static int syna_tcm_spi_probe(struct spi_device *spi)
 	}
 
 	bus_io.type = BUS_SPI;
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(4, 5, 0))
+	if (hw_if.bdata->byte_delay_us == 0 &&
+			spi_max_transfer_size(spi) < UINT_MAX)
+		bus_io.max_read_size = spi_max_transfer_size(spi);
+#endif
 	bus_io.read = syna_tcm_spi_read;
 	bus_io.write = syna_tcm_spi_write;
 	bus_io.rmi_read = syna_tcm_spi_rmi_read;
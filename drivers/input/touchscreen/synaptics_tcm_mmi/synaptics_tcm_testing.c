@@ -100,6 +100,8 @@ DECLARE_COMPLETION(testing_remove_complete);
 
 static struct testing_hcd *testing_hcd;
 
+static struct syna_tcm_module_cb testing_module;
+
 static int testing_dynamic_range(void);
 
 static int testing_dynamic_range_lpwg(void);
@@ -400,6 +402,8 @@ static int testing_collect_reports(enum report_type report_type,
 	testing_hcd->report_type = report_type;
 	testing_hcd->num_of_reports = num_of_reports;
 
+	syna_tcm_subscribe_report(&testing_module, report_type, true);
+
 #if (LINUX_VERSION_CODE >= KERNEL_VERSION(3, 13, 0))
 	reinit_completion(&report_complete);
 #else
@@ -488,6 +492,8 @@ static int testing_collect_reports(enum report_type report_type,
 		retval = -EIO;
 
 exit:
+	syna_tcm_subscribe_report(&testing_module, report_type, false);
+
 	testing_hcd->report_type = 0;
 
 	return retval;
@@ -32,7 +32,9 @@
 
 #include <linux/input/mt.h>
 #include <linux/interrupt.h>
+#include <linux/bitmap.h>
 #include "synaptics_tcm_core.h"
+#include "synaptics_tcm_touch.h"
 
 #define TYPE_B_PROTOCOL
 
@@ -47,86 +49,49 @@ enum touch_status {
 	NOP = -1,
 };
 
-enum touch_report_code {
-	TOUCH_END = 0,
-	TOUCH_FOREACH_ACTIVE_OBJECT,
-	TOUCH_FOREACH_OBJECT,
-	TOUCH_FOREACH_END,
-	TOUCH_PAD_TO_NEXT_BYTE,
-	TOUCH_TIMESTAMP,
-	TOUCH_OBJECT_N_INDEX,
-	TOUCH_OBJECT_N_CLASSIFICATION,
-	TOUCH_OBJECT_N_X_POSITION,
-	TOUCH_OBJECT_N_Y_POSITION,
-	TOUCH_OBJECT_N_Z,
-	TOUCH_OBJECT_N_X_WIDTH,
-	TOUCH_OBJECT_N_Y_WIDTH,
-	TOUCH_OBJECT_N_TX_POSITION_TIXELS,
-	TOUCH_OBJECT_N_RX_POSITION_TIXELS,
-	TOUCH_0D_BUTTONS_STATE,
-	TOUCH_GESTURE_DOUBLE_TAP,
-	TOUCH_FRAME_RATE,
-	TOUCH_POWER_IM,
-	TOUCH_CID_IM,
-	TOUCH_RAIL_IM,
-	TOUCH_CID_VARIANCE_IM,
-	TOUCH_NSM_FREQUENCY,
-	TOUCH_NSM_STATE,
-	TOUCH_NUM_OF_ACTIVE_OBJECTS,
-	TOUCH_NUM_OF_CPU_CYCLES_USED_SINCE_LAST_FRAME,
-	TOUCH_TUNING_GAUSSIAN_WIDTHS = 0x80,
-	TOUCH_TUNING_SMALL_OBJECT_PARAMS,
-	TOUCH_TUNING_0D_BUTTONS_VARIANCE,
-};
-
-struct object_data {
-	unsigned char status;
-	unsigned int x_pos;
-	unsigned int y_pos;
-	unsigned int x_width;
-	unsigned int y_width;
-	unsigned int z;
-	unsigned int tx_pos;
-	unsigned int rx_pos;
-};
-
-struct input_params {
-	unsigned int max_x;
-	unsigned int max_y;
-	unsigned int max_objects;
-};
-
-struct touch_data {
-	struct object_data *object_data;
-	unsigned int timestamp;
-	unsigned int buttons_state;
-	unsigned int gesture_double_tap;
-	unsigned int frame_rate;
-	unsigned int power_im;
-	unsigned int cid_im;
-	unsigned int rail_im;
-	unsigned int cid_variance_im;
-	unsigned int nsm_frequency;
-	unsigned int nsm_state;
-	unsigned int num_of_active_objects;
-	unsigned int num_of_cpu_cycles;
-};
-
-struct touch_hcd {
-	bool irq_wake;
-	bool report_touch;
-	bool suspend_touch;
-	unsigned char *prev_status;
-	unsigned int max_x;
-	unsigned int max_y;
-	unsigned int max_objects;
-	struct mutex report_mutex;
-	struct input_dev *input_dev;
-	struct touch_data touch_data;
-	struct input_params input_params;
-	struct syna_tcm_buffer out;
-	struct syna_tcm_buffer resp;
-	struct syna_tcm_hcd *tcm_hcd;
+static const struct {
+	unsigned char type;
+	unsigned short dest;
+} touch_fields[] = {
+	[TOUCH_TIMESTAMP] = {TOUCH_OP_FIELD,
+			offsetof(struct touch_data, timestamp)},
+	[TOUCH_OBJECT_N_INDEX] = {TOUCH_OP_OBJECT_INDEX, 0},
+	[TOUCH_OBJECT_N_CLASSIFICATION] = {TOUCH_OP_OBJECT_STATUS, 0},
+	[TOUCH_OBJECT_N_X_POSITION] = {TOUCH_OP_OBJECT_FIELD,
+			offsetof(struct object_data, x_pos)},
+	[TOUCH_OBJECT_N_Y_POSITION] = {TOUCH_OP_OBJECT_FIELD,
+			offsetof(struct object_data, y_pos)},
+	[TOUCH_OBJECT_N_Z] = {TOUCH_OP_OBJECT_FIELD,
+			offsetof(struct object_data, z)},
+	[TOUCH_OBJECT_N_X_WIDTH] = {TOUCH_OP_OBJECT_FIELD,
+			offsetof(struct object_data, x_width)},
+	[TOUCH_OBJECT_N_Y_WIDTH] = {TOUCH_OP_OBJECT_FIELD,
+			offsetof(struct object_data, y_width)},
+	[TOUCH_OBJECT_N_TX_POSITION_TIXELS] = {TOUCH_OP_OBJECT_FIELD,
+			offsetof(struct object_data, tx_pos)},
+	[TOUCH_OBJECT_N_RX_POSITION_TIXELS] = {TOUCH_OP_OBJECT_FIELD,
+			offsetof(struct object_data, rx_pos)},
+	[TOUCH_0D_BUTTONS_STATE] = {TOUCH_OP_FIELD,
+			offsetof(struct touch_data, buttons_state)},
+	[TOUCH_GESTURE_DOUBLE_TAP] = {TOUCH_OP_FIELD,
+			offsetof(struct touch_data, gesture_double_tap)},
+	[TOUCH_FRAME_RATE] = {TOUCH_OP_FIELD,
+			offsetof(struct touch_data, frame_rate)},
+	[TOUCH_POWER_IM] = {TOUCH_OP_FIELD,
+			offsetof(struct touch_data, power_im)},
+	[TOUCH_CID_IM] = {TOUCH_OP_FIELD,
+			offsetof(struct touch_data, cid_im)},
+	[TOUCH_RAIL_IM] = {TOUCH_OP_FIELD,
+			offsetof(struct touch_data, rail_im)},
+	[TOUCH_CID_VARIANCE_IM] = {TOUCH_OP_FIELD,
+			offsetof(struct touch_data, cid_variance_im)},
+	[TOUCH_NSM_FREQUENCY] = {TOUCH_OP_FIELD,
+			offsetof(struct touch_data, nsm_frequency)},
+	[TOUCH_NSM_STATE] = {TOUCH_OP_FIELD,
+			offsetof(struct touch_data, nsm_state)},
+	[TOUCH_NUM_OF_ACTIVE_OBJECTS] = {TOUCH_OP_ACTIVE_COUNT, 0},
+	[TOUCH_NUM_OF_CPU_CYCLES_USED_SINCE_LAST_FRAME] = {TOUCH_OP_FIELD,
+			offsetof(struct touch_data, num_of_cpu_cycles)},
 };
 
 DECLARE_COMPLETION(touch_remove_complete);
@@ -171,397 +136,297 @@ static void touch_free_objects(void)
 }
 
 /**
- * touch_get_report_data() - Retrieve data from touch report
+ * touch_get_bits() - Retrieve data from touch report
  *
  * Retrieve data from the touch report based on the bit offset and bit length
- * information from the touch report configuration.
+ * of a field. Fields lying beyond the end of the report read as 0.
  */
-static int touch_get_report_data(unsigned int offset,
-		unsigned int bits, unsigned int *data)
+static inline unsigned int touch_get_bits(const unsigned char *report,
+		unsigned int report_bits, unsigned int offset, unsigned int bits)
 {
-	unsigned char mask;
-	unsigned char byte_data;
-	unsigned int output_data;
-	unsigned int bit_offset;
-	unsigned int byte_offset;
-	unsigned int data_bits;
-	unsigned int available_bits;
-	unsigned int remaining_bits;
-	unsigned char *touch_report;
-	struct syna_tcm_hcd *tcm_hcd = touch_hcd->tcm_hcd;
-
-	if (bits == 0 || bits > 32) {
-		LOGE(tcm_hcd->pdev->dev.parent,
-				"Invalid number of bits\n");
-		return -EINVAL;
-	}
+	unsigned int idx;
+	unsigned int shift;
+	unsigned long long data;
+	const unsigned char *src;
 
-	if (offset + bits > tcm_hcd->report.buffer.data_length * 8) {
-		*data = 0;
+	if (offset + bits > report_bits)
 		return 0;
-	}
-
-	touch_report = tcm_hcd->report.buffer.buf;
-
-	output_data = 0;
-	remaining_bits = bits;
-
-	bit_offset = offset % 8;
-	byte_offset = offset / 8;
-
-	while (remaining_bits) {
-		byte_data = touch_report[byte_offset];
-		byte_data >>= bit_offset;
 
-		available_bits = 8 - bit_offset;
-		data_bits = MIN(available_bits, remaining_bits);
-		mask = 0xff >> (8 - data_bits);
-
-		byte_data &= mask;
-
-		output_data |= byte_data << (bits - remaining_bits);
-
-		bit_offset = 0;
-		byte_offset += 1;
-		remaining_bits -= data_bits;
+	src = &report[offset / 8];
+	shift = offset % 8;
+
+	if (shift == 0) {
+		switch (bits) {
+		case 8:
+			return src[0];
+		case 16:
+			return le2_to_uint(src);
+		case 32:
+			return le4_to_uint(src);
+		default:
+			break;
+		}
 	}
 
-	*data = output_data;
+	data = 0;
+	for (idx = 0; idx < ceil_div(shift + bits, 8); idx++)
+		data |= (unsigned long long)src[idx] << (idx * 8);
 
-	return 0;
+	return (unsigned int)((data >> shift) & ((1ULL << bits) - 1));
 }
 
 /**
- * touch_parse_report() - Parse touch report
+ * touch_compile_report_config() - Compile touch report configuration
  *
- * Traverse through the touch report configuration and parse the touch report
- * generated by the device accordingly to retrieve the touch data.
+ * @hcd: handle of touch module
+ *
+ * Translate the touch report configuration into a table of operations that
+ * touch_parse_report() runs for every report. The caller holds the config
+ * buffer lock. Errors are kept in hcd->ops_error and returned by
+ * touch_parse_report() for each report until the configuration changes.
  */
-static int touch_parse_report(void)
+static int touch_compile_report_config(struct touch_hcd *hcd)
 {
-	int retval;
-	bool active_only = false;
-	bool num_of_active_objects;
+	int retval = 0;
+	bool loop = false;
 	unsigned char code;
-	unsigned int size;
 	unsigned int idx;
-	unsigned int obj;
-	unsigned int next;
-	unsigned int data;
-	unsigned int bits;
-	unsigned int offset;
-	unsigned int objects;
-	unsigned int active_objects = 0;
-	unsigned int report_size;
+	unsigned int count;
+	unsigned int end_of_foreach = 0;
 	unsigned int config_size;
 	unsigned char *config_data;
-	struct touch_data *touch_data;
-	struct object_data *object_data;
-	struct syna_tcm_hcd *tcm_hcd = touch_hcd->tcm_hcd;
-	static unsigned int end_of_foreach;
+	struct touch_report_op *op;
+	struct syna_tcm_hcd *tcm_hcd = hcd->tcm_hcd;
 
-	touch_data = &touch_hcd->touch_data;
-	object_data = touch_hcd->touch_data.object_data;
+	hcd->config_seq = tcm_hcd->config_seq;
 
 	config_data = tcm_hcd->config.buf;
 	config_size = tcm_hcd->config.data_length;
 
-	report_size = tcm_hcd->report.buffer.data_length;
-
-	size = sizeof(*object_data) * touch_hcd->max_objects;
-	memset(touch_hcd->touch_data.object_data, 0x00, size);
-
-	num_of_active_objects = false;
+	if (hcd->ops_size < config_size + 1) {
+		kfree(hcd->ops);
+		hcd->ops = kcalloc(config_size + 1,
+				sizeof(*hcd->ops), GFP_KERNEL);
+		if (!hcd->ops) {
+			LOGE(tcm_hcd->pdev->dev.parent,
+					"Failed to allocate memory for touch_hcd->ops\n");
+			hcd->ops_size = 0;
+			hcd->ops_error = -ENOMEM;
+			return -ENOMEM;
+		}
+		hcd->ops_size = config_size + 1;
+	}
 
 	idx = 0;
-	offset = 0;
-	objects = 0;
+	count = 0;
 	while (idx < config_size) {
 		code = config_data[idx++];
+		op = &hcd->ops[count];
+
 		switch (code) {
 		case TOUCH_END:
 			goto exit;
 		case TOUCH_FOREACH_ACTIVE_OBJECT:
-			obj = 0;
-			next = idx;
-			active_only = true;
-			break;
 		case TOUCH_FOREACH_OBJECT:
-			obj = 0;
-			next = idx;
-			active_only = false;
-			break;
+			op->type = TOUCH_OP_FOREACH;
+			op->bits = code == TOUCH_FOREACH_ACTIVE_OBJECT;
+			loop = true;
+			count++;
+			continue;
 		case TOUCH_FOREACH_END:
-			end_of_foreach = idx;
-			if (active_only) {
-				if (num_of_active_objects) {
-					objects++;
-					if (objects < active_objects)
-						idx = next;
-				} else if (offset < report_size * 8) {
-					idx = next;
-				}
-			} else {
-				obj++;
-				if (obj < touch_hcd->max_objects)
-					idx = next;
-			}
-			break;
+			if (!loop)
+				continue;
+			op->type = TOUCH_OP_FOREACH_END;
+			count++;
+			end_of_foreach = count;
+			continue;
 		case TOUCH_PAD_TO_NEXT_BYTE:
-			offset = ceil_div(offset, 8) * 8;
-			break;
-		case TOUCH_TIMESTAMP:
-			bits = config_data[idx++];
-			retval = touch_get_report_data(offset, bits, &data);
-			if (retval < 0) {
-				LOGE(tcm_hcd->pdev->dev.parent,
-						"Failed to get timestamp\n");
-				return retval;
-			}
-			touch_data->timestamp = data;
-			offset += bits;
-			break;
-		case TOUCH_OBJECT_N_INDEX:
-			bits = config_data[idx++];
-			retval = touch_get_report_data(offset, bits, &obj);
-			if (retval < 0) {
-				LOGE(tcm_hcd->pdev->dev.parent,
-						"Failed to get object index\n");
-				return retval;
-			}
-			offset += bits;
-			break;
-		case TOUCH_OBJECT_N_CLASSIFICATION:
-			bits = config_data[idx++];
-			retval = touch_get_report_data(offset, bits, &data);
-			if (retval < 0) {
-				LOGE(tcm_hcd->pdev->dev.parent,
-						"Failed to get object classification\n");
-				return retval;
-			}
-			object_data[obj].status = data;
-			offset += bits;
-			break;
-		case TOUCH_OBJECT_N_X_POSITION:
-			bits = config_data[idx++];
-			retval = touch_get_report_data(offset, bits, &data);
-			if (retval < 0) {
-				LOGE(tcm_hcd->pdev->dev.parent,
-						"Failed to get object x position\n");
-				return retval;
-			}
-			object_data[obj].x_pos = data;
-			offset += bits;
-			break;
-		case TOUCH_OBJECT_N_Y_POSITION:
-			bits = config_data[idx++];
-			retval = touch_get_report_data(offset, bits, &data);
-			if (retval < 0) {
-				LOGE(tcm_hcd->pdev->dev.parent,
-						"Failed to get object y position\n");
-				return retval;
-			}
-			object_data[obj].y_pos = data;
-			offset += bits;
-			break;
-		case TOUCH_OBJECT_N_Z:
-			bits = config_data[idx++];
-			retval = touch_get_report_data(offset, bits, &data);
-			if (retval < 0) {
-				LOGE(tcm_hcd->pdev->dev.parent,
-						"Failed to get object z\n");
-				return retval;
-			}
-			object_data[obj].z = data;
-			offset += bits;
-			break;
-		case TOUCH_OBJECT_N_X_WIDTH:
-			bits = config_data[idx++];
-			retval = touch_get_report_data(offset, bits, &data);
-			if (retval < 0) {
-				LOGE(tcm_hcd->pdev->dev.parent,
-						"Failed to get object x width\n");
-				return retval;
-			}
-			object_data[obj].x_width = data;
-			offset += bits;
-			break;
-		case TOUCH_OBJECT_N_Y_WIDTH:
-			bits = config_data[idx++];
-			retval = touch_get_report_data(offset, bits, &data);
-			if (retval < 0) {
-				LOGE(tcm_hcd->pdev->dev.parent,
-						"Failed to get object y width\n");
-				return retval;
-			}
-			object_data[obj].y_width = data;
-			offset += bits;
-			break;
-		case TOUCH_OBJECT_N_TX_POSITION_TIXELS:
-			bits = config_data[idx++];
-			retval = touch_get_report_data(offset, bits, &data);
-			if (retval < 0) {
-				LOGE(tcm_hcd->pdev->dev.parent,
-						"Failed to get object tx position\n");
-				return retval;
-			}
-			object_data[obj].tx_pos = data;
-			offset += bits;
-			break;
-		case TOUCH_OBJECT_N_RX_POSITION_TIXELS:
-			bits = config_data[idx++];
-			retval = touch_get_report_data(offset, bits, &data);
-			if (retval < 0) {
-				LOGE(tcm_hcd->pdev->dev.parent,
-						"Failed to get object rx position\n");
-				return retval;
-			}
-			object_data[obj].rx_pos = data;
-			offset += bits;
-			break;
-		case TOUCH_0D_BUTTONS_STATE:
-			bits = config_data[idx++];
-			retval = touch_get_report_data(offset, bits, &data);
-			if (retval < 0) {
-				LOGE(tcm_hcd->pdev->dev.parent,
-						"Failed to get 0D buttons state\n");
-				return retval;
-			}
-			touch_data->buttons_state = data;
-			offset += bits;
-			break;
-		case TOUCH_GESTURE_DOUBLE_TAP:
-			bits = config_data[idx++];
-			retval = touch_get_report_data(offset, bits, &data);
-			if (retval < 0) {
-				LOGE(tcm_hcd->pdev->dev.parent,
-						"Failed to get gesture double tap\n");
-				return retval;
-			}
-			touch_data->gesture_double_tap = data;
-			offset += bits;
+			op->type = TOUCH_OP_PAD;
+			count++;
+			continue;
+		case TOUCH_TUNING_GAUSSIAN_WIDTHS:
+		case TOUCH_TUNING_SMALL_OBJECT_PARAMS:
+		case TOUCH_TUNING_0D_BUTTONS_VARIANCE:
+			op->type = TOUCH_OP_SKIP;
 			break;
-		case TOUCH_FRAME_RATE:
-			bits = config_data[idx++];
-			retval = touch_get_report_data(offset, bits, &data);
-			if (retval < 0) {
-				LOGE(tcm_hcd->pdev->dev.parent,
-						"Failed to get frame rate\n");
-				return retval;
-			}
-			touch_data->frame_rate = data;
-			offset += bits;
+		default:
+			/* unknown codes carry no bit length */
+			if (code >= ARRAY_SIZE(touch_fields) ||
+					touch_fields[code].type == TOUCH_OP_END)
+				continue;
+			op->type = touch_fields[code].type;
+			op->dest = touch_fields[code].dest;
 			break;
-		case TOUCH_POWER_IM:
-			bits = config_data[idx++];
-			retval = touch_get_report_data(offset, bits, &data);
-			if (retval < 0) {
-				LOGE(tcm_hcd->pdev->dev.parent,
-						"Failed to get power IM\n");
-				return retval;
-			}
-			touch_data->power_im = data;
-			offset += bits;
+		}
+
+		if (idx >= config_size)
 			break;
-		case TOUCH_CID_IM:
-			bits = config_data[idx++];
-			retval = touch_get_report_data(offset, bits, &data);
-			if (retval < 0) {
-				LOGE(tcm_hcd->pdev->dev.parent,
-						"Failed to get CID IM\n");
-				return retval;
-			}
-			touch_data->cid_im = data;
-			offset += bits;
+
+		op->bits = config_data[idx++];
+		if (op->type != TOUCH_OP_SKIP &&
+				(op->bits == 0 || op->bits > 32)) {
+			LOGE(tcm_hcd->pdev->dev.parent,
+					"Invalid number of bits for code 0x%02x\n",
+					code);
+			retval = -EINVAL;
+			count = 0;
 			break;
-		case TOUCH_RAIL_IM:
-			bits = config_data[idx++];
-			retval = touch_get_report_data(offset, bits, &data);
-			if (retval < 0) {
-				LOGE(tcm_hcd->pdev->dev.parent,
-						"Failed to get rail IM\n");
-				return retval;
-			}
-			touch_data->rail_im = data;
-			offset += bits;
+		}
+		count++;
+	}
+
+exit:
+	hcd->ops[count].type = TOUCH_OP_END;
+
+	/* no active objects skips past the last object loop that follows */
+	for (idx = 0; idx < count; idx++) {
+		if (hcd->ops[idx].type != TOUCH_OP_ACTIVE_COUNT)
+			continue;
+		if (end_of_foreach > idx)
+			hcd->ops[idx].dest = end_of_foreach;
+		else
+			hcd->ops[idx].dest = 0;
+	}
+
+	hcd->ops_error = retval;
+
+	return retval;
+}
+
+/**
+ * touch_parse_report() - Parse touch report
+ *
+ * @hcd: handle of touch module
+ *
+ * Run the operations compiled from the touch report configuration over the
+ * touch report generated by the device to retrieve the touch data.
+ */
+static int touch_parse_report(struct touch_hcd *hcd)
+{
+	bool active_only = false;
+	bool num_of_active_objects = false;
+	unsigned int obj;
+	unsigned int data;
+	unsigned int offset;
+	unsigned int loop_offset = 0;
+	unsigned int iterations = 0;
+	unsigned int objects = 0;
+	unsigned int active_objects = 0;
+	unsigned int report_bits;
+	unsigned char *report;
+	const struct touch_report_op *op;
+	const struct touch_report_op *loop = NULL;
+	struct touch_data *touch_data;
+	struct object_data *object_data;
+	struct syna_tcm_hcd *tcm_hcd = hcd->tcm_hcd;
+
+	if (hcd->config_seq != tcm_hcd->config_seq || !hcd->ops) {
+		LOCK_BUFFER(tcm_hcd->config);
+		touch_compile_report_config(hcd);
+		UNLOCK_BUFFER(tcm_hcd->config);
+	}
+
+	if (hcd->ops_error < 0)
+		return hcd->ops_error;
+
+	touch_data = &hcd->touch_data;
+	object_data = hcd->touch_data.object_data;
+
+	report = tcm_hcd->report.buffer.buf;
+	report_bits = tcm_hcd->report.buffer.data_length * 8;
+
+	/* only the objects of the previous report hold data */
+	for_each_set_bit(obj, hcd->object_dirty, hcd->max_objects)
+		memset(&object_data[obj], 0x00, sizeof(*object_data));
+	bitmap_zero(hcd->object_dirty, hcd->max_objects);
+
+	obj = 0;
+	offset = 0;
+	for (op = hcd->ops; ; op++) {
+		switch (op->type) {
+		case TOUCH_OP_FIELD:
+			data = touch_get_bits(report, report_bits, offset, op->bits);
+			*(unsigned int *)((unsigned char *)touch_data + op->dest) =
+					data;
+			offset += op->bits;
 			break;
-		case TOUCH_CID_VARIANCE_IM:
-			bits = config_data[idx++];
-			retval = touch_get_report_data(offset, bits, &data);
-			if (retval < 0) {
-				LOGE(tcm_hcd->pdev->dev.parent,
-						"Failed to get CID variance IM\n");
-				return retval;
+		case TOUCH_OP_OBJECT_FIELD:
+			data = touch_get_bits(report, report_bits, offset, op->bits);
+			if (obj < hcd->max_objects) {
+				*(unsigned int *)((unsigned char *)&object_data[obj] +
+						op->dest) = data;
+				__set_bit(obj, hcd->object_dirty);
 			}
-			touch_data->cid_variance_im = data;
-			offset += bits;
+			offset += op->bits;
 			break;
-		case TOUCH_NSM_FREQUENCY:
-			bits = config_data[idx++];
-			retval = touch_get_report_data(offset, bits, &data);
-			if (retval < 0) {
-				LOGE(tcm_hcd->pdev->dev.parent,
-						"Failed to get NSM frequency\n");
-				return retval;
+		case TOUCH_OP_OBJECT_STATUS:
+			data = touch_get_bits(report, report_bits, offset, op->bits);
+			if (obj < hcd->max_objects) {
+				object_data[obj].status = data;
+				__set_bit(obj, hcd->object_dirty);
 			}
-			touch_data->nsm_frequency = data;
-			offset += bits;
+			offset += op->bits;
 			break;
-		case TOUCH_NSM_STATE:
-			bits = config_data[idx++];
-			retval = touch_get_report_data(offset, bits, &data);
-			if (retval < 0) {
-				LOGE(tcm_hcd->pdev->dev.parent,
-						"Failed to get NSM state\n");
-				return retval;
-			}
-			touch_data->nsm_state = data;
-			offset += bits;
+		case TOUCH_OP_OBJECT_INDEX:
+			obj = touch_get_bits(report, report_bits, offset, op->bits);
+			offset += op->bits;
 			break;
-		case TOUCH_NUM_OF_ACTIVE_OBJECTS:
-			bits = config_data[idx++];
-			retval = touch_get_report_data(offset, bits, &data);
-			if (retval < 0) {
-				LOGE(tcm_hcd->pdev->dev.parent,
-						"Failed to get number of active objects\n");
-				return retval;
-			}
+		case TOUCH_OP_ACTIVE_COUNT:
+			data = touch_get_bits(report, report_bits, offset, op->bits);
 			active_objects = data;
 			num_of_active_objects = true;
 			touch_data->num_of_active_objects = data;
-			offset += bits;
-			if (touch_data->num_of_active_objects == 0)
-				idx = end_of_foreach;
+			offset += op->bits;
+			if (data == 0 && op->dest)
+				op = &hcd->ops[op->dest - 1];
 			break;
-		case TOUCH_NUM_OF_CPU_CYCLES_USED_SINCE_LAST_FRAME:
-			bits = config_data[idx++];
-			retval = touch_get_report_data(offset, bits, &data);
-			if (retval < 0) {
-				LOGE(tcm_hcd->pdev->dev.parent,
-						"Failed to get number of CPU cycles used since last frame\n");
-				return retval;
-			}
-			touch_data->num_of_cpu_cycles = data;
-			offset += bits;
+		case TOUCH_OP_SKIP:
+			offset += op->bits;
 			break;
-		case TOUCH_TUNING_GAUSSIAN_WIDTHS:
-			bits = config_data[idx++];
-			offset += bits;
+		case TOUCH_OP_PAD:
+			offset = ceil_div(offset, 8) * 8;
 			break;
-		case TOUCH_TUNING_SMALL_OBJECT_PARAMS:
-			bits = config_data[idx++];
-			offset += bits;
+		case TOUCH_OP_FOREACH:
+			obj = 0;
+			active_only = op->bits;
+			loop = op;
+			loop_offset = offset;
+			iterations = 0;
 			break;
-		case TOUCH_TUNING_0D_BUTTONS_VARIANCE:
-			bits = config_data[idx++];
-			offset += bits;
+		case TOUCH_OP_FOREACH_END:
+			if (active_only) {
+				if (num_of_active_objects) {
+					objects++;
+					if (objects >= active_objects)
+						break;
+				} else if (offset >= report_bits ||
+						offset == loop_offset) {
+					break;
+				}
+			} else {
+				obj++;
+				iterations++;
+				if (obj >= hcd->max_objects ||
+						iterations >= hcd->max_objects)
+					break;
+			}
+			loop_offset = offset;
+			op = loop;
 			break;
+		case TOUCH_OP_END:
+		default:
+			return 0;
 		}
 	}
+}
 
-exit:
-	return 0;
+#ifdef CONFIG_TOUCHSCREEN_SYNAPTICS_TCM_KUNIT_TEST
+int syna_tcm_touch_parse_report(struct touch_hcd *touch_hcd)
+{
+	return touch_parse_report(touch_hcd);
 }
+EXPORT_SYMBOL(syna_tcm_touch_parse_report);
+#endif
 
 /**
  * touch_report() - Report touch events
@@ -591,7 +456,7 @@ static void touch_report(void)
 
 	mutex_lock(&touch_hcd->report_mutex);
 
-	retval = touch_parse_report();
+	retval = touch_parse_report(touch_hcd);
 	if (retval < 0) {
 		LOGE(tcm_hcd->pdev->dev.parent,
 				"Failed to parse touch report\n");
@@ -771,6 +636,10 @@ static int touch_get_input_params(void)
 		return retval;
 	}
 
+	tcm_hcd->config_seq++;
+
+	touch_compile_report_config(touch_hcd);
+
 	UNLOCK_BUFFER(tcm_hcd->config);
 
 	return 0;
@@ -943,6 +812,14 @@ static int touch_check_input_params(void)
 					"Failed to allocate memory for touch_hcd->touch_data.object_data\n");
 			return -ENOMEM;
 		}
+		kfree(touch_hcd->object_dirty);
+		touch_hcd->object_dirty = kcalloc(BITS_TO_LONGS(touch_hcd->max_objects),
+				sizeof(*touch_hcd->object_dirty), GFP_KERNEL);
+		if (!touch_hcd->object_dirty) {
+			LOGE(tcm_hcd->pdev->dev.parent,
+					"Failed to allocate memory for touch_hcd->object_dirty\n");
+			return -ENOMEM;
+		}
 		return 1;
 	}
 
@@ -1056,7 +933,9 @@ static int touch_init(struct syna_tcm_hcd *tcm_hcd)
 
 err_set_input_reporting:
 	kfree(touch_hcd->touch_data.object_data);
+	kfree(touch_hcd->object_dirty);
 	kfree(touch_hcd->prev_status);
+	kfree(touch_hcd->ops);
 
 	RELEASE_BUFFER(touch_hcd->resp);
 	RELEASE_BUFFER(touch_hcd->out);
@@ -1077,7 +956,9 @@ static int touch_remove(struct syna_tcm_hcd *tcm_hcd)
 	input_unregister_device(touch_hcd->input_dev);
 
 	kfree(touch_hcd->touch_data.object_data);
+	kfree(touch_hcd->object_dirty);
 	kfree(touch_hcd->prev_status);
+	kfree(touch_hcd->ops);
 
 	RELEASE_BUFFER(touch_hcd->resp);
 	RELEASE_BUFFER(touch_hcd->out);
@@ -1251,6 +1132,10 @@ static struct syna_tcm_module_cb touch_module = {
 
 static int __init touch_module_init(void)
 {
+	syna_tcm_subscribe_report(&touch_module, REPORT_IDENTIFY, true);
+	syna_tcm_subscribe_report(&touch_module, REPORT_TOUCH, true);
+	syna_tcm_subscribe_async(&touch_module, REPORT_IDENTIFY, true);
+
 	return syna_tcm_add_module(&touch_module, true);
 }
 
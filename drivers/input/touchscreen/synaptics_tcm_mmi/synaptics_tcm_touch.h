@@ -0,0 +1,152 @@
+/*
+ * Synaptics TCM touchscreen driver
+ *
+ * Copyright (C) 2017-2018 Synaptics Incorporated. All rights reserved.
+ *
+ * Copyright (C) 2017-2018 Scott Lin <scott.lin@tw.synaptics.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * INFORMATION CONTAINED IN THIS DOCUMENT IS PROVIDED "AS-IS," AND SYNAPTICS
+ * EXPRESSLY DISCLAIMS ALL EXPRESS AND IMPLIED WARRANTIES, INCLUDING ANY
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE,
+ * AND ANY WARRANTIES OF NON-INFRINGEMENT OF ANY INTELLECTUAL PROPERTY RIGHTS.
+ * IN NO EVENT SHALL SYNAPTICS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, PUNITIVE, OR CONSEQUENTIAL DAMAGES ARISING OUT OF OR IN CONNECTION
+ * WITH THE USE OF THE INFORMATION CONTAINED IN THIS DOCUMENT, HOWEVER CAUSED
+ * AND BASED ON ANY THEORY OF LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, AND EVEN IF SYNAPTICS WAS ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE. IF A TRIBUNAL OF COMPETENT JURISDICTION DOES
+ * NOT PERMIT THE DISCLAIMER OF DIRECT DAMAGES OR ANY OTHER DAMAGES, SYNAPTICS'
+ * TOTAL CUMULATIVE LIABILITY TO ANY PARTY SHALL NOT EXCEED ONE HUNDRED U.S.
+ * DOLLARS.
+ */
+
+#ifndef _SYNAPTICS_TCM_TOUCH_H_
+#define _SYNAPTICS_TCM_TOUCH_H_
+
+enum touch_report_code {
+	TOUCH_END = 0,
+	TOUCH_FOREACH_ACTIVE_OBJECT,
+	TOUCH_FOREACH_OBJECT,
+	TOUCH_FOREACH_END,
+	TOUCH_PAD_TO_NEXT_BYTE,
+	TOUCH_TIMESTAMP,
+	TOUCH_OBJECT_N_INDEX,
+	TOUCH_OBJECT_N_CLASSIFICATION,
+	TOUCH_OBJECT_N_X_POSITION,
+	TOUCH_OBJECT_N_Y_POSITION,
+	TOUCH_OBJECT_N_Z,
+	TOUCH_OBJECT_N_X_WIDTH,
+	TOUCH_OBJECT_N_Y_WIDTH,
+	TOUCH_OBJECT_N_TX_POSITION_TIXELS,
+	TOUCH_OBJECT_N_RX_POSITION_TIXELS,
+	TOUCH_0D_BUTTONS_STATE,
+	TOUCH_GESTURE_DOUBLE_TAP,
+	TOUCH_FRAME_RATE,
+	TOUCH_POWER_IM,
+	TOUCH_CID_IM,
+	TOUCH_RAIL_IM,
+	TOUCH_CID_VARIANCE_IM,
+	TOUCH_NSM_FREQUENCY,
+	TOUCH_NSM_STATE,
+	TOUCH_NUM_OF_ACTIVE_OBJECTS,
+	TOUCH_NUM_OF_CPU_CYCLES_USED_SINCE_LAST_FRAME,
+	TOUCH_TUNING_GAUSSIAN_WIDTHS = 0x80,
+	TOUCH_TUNING_SMALL_OBJECT_PARAMS,
+	TOUCH_TUNING_0D_BUTTONS_VARIANCE,
+};
+
+struct object_data {
+	unsigned char status;
+	unsigned int x_pos;
+	unsigned int y_pos;
+	unsigned int x_width;
+	unsigned int y_width;
+	unsigned int z;
+	unsigned int tx_pos;
+	unsigned int rx_pos;
+};
+
+enum touch_op_type {
+	TOUCH_OP_END = 0,
+	TOUCH_OP_FIELD,
+	TOUCH_OP_OBJECT_FIELD,
+	TOUCH_OP_OBJECT_STATUS,
+	TOUCH_OP_OBJECT_INDEX,
+	TOUCH_OP_ACTIVE_COUNT,
+	TOUCH_OP_SKIP,
+	TOUCH_OP_PAD,
+	TOUCH_OP_FOREACH,
+	TOUCH_OP_FOREACH_END,
+};
+
+/*
+ * One operation compiled from the touch report configuration. dest is the
+ * offset of the field in struct touch_data or struct object_data, or for
+ * TOUCH_OP_ACTIVE_COUNT the operation to continue with when there are no
+ * active objects (0 for none).
+ */
+struct touch_report_op {
+	unsigned char type;
+	unsigned char bits;
+	unsigned short dest;
+};
+
+struct input_params {
+	unsigned int max_x;
+	unsigned int max_y;
+	unsigned int max_objects;
+};
+
+struct touch_data {
+	struct object_data *object_data;
+	unsigned int timestamp;
+	unsigned int buttons_state;
+	unsigned int gesture_double_tap;
+	unsigned int frame_rate;
+	unsigned int power_im;
+	unsigned int cid_im;
+	unsigned int rail_im;
+	unsigned int cid_variance_im;
+	unsigned int nsm_frequency;
+	unsigned int nsm_state;
+	unsigned int num_of_active_objects;
+	unsigned int num_of_cpu_cycles;
+};
+
+struct touch_hcd {
+	bool irq_wake;
+	bool report_touch;
+	bool suspend_touch;
+	int ops_error;
+	unsigned char *prev_status;
+	unsigned int max_x;
+	unsigned int max_y;
+	unsigned int max_objects;
+	unsigned int ops_size;
+	unsigned int config_seq;
+	unsigned long *object_dirty;
+	struct touch_report_op *ops;
+	struct mutex report_mutex;
+	struct input_dev *input_dev;
+	struct touch_data touch_data;
+	struct input_params input_params;
+	struct syna_tcm_buffer out;
+	struct syna_tcm_buffer resp;
+	struct syna_tcm_hcd *tcm_hcd;
+};
+
+#ifdef CONFIG_TOUCHSCREEN_SYNAPTICS_TCM_KUNIT_TEST
+int syna_tcm_touch_parse_report(struct touch_hcd *touch_hcd);
+#endif
+
+#endif
@@ -0,0 +1,550 @@
+/*
+ * Synaptics TCM touchscreen driver
+ *
+ * KUnit tests of the touch report parser, built as their own module when
+ * CONFIG_TOUCHSCREEN_SYNAPTICS_TCM_KUNIT_TEST is set. They parse into a
+ * touch_hcd of their own, never the one of the touch module.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ */
+
+#include <kunit/test.h>
+#include <linux/module.h>
+#include <linux/platform_device.h>
+#include "synaptics_tcm_core.h"
+#include "synaptics_tcm_touch.h"
+
+#define TEST_MAX_OBJECTS 10
+
+/* the reference parser may index objects beyond max_objects */
+#define TEST_REF_OBJECTS 64
+
+#define TEST_CONFIGS 2000
+
+#define TEST_FRAMES 6
+
+struct touch_test_ctx {
+	struct touch_hcd hcd;
+	struct syna_tcm_hcd *tcm_hcd;
+	struct object_data *ref_objects;
+	unsigned char config[64];
+	unsigned char report[64];
+	unsigned int seed;
+};
+
+/* xorshift32, so that a failing config can be reproduced from its seed */
+static unsigned int touch_test_rand(struct touch_test_ctx *ctx)
+{
+	unsigned int x = ctx->seed;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	ctx->seed = x;
+
+	return x;
+}
+
+/**
+ * touch_test_ref_get_bits() - Reference field extraction
+ *
+ * The bit at a time extraction touch_parse_report() used before the report
+ * configuration was compiled.
+ */
+static int touch_test_ref_get_bits(const unsigned char *report,
+		unsigned int report_size, unsigned int offset,
+		unsigned int bits, unsigned int *data)
+{
+	unsigned char mask;
+	unsigned char byte_data;
+	unsigned int output_data;
+	unsigned int bit_offset;
+	unsigned int byte_offset;
+	unsigned int data_bits;
+	unsigned int remaining_bits;
+
+	if (bits == 0 || bits > 32)
+		return -EINVAL;
+
+	if (offset + bits > report_size * 8) {
+		*data = 0;
+		return 0;
+	}
+
+	output_data = 0;
+	remaining_bits = bits;
+
+	bit_offset = offset % 8;
+	byte_offset = offset / 8;
+
+	while (remaining_bits) {
+		byte_data = report[byte_offset] >> bit_offset;
+		data_bits = MIN(8 - bit_offset, remaining_bits);
+		mask = 0xff >> (8 - data_bits);
+
+		output_data |= (unsigned int)(byte_data & mask) <<
+				(bits - remaining_bits);
+
+		bit_offset = 0;
+		byte_offset += 1;
+		remaining_bits -= data_bits;
+	}
+
+	*data = output_data;
+
+	return 0;
+}
+
+static unsigned int *touch_test_ref_field(unsigned char code,
+		struct touch_data *touch_data, struct object_data *object_data)
+{
+	switch (code) {
+	case TOUCH_TIMESTAMP:
+		return &touch_data->timestamp;
+	case TOUCH_OBJECT_N_X_POSITION:
+		return &object_data->x_pos;
+	case TOUCH_OBJECT_N_Y_POSITION:
+		return &object_data->y_pos;
+	case TOUCH_OBJECT_N_Z:
+		return &object_data->z;
+	case TOUCH_OBJECT_N_X_WIDTH:
+		return &object_data->x_width;
+	case TOUCH_OBJECT_N_Y_WIDTH:
+		return &object_data->y_width;
+	case TOUCH_OBJECT_N_TX_POSITION_TIXELS:
+		return &object_data->tx_pos;
+	case TOUCH_OBJECT_N_RX_POSITION_TIXELS:
+		return &object_data->rx_pos;
+	case TOUCH_0D_BUTTONS_STATE:
+		return &touch_data->buttons_state;
+	case TOUCH_GESTURE_DOUBLE_TAP:
+		return &touch_data->gesture_double_tap;
+	case TOUCH_FRAME_RATE:
+		return &touch_data->frame_rate;
+	case TOUCH_POWER_IM:
+		return &touch_data->power_im;
+	case TOUCH_CID_IM:
+		return &touch_data->cid_im;
+	case TOUCH_RAIL_IM:
+		return &touch_data->rail_im;
+	case TOUCH_CID_VARIANCE_IM:
+		return &touch_data->cid_variance_im;
+	case TOUCH_NSM_FREQUENCY:
+		return &touch_data->nsm_frequency;
+	case TOUCH_NSM_STATE:
+		return &touch_data->nsm_state;
+	case TOUCH_NUM_OF_CPU_CYCLES_USED_SINCE_LAST_FRAME:
+		return &touch_data->num_of_cpu_cycles;
+	default:
+		return NULL;
+	}
+}
+
+/**
+ * touch_test_ref_parse() - Reference touch report parser
+ *
+ * The interpreter touch_parse_report() ran over the configuration bytes for
+ * every report before the configuration was compiled. The end of the last
+ * object loop used to be kept in a static from the previous report; it is
+ * set up front to the value that static converged to.
+ */
+static int touch_test_ref_parse(const unsigned char *config,
+		unsigned int config_size, const unsigned char *report,
+		unsigned int report_size, struct touch_data *touch_data,
+		struct object_data *object_data, unsigned int max_objects)
+{
+	bool active_only = false;
+	bool num_of_active_objects = false;
+	unsigned char code;
+	unsigned int idx;
+	unsigned int obj = 0;
+	unsigned int next = 0;
+	unsigned int data;
+	unsigned int bits;
+	unsigned int offset = 0;
+	unsigned int objects = 0;
+	unsigned int active_objects = 0;
+	unsigned int end_of_foreach = 0;
+	unsigned int *field;
+
+	for (idx = 0; idx < config_size; ) {
+		code = config[idx++];
+		if (code == TOUCH_END)
+			break;
+		if (code == TOUCH_FOREACH_END)
+			end_of_foreach = idx;
+		else if (code >= TOUCH_TIMESTAMP)
+			idx++;
+	}
+
+	memset(object_data, 0x00, sizeof(*object_data) * TEST_REF_OBJECTS);
+
+	idx = 0;
+	while (idx < config_size) {
+		code = config[idx++];
+		switch (code) {
+		case TOUCH_END:
+			return 0;
+		case TOUCH_FOREACH_ACTIVE_OBJECT:
+		case TOUCH_FOREACH_OBJECT:
+			obj = 0;
+			next = idx;
+			active_only = code == TOUCH_FOREACH_ACTIVE_OBJECT;
+			break;
+		case TOUCH_FOREACH_END:
+			end_of_foreach = idx;
+			if (active_only) {
+				if (num_of_active_objects) {
+					objects++;
+					if (objects < active_objects)
+						idx = next;
+				} else if (offset < report_size * 8) {
+					idx = next;
+				}
+			} else {
+				obj++;
+				if (obj < max_objects)
+					idx = next;
+			}
+			break;
+		case TOUCH_PAD_TO_NEXT_BYTE:
+			offset = ceil_div(offset, 8) * 8;
+			break;
+		case TOUCH_TUNING_GAUSSIAN_WIDTHS:
+		case TOUCH_TUNING_SMALL_OBJECT_PARAMS:
+		case TOUCH_TUNING_0D_BUTTONS_VARIANCE:
+			offset += config[idx++];
+			break;
+		default:
+			if (code > TOUCH_NUM_OF_CPU_CYCLES_USED_SINCE_LAST_FRAME)
+				break;
+			bits = config[idx++];
+			if (touch_test_ref_get_bits(report, report_size, offset,
+					bits, &data) < 0)
+				return -EINVAL;
+			offset += bits;
+
+			if (code == TOUCH_OBJECT_N_INDEX) {
+				obj = data;
+			} else if (code == TOUCH_NUM_OF_ACTIVE_OBJECTS) {
+				active_objects = data;
+				num_of_active_objects = true;
+				touch_data->num_of_active_objects = data;
+				if (data == 0)
+					idx = end_of_foreach;
+			} else if (obj < TEST_REF_OBJECTS) {
+				if (code == TOUCH_OBJECT_N_CLASSIFICATION) {
+					object_data[obj].status = data;
+				} else {
+					field = touch_test_ref_field(code,
+							touch_data, &object_data[obj]);
+					if (field)
+						*field = data;
+				}
+			}
+			break;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Generate a configuration shaped like the ones devices report: optional
+ * header fields, one object loop, then optional trailing fields.
+ */
+static unsigned int touch_test_gen_config(struct touch_test_ctx *ctx)
+{
+	static const unsigned char object_codes[] = {
+		TOUCH_OBJECT_N_INDEX,
+		TOUCH_OBJECT_N_CLASSIFICATION,
+		TOUCH_OBJECT_N_X_POSITION,
+		TOUCH_OBJECT_N_Y_POSITION,
+		TOUCH_OBJECT_N_Z,
+		TOUCH_OBJECT_N_X_WIDTH,
+		TOUCH_OBJECT_N_Y_WIDTH,
+		TOUCH_OBJECT_N_TX_POSITION_TIXELS,
+		TOUCH_OBJECT_N_RX_POSITION_TIXELS,
+		TOUCH_0D_BUTTONS_STATE,
+	};
+	unsigned char *cfg = ctx->config;
+	unsigned char code;
+	unsigned int n = 0;
+	unsigned int loop;
+	unsigned int fields;
+	unsigned int i;
+
+	if (touch_test_rand(ctx) % 2) {
+		cfg[n++] = TOUCH_NUM_OF_ACTIVE_OBJECTS;
+		cfg[n++] = 1 + touch_test_rand(ctx) % 8;
+	}
+	if (touch_test_rand(ctx) % 3 == 0) {
+		cfg[n++] = TOUCH_TIMESTAMP;
+		cfg[n++] = 1 + touch_test_rand(ctx) % 32;
+	}
+	if (touch_test_rand(ctx) % 4 == 0)
+		cfg[n++] = TOUCH_PAD_TO_NEXT_BYTE;
+
+	loop = n;
+	cfg[n++] = touch_test_rand(ctx) % 3 ?
+			TOUCH_FOREACH_ACTIVE_OBJECT : TOUCH_FOREACH_OBJECT;
+
+	/* the first field of a loop always consumes bits */
+	fields = 1 + touch_test_rand(ctx) % 6;
+	for (i = 0; i < fields; i++) {
+		code = object_codes[touch_test_rand(ctx) %
+				ARRAY_SIZE(object_codes)];
+		if (i && touch_test_rand(ctx) % 8 == 0)
+			code = TOUCH_PAD_TO_NEXT_BYTE;
+		if (code == TOUCH_OBJECT_N_INDEX &&
+				cfg[loop] == TOUCH_FOREACH_OBJECT)
+			code = TOUCH_OBJECT_N_CLASSIFICATION;
+
+		cfg[n++] = code;
+		if (code == TOUCH_OBJECT_N_INDEX)
+			cfg[n++] = 1 + touch_test_rand(ctx) % 3;
+		else if (code != TOUCH_PAD_TO_NEXT_BYTE)
+			cfg[n++] = 1 + touch_test_rand(ctx) % 16;
+	}
+	cfg[n++] = TOUCH_FOREACH_END;
+
+	if (touch_test_rand(ctx) % 2) {
+		cfg[n++] = TOUCH_GESTURE_DOUBLE_TAP;
+		cfg[n++] = 1 + touch_test_rand(ctx) % 8;
+	}
+	if (touch_test_rand(ctx) % 3 == 0) {
+		cfg[n++] = TOUCH_TUNING_GAUSSIAN_WIDTHS +
+				touch_test_rand(ctx) % 3;
+		cfg[n++] = touch_test_rand(ctx) % 40;
+	}
+	if (touch_test_rand(ctx) % 4 == 0) {
+		cfg[n++] = TOUCH_TIMESTAMP;
+		cfg[n++] = 1 + touch_test_rand(ctx) % 32;
+	}
+	cfg[n++] = TOUCH_END;
+
+	return n;
+}
+
+static void touch_test_set_config(struct touch_test_ctx *ctx,
+		const unsigned char *config, unsigned int size)
+{
+	if (config != ctx->config)
+		memcpy(ctx->config, config, size);
+
+	ctx->tcm_hcd->config.buf = ctx->config;
+	ctx->tcm_hcd->config.data_length = size;
+	ctx->tcm_hcd->config_seq++;
+}
+
+static void touch_test_set_report(struct touch_test_ctx *ctx,
+		const unsigned char *report, unsigned int size)
+{
+	if (report != ctx->report)
+		memcpy(ctx->report, report, size);
+
+	ctx->tcm_hcd->report.buffer.buf = ctx->report;
+	ctx->tcm_hcd->report.buffer.data_length = size;
+}
+
+static void touch_test_parse_equivalence(struct kunit *test)
+{
+	struct touch_test_ctx *ctx = test->priv;
+	struct touch_data ref_data;
+	struct touch_data *touch_data = &ctx->hcd.touch_data;
+	struct object_data *object_data = touch_data->object_data;
+	unsigned int config_size;
+	unsigned int report_size;
+	unsigned int cfg;
+	unsigned int frame;
+	unsigned int i;
+	unsigned int seed;
+	int ref_retval;
+	int retval;
+
+	ctx->seed = 1;
+	memset(&ref_data, 0x00, sizeof(ref_data));
+
+	for (cfg = 0; cfg < TEST_CONFIGS; cfg++) {
+		seed = ctx->seed;
+		config_size = touch_test_gen_config(ctx);
+		touch_test_set_config(ctx, ctx->config, config_size);
+
+		for (frame = 0; frame < TEST_FRAMES; frame++) {
+			report_size = touch_test_rand(ctx) % 40;
+			for (i = 0; i < report_size; i++)
+				ctx->report[i] = touch_test_rand(ctx);
+
+			/* often no active objects in the low bits */
+			if (report_size && touch_test_rand(ctx) % 3 == 0)
+				ctx->report[0] &= 0xf0;
+			touch_test_set_report(ctx, ctx->report, report_size);
+
+			ref_retval = touch_test_ref_parse(ctx->config,
+					config_size, ctx->report, report_size,
+					&ref_data, ctx->ref_objects,
+					TEST_MAX_OBJECTS);
+			retval = syna_tcm_touch_parse_report(&ctx->hcd);
+
+			KUNIT_ASSERT_EQ_MSG(test, ref_retval < 0, retval < 0,
+					"config seed %u frame %u", seed, frame);
+			if (retval < 0)
+				continue;
+
+			KUNIT_ASSERT_TRUE_MSG(test,
+					!memcmp(object_data, ctx->ref_objects,
+					sizeof(*object_data) * TEST_MAX_OBJECTS),
+					"config seed %u frame %u", seed, frame);
+
+			ref_data.object_data = object_data;
+			KUNIT_ASSERT_TRUE_MSG(test,
+					!memcmp(touch_data, &ref_data,
+					sizeof(ref_data)),
+					"config seed %u frame %u", seed, frame);
+		}
+	}
+}
+
+static void touch_test_active_count_after_loop(struct kunit *test)
+{
+	static const unsigned char config[] = {
+		TOUCH_FOREACH_OBJECT,
+		TOUCH_OBJECT_N_X_POSITION, 8,
+		TOUCH_FOREACH_END,
+		TOUCH_NUM_OF_ACTIVE_OBJECTS, 8,
+		TOUCH_TIMESTAMP, 8,
+		TOUCH_END,
+	};
+	unsigned char report[TEST_MAX_OBJECTS + 2];
+	struct touch_test_ctx *ctx = test->priv;
+	struct object_data *object_data = ctx->hcd.touch_data.object_data;
+	unsigned int idx;
+
+	for (idx = 0; idx < TEST_MAX_OBJECTS; idx++)
+		report[idx] = 0x10 + idx;
+	report[TEST_MAX_OBJECTS] = 0x00;
+	report[TEST_MAX_OBJECTS + 1] = 0x34;
+
+	touch_test_set_config(ctx, config, sizeof(config));
+	touch_test_set_report(ctx, report, sizeof(report));
+
+	/* a zero count has no object loop left to skip */
+	KUNIT_ASSERT_EQ(test, syna_tcm_touch_parse_report(&ctx->hcd), 0);
+	for (idx = 0; ctx->hcd.ops[idx].type != TOUCH_OP_END; idx++) {
+		if (ctx->hcd.ops[idx].type == TOUCH_OP_ACTIVE_COUNT)
+			KUNIT_EXPECT_EQ(test, ctx->hcd.ops[idx].dest, 0);
+	}
+	KUNIT_EXPECT_EQ(test, object_data[0].x_pos, 0x10);
+	KUNIT_EXPECT_EQ(test, object_data[TEST_MAX_OBJECTS - 1].x_pos,
+			0x10 + TEST_MAX_OBJECTS - 1);
+	KUNIT_EXPECT_EQ(test, ctx->hcd.touch_data.num_of_active_objects, 0);
+	KUNIT_EXPECT_EQ(test, ctx->hcd.touch_data.timestamp, 0x34);
+}
+
+static void touch_test_active_count_skips_loop(struct kunit *test)
+{
+	static const unsigned char config[] = {
+		TOUCH_NUM_OF_ACTIVE_OBJECTS, 8,
+		TOUCH_FOREACH_ACTIVE_OBJECT,
+		TOUCH_OBJECT_N_X_POSITION, 8,
+		TOUCH_FOREACH_END,
+		TOUCH_TIMESTAMP, 8,
+		TOUCH_END,
+	};
+	static const unsigned char report[] = {0x00, 0x56};
+	struct touch_test_ctx *ctx = test->priv;
+
+	touch_test_set_config(ctx, config, sizeof(config));
+	touch_test_set_report(ctx, report, sizeof(report));
+
+	KUNIT_ASSERT_EQ(test, syna_tcm_touch_parse_report(&ctx->hcd), 0);
+	KUNIT_EXPECT_EQ(test, ctx->hcd.touch_data.object_data[0].x_pos, 0);
+	KUNIT_EXPECT_EQ(test, ctx->hcd.touch_data.timestamp, 0x56);
+}
+
+static void touch_test_invalid_bits(struct kunit *test)
+{
+	static const unsigned char config[] = {
+		TOUCH_TIMESTAMP, 33,
+		TOUCH_END,
+	};
+	static const unsigned char report[] = {0xff, 0xff, 0xff, 0xff, 0xff};
+	struct touch_test_ctx *ctx = test->priv;
+
+	touch_test_set_config(ctx, config, sizeof(config));
+	touch_test_set_report(ctx, report, sizeof(report));
+
+	KUNIT_EXPECT_EQ(test, syna_tcm_touch_parse_report(&ctx->hcd), -EINVAL);
+	KUNIT_EXPECT_EQ(test, syna_tcm_touch_parse_report(&ctx->hcd), -EINVAL);
+}
+
+static int touch_test_init(struct kunit *test)
+{
+	struct touch_test_ctx *ctx;
+	struct platform_device *pdev;
+
+	ctx = kunit_kzalloc(test, sizeof(*ctx), GFP_KERNEL);
+	if (!ctx)
+		return -ENOMEM;
+
+	ctx->tcm_hcd = kunit_kzalloc(test, sizeof(*ctx->tcm_hcd), GFP_KERNEL);
+	pdev = kunit_kzalloc(test, sizeof(*pdev), GFP_KERNEL);
+	ctx->ref_objects = kunit_kcalloc(test, TEST_REF_OBJECTS,
+			sizeof(*ctx->ref_objects), GFP_KERNEL);
+	ctx->hcd.touch_data.object_data = kunit_kcalloc(test,
+			TEST_MAX_OBJECTS, sizeof(struct object_data),
+			GFP_KERNEL);
+	ctx->hcd.object_dirty = kunit_kcalloc(test,
+			BITS_TO_LONGS(TEST_MAX_OBJECTS), sizeof(long),
+			GFP_KERNEL);
+	if (!ctx->tcm_hcd || !pdev || !ctx->ref_objects ||
+			!ctx->hcd.touch_data.object_data ||
+			!ctx->hcd.object_dirty)
+		return -ENOMEM;
+
+	ctx->tcm_hcd->pdev = pdev;
+	INIT_BUFFER(ctx->tcm_hcd->config, false);
+	INIT_BUFFER(ctx->tcm_hcd->report.buffer, false);
+
+	ctx->hcd.tcm_hcd = ctx->tcm_hcd;
+	ctx->hcd.max_objects = TEST_MAX_OBJECTS;
+
+	test->priv = ctx;
+
+	return 0;
+}
+
+static void touch_test_exit(struct kunit *test)
+{
+	struct touch_test_ctx *ctx = test->priv;
+
+	kfree(ctx->hcd.ops);
+}
+
+static struct kunit_case touch_test_cases[] = {
+	KUNIT_CASE(touch_test_parse_equivalence),
+	KUNIT_CASE(touch_test_active_count_after_loop),
+	KUNIT_CASE(touch_test_active_count_skips_loop),
+	KUNIT_CASE(touch_test_invalid_bits),
+	{}
+};
+
+static struct kunit_suite touch_test_suite = {
+	.name = "synaptics_tcm_touch",
+	.init = touch_test_init,
+	.exit = touch_test_exit,
+	.test_cases = touch_test_cases,
+};
+
+kunit_test_suite(touch_test_suite);
+
+MODULE_DESCRIPTION("Synaptics TCM Touch Module KUnit Tests");
+MODULE_LICENSE("GPL v2");
@@ -955,6 +955,9 @@ static struct syna_tcm_module_cb zeroflash_module = {
 
 static int __init zeroflash_module_init(void)
 {
+	syna_tcm_subscribe_report(&zeroflash_module, REPORT_STATUS, true);
+	syna_tcm_subscribe_report(&zeroflash_module, REPORT_HDL, true);
+
 	return syna_tcm_add_module(&zeroflash_module, true);
 }
 
@@ -99,7 +99,7 @@ int FsMountVol(struct super_block *sb)
 	err = buf_init(sb);
 	if (!err)
 		err = ffsMountVol(sb);
-	else
+	if (err)
 		buf_shutdown(sb);
 
 	sm_V(&z_sem);
@@ -167,6 +167,65 @@ int FsSyncVol(struct super_block *sb, int do_sync)
 	return err;
 } /* end of FsSyncVol */
 
+#ifdef CONFIG_EXFAT_DISCARD
+/* FsDiscardPending : issue the discards queued by freeing clusters */
+int FsDiscardPending(struct super_block *sb)
+{
+	int remaining;
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+
+	/* give the volume lock up between batches, as the discards are
+	   issued synchronously while it is held */
+	do {
+		/* acquire the lock for file system critical section */
+		sm_P(&p_fs->v_sem);
+
+		remaining = ffsDiscardPending(sb, DISCARD_BATCH_EXTENTS);
+
+		/* release the lock for file system critical section */
+		sm_V(&p_fs->v_sem);
+	} while (remaining > 0);
+
+	return FFS_SUCCESS;
+} /* end of FsDiscardPending */
+
+/* FsTrimVol : discard the free runs of a range of clusters (FITRIM) */
+int FsTrimVol(struct super_block *sb, u32 clu, u32 num_clusters, u32 minlen, u32 *trimmed)
+{
+	int err = FFS_SUCCESS;
+	u32 chunk, num;
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+	BD_INFO_T *p_bd = &(EXFAT_SB(sb)->bd_info);
+
+	/* check the validity of pointer parameters */
+	if (trimmed == NULL)
+		return FFS_ERROR;
+
+	*trimmed = 0;
+	chunk = TRIM_MAP_SECTORS << (p_bd->sector_size_bits + 3);
+
+	while (num_clusters > 0) {
+		num = (num_clusters > chunk) ? chunk : num_clusters;
+
+		/* acquire the lock for file system critical section */
+		sm_P(&p_fs->v_sem);
+
+		err = ffsTrimVol(sb, clu, num, minlen, trimmed);
+
+		/* release the lock for file system critical section */
+		sm_V(&p_fs->v_sem);
+
+		if (err)
+			break;
+
+		clu += num;
+		num_clusters -= num;
+	}
+
+	return err;
+} /* end of FsTrimVol */
+#endif /* CONFIG_EXFAT_DISCARD */
+
 
 /*----------------------------------------------------------------------*/
 /*  File Operation Functions                                            */
@@ -391,7 +450,7 @@ int FsWriteStat(struct inode *inode, DIR_ENTRY_T *info)
 } /* end of FsWriteStat */
 
 /* FsMapCluster : return the cluster number in the given cluster offset */
-int FsMapCluster(struct inode *inode, s32 clu_offset, u32 *clu)
+int FsMapCluster(struct inode *inode, s32 clu_offset, u32 *clu, u32 *clu_count)
 {
 	int err;
 	struct super_block *sb = inode->i_sb;
@@ -404,7 +463,7 @@ int FsMapCluster(struct inode *inode, s32 clu_offset, u32 *clu)
 	/* acquire the lock for file system critical section */
 	sm_P(&p_fs->v_sem);
 
-	err = ffsMapCluster(inode, clu_offset, clu);
+	err = ffsMapCluster(inode, clu_offset, clu, clu_count);
 
 	/* release the lock for file system critical section */
 	sm_V(&p_fs->v_sem);
@@ -412,6 +471,60 @@ int FsMapCluster(struct inode *inode, s32 clu_offset, u32 *clu)
 	return err;
 } /* end of FsMapCluster */
 
+/* FsReleasePrealloc : free the clusters preallocated for a file */
+int FsReleasePrealloc(struct inode *inode)
+{
+	int err;
+	struct super_block *sb = inode->i_sb;
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+
+	/* acquire the lock for file system critical section */
+	sm_P(&p_fs->v_sem);
+
+	err = ffsReleasePrealloc(inode);
+
+	/* release the lock for file system critical section */
+	sm_V(&p_fs->v_sem);
+
+	return err;
+} /* end of FsReleasePrealloc */
+
+/* FsReserveClusters : allocate the clusters of a file ahead of the writes */
+int FsReserveClusters(struct inode *inode, s32 num_wanted)
+{
+	int err;
+	struct super_block *sb = inode->i_sb;
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+
+	/* acquire the lock for file system critical section */
+	sm_P(&p_fs->v_sem);
+
+	err = ffsReserveClusters(inode, num_wanted);
+
+	/* release the lock for file system critical section */
+	sm_V(&p_fs->v_sem);
+
+	return err;
+} /* end of FsReserveClusters */
+
+/* FsReleaseEntrySet : drop the directory entry set cached for a file */
+int FsReleaseEntrySet(struct inode *inode, int do_write)
+{
+	int err;
+	struct super_block *sb = inode->i_sb;
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+
+	/* acquire the lock for file system critical section */
+	sm_P(&p_fs->v_sem);
+
+	err = ffsReleaseEntrySet(inode, do_write);
+
+	/* release the lock for file system critical section */
+	sm_V(&p_fs->v_sem);
+
+	return err;
+} /* end of FsReleaseEntrySet */
+
 /*----------------------------------------------------------------------*/
 /*  Directory Operation Functions                                       */
 /*----------------------------------------------------------------------*/
@@ -486,6 +599,10 @@ EXPORT_SYMBOL(FsMountVol);
 EXPORT_SYMBOL(FsUmountVol);
 EXPORT_SYMBOL(FsGetVolInfo);
 EXPORT_SYMBOL(FsSyncVol);
+#ifdef CONFIG_EXFAT_DISCARD
+EXPORT_SYMBOL(FsDiscardPending);
+EXPORT_SYMBOL(FsTrimVol);
+#endif /* CONFIG_EXFAT_DISCARD */
 EXPORT_SYMBOL(FsLookupFile);
 EXPORT_SYMBOL(FsCreateFile);
 EXPORT_SYMBOL(FsReadFile);
@@ -497,6 +614,9 @@ EXPORT_SYMBOL(FsSetAttr);
 EXPORT_SYMBOL(FsReadStat);
 EXPORT_SYMBOL(FsWriteStat);
 EXPORT_SYMBOL(FsMapCluster);
+EXPORT_SYMBOL(FsReleasePrealloc);
+EXPORT_SYMBOL(FsReserveClusters);
+EXPORT_SYMBOL(FsReleaseEntrySet);
 EXPORT_SYMBOL(FsCreateDir);
 EXPORT_SYMBOL(FsReadDir);
 EXPORT_SYMBOL(FsRemoveDir);
@@ -159,6 +159,8 @@ typedef struct {
 	DATE_TIME_T CreateTimestamp;
 	DATE_TIME_T ModifyTimestamp;
 	DATE_TIME_T AccessTimestamp;
+	u32      StartClu;                          /* filled only by FsReadDir */
+	u8       Flags;                             /* filled only by FsReadDir */
 } DIR_ENTRY_T;
 
 /*======================================================================*/
@@ -181,6 +183,10 @@ typedef struct {
 	int FsUmountVol(struct super_block *sb);
 	int FsGetVolInfo(struct super_block *sb, VOL_INFO_T *info);
 	int FsSyncVol(struct super_block *sb, int do_sync);
+#ifdef CONFIG_EXFAT_DISCARD
+	int FsDiscardPending(struct super_block *sb);
+	int FsTrimVol(struct super_block *sb, u32 clu, u32 num_clusters, u32 minlen, u32 *trimmed);
+#endif /* CONFIG_EXFAT_DISCARD */
 
 /* file management functions */
 	int FsLookupFile(struct inode *inode, char *path, FILE_ID_T *fid);
@@ -193,7 +199,10 @@ typedef struct {
 	int FsSetAttr(struct inode *inode, u32 attr);
 	int FsReadStat(struct inode *inode, DIR_ENTRY_T *info);
 	int FsWriteStat(struct inode *inode, DIR_ENTRY_T *info);
-	int FsMapCluster(struct inode *inode, s32 clu_offset, u32 *clu);
+	int FsMapCluster(struct inode *inode, s32 clu_offset, u32 *clu, u32 *clu_count);
+	int FsReleasePrealloc(struct inode *inode);
+	int FsReserveClusters(struct inode *inode, s32 num_wanted);
+	int FsReleaseEntrySet(struct inode *inode, int do_write);
 
 /* directory management functions */
 	int FsCreateDir(struct inode *inode, char *path, FILE_ID_T *fid);
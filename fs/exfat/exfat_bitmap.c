@@ -32,6 +32,9 @@
 /*                                                                      */
 /************************************************************************/
 
+#include <linux/version.h>
+#include <linux/bitops.h>
+
 #include "exfat_config.h"
 #include "exfat_bitmap.h"
 
@@ -61,3 +64,23 @@ void exfat_bitmap_clear(u8 *bitmap, int i)
 {
 	bitmap[BITMAP_LOC(i)] &= ~(0x01 << BITMAP_SHIFT(i));
 } /* end of Bitmap_clear */
+
+/* bitmap must be aligned to unsigned long; the bit order is the same
+   as the little-endian bitops, so whole words are scanned at a time */
+int exfat_bitmap_find_zero(u8 *bitmap, int size, int i)
+{
+#if LINUX_VERSION_CODE < KERNEL_VERSION(2,6,39)
+	return generic_find_next_zero_le_bit((unsigned long *) bitmap, size, i);
+#else
+	return find_next_zero_bit_le(bitmap, size, i);
+#endif
+} /* end of Bitmap_find_zero */
+
+int exfat_bitmap_find_one(u8 *bitmap, int size, int i)
+{
+#if LINUX_VERSION_CODE < KERNEL_VERSION(2,6,39)
+	return generic_find_next_le_bit((unsigned long *) bitmap, size, i);
+#else
+	return find_next_bit_le(bitmap, size, i);
+#endif
+} /* end of Bitmap_find_one */
@@ -51,5 +51,7 @@
 s32	exfat_bitmap_test(u8 *bitmap, int i);
 void	exfat_bitmap_set(u8 *bitmap, int i);
 void	exfat_bitmap_clear(u8 *bitmpa, int i);
+int	exfat_bitmap_find_zero(u8 *bitmap, int size, int i);
+int	exfat_bitmap_find_one(u8 *bitmap, int size, int i);
 
 #endif /* _EXFAT_BITMAP_H */
@@ -39,6 +39,7 @@
 #include "exfat_data.h"
 #include "exfat_api.h"
 #include "exfat_super.h"
+#include "exfat_trace.h"
 
 /*----------------------------------------------------------------------*/
 /*  Constant & Macro Definitions                                        */
@@ -112,6 +113,10 @@ s32 bdev_read(struct super_block *sb, sector_t secno, struct buffer_head **bh, u
 	if (*bh)
 		__brelse(*bh);
 
+	p_fs->stats.bdev_reads++;
+	p_fs->stats.bdev_read_secs += num_secs;
+	trace_exfat_bdev_read(sb, secno, num_secs, read);
+
 	if (read)
 		*bh = __bread(sb->s_bdev, secno, num_secs << p_bd->sector_size_bits);
 	else
@@ -126,6 +131,35 @@ s32 bdev_read(struct super_block *sb, sector_t secno, struct buffer_head **bh, u
 	return FFS_MEDIAERR;
 }
 
+s32 bdev_readahead(struct super_block *sb, sector_t secno, u32 num_secs)
+{
+	BD_INFO_T *p_bd = &(EXFAT_SB(sb)->bd_info);
+	struct buffer_head *bh;
+	struct blk_plug plug;
+	u32 i;
+	int uptodate;
+
+	if (!p_bd->opened)
+		return FFS_MEDIAERR;
+
+	/* nothing to do if the tail of the window is already cached */
+	bh = __find_get_block(sb->s_bdev, secno + num_secs - 1, p_bd->sector_size);
+	if (bh) {
+		uptodate = buffer_uptodate(bh);
+		__brelse(bh);
+		if (uptodate)
+			return FFS_SUCCESS;
+	}
+
+	/* the plug lets the block layer merge the window into one request */
+	blk_start_plug(&plug);
+	for (i = 0; i < num_secs; i++)
+		__breadahead(sb->s_bdev, secno + i, p_bd->sector_size);
+	blk_finish_plug(&plug);
+
+	return FFS_SUCCESS;
+}
+
 void bdev_end_buffer_write(struct buffer_head *bh, int uptodate, int sync)
 {
 	if (!uptodate)
@@ -170,6 +204,35 @@ s32 bdev_sync_dirty_buffer(struct buffer_head *bh,
 	return ret;
 }
 
+/* write back the dirty ones of a set of buffers, which the caller has
+   sorted by sector: they are all submitted under one plug, so that the
+   block layer merges adjacent sectors, and waited for afterwards */
+s32 bdev_write_buffers(struct super_block *sb, struct buffer_head **bhs, u32 num_bhs)
+{
+	u32 i;
+	s32 ret = FFS_SUCCESS;
+	struct blk_plug plug;
+	BD_INFO_T *p_bd = &(EXFAT_SB(sb)->bd_info);
+
+	if (!p_bd->opened)
+		return FFS_MEDIAERR;
+
+	blk_start_plug(&plug);
+	for (i = 0; i < num_bhs; i++) {
+		if (bdev_sync_dirty_buffer(bhs[i], sb, 0))
+			ret = FFS_MEDIAERR;
+	}
+	blk_finish_plug(&plug);
+
+	for (i = 0; i < num_bhs; i++) {
+		wait_on_buffer(bhs[i]);
+		if (!buffer_uptodate(bhs[i]))
+			ret = FFS_MEDIAERR;
+	}
+
+	return ret;
+}
+
 s32 bdev_write(struct super_block *sb, sector_t secno, struct buffer_head *bh, u32 num_secs, s32 sync)
 {
 	s32 count;
@@ -187,6 +250,10 @@ s32 bdev_write(struct super_block *sb, sector_t secno, struct buffer_head *bh, u
 	if (!p_bd->opened)
 		return FFS_MEDIAERR;
 
+	p_fs->stats.bdev_writes++;
+	p_fs->stats.bdev_write_secs += num_secs;
+	trace_exfat_bdev_write(sb, secno, num_secs, sync);
+
 	if (secno == bh->b_blocknr) {
 		lock_buffer(bh);
 		set_buffer_uptodate(bh);
@@ -67,8 +67,10 @@ s32 bdev_shutdown(void);
 s32 bdev_open(struct super_block *sb);
 s32 bdev_close(struct super_block *sb);
 s32 bdev_read(struct super_block *sb, sector_t secno, struct buffer_head **bh, u32 num_secs, s32 read);
+s32 bdev_readahead(struct super_block *sb, sector_t secno, u32 num_secs);
 s32 bdev_write(struct super_block *sb, sector_t secno, struct buffer_head *bh, u32 num_secs, s32 sync);
 s32 bdev_sync(struct super_block *sb);
+s32 bdev_write_buffers(struct super_block *sb, struct buffer_head **bhs, u32 num_bhs);
 void bdev_end_buffer_write(struct buffer_head *bh, int uptodate, int sync);
 s32 bdev_sync_dirty_buffer(struct buffer_head *bh,
 				struct super_block *sb, int sync);
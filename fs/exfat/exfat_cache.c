@@ -33,12 +33,17 @@
 /*                                                                      */
 /************************************************************************/
 
+#include <linux/log2.h>
+#include <linux/slab.h>
+#include <linux/sort.h>
+
 #include "exfat_config.h"
 #include "exfat_data.h"
 
 #include "exfat_cache.h"
 #include "exfat_super.h"
 #include "exfat_core.h"
+#include "exfat_trace.h"
 
 /*----------------------------------------------------------------------*/
 /*  Global Variable Definitions                                         */
@@ -50,22 +55,16 @@
 static s32 __FAT_read(struct super_block *sb, u32 loc, u32 *content);
 static s32 __FAT_write(struct super_block *sb, u32 loc, u32 content);
 
-static BUF_CACHE_T *FAT_cache_find(struct super_block *sb, sector_t sec);
-static BUF_CACHE_T *FAT_cache_get(struct super_block *sb, sector_t sec);
-static void FAT_cache_insert_hash(struct super_block *sb, BUF_CACHE_T *bp);
-static void FAT_cache_remove_hash(BUF_CACHE_T *bp);
-
 static u8 *__buf_getblk(struct super_block *sb, sector_t sec);
 
-static BUF_CACHE_T *buf_cache_find(struct super_block *sb, sector_t sec);
-static BUF_CACHE_T *buf_cache_get(struct super_block *sb, sector_t sec);
-static void buf_cache_insert_hash(struct super_block *sb, BUF_CACHE_T *bp);
-static void buf_cache_remove_hash(BUF_CACHE_T *bp);
-
-static void push_to_mru(BUF_CACHE_T *bp, BUF_CACHE_T *list);
-static void push_to_lru(BUF_CACHE_T *bp, BUF_CACHE_T *list);
-static void move_to_mru(BUF_CACHE_T *bp, BUF_CACHE_T *list);
-static void move_to_lru(BUF_CACHE_T *bp, BUF_CACHE_T *list);
+static s32 cache_pool_init(BUF_CACHE_POOL_T *pool, u32 size);
+static void cache_pool_free(BUF_CACHE_POOL_T *pool);
+static BUF_CACHE_T *cache_find(struct super_block *sb, BUF_CACHE_POOL_T *pool, sector_t sec);
+static BUF_CACHE_T *cache_get(BUF_CACHE_POOL_T *pool);
+static void cache_insert_hash(struct super_block *sb, BUF_CACHE_POOL_T *pool, BUF_CACHE_T *bp);
+static void cache_remove_hash(BUF_CACHE_T *bp);
+static void cache_discard(BUF_CACHE_POOL_T *pool, BUF_CACHE_T *bp);
+static void cache_pool_sync(struct super_block *sb, BUF_CACHE_POOL_T *pool);
 
 /*======================================================================*/
 /*  Cache Initialization Functions                                      */
@@ -74,56 +73,41 @@ static void move_to_lru(BUF_CACHE_T *bp, BUF_CACHE_T *list);
 s32 buf_init(struct super_block *sb)
 {
 	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+	struct exfat_mount_options *opts = &(EXFAT_SB(sb)->options);
+	u32 num_bufs;
 
-	int i;
-
-	/* LRU list */
-	p_fs->FAT_cache_lru_list.next = p_fs->FAT_cache_lru_list.prev = &p_fs->FAT_cache_lru_list;
-
-	for (i = 0; i < FAT_CACHE_SIZE; i++) {
-		p_fs->FAT_cache_array[i].drv = -1;
-		p_fs->FAT_cache_array[i].sec = ~0;
-		p_fs->FAT_cache_array[i].flag = 0;
-		p_fs->FAT_cache_array[i].buf_bh = NULL;
-		p_fs->FAT_cache_array[i].prev = p_fs->FAT_cache_array[i].next = NULL;
-		push_to_mru(&(p_fs->FAT_cache_array[i]), &p_fs->FAT_cache_lru_list);
-	}
-
-	p_fs->buf_cache_lru_list.next = p_fs->buf_cache_lru_list.prev = &p_fs->buf_cache_lru_list;
-
-	for (i = 0; i < BUF_CACHE_SIZE; i++) {
-		p_fs->buf_cache_array[i].drv = -1;
-		p_fs->buf_cache_array[i].sec = ~0;
-		p_fs->buf_cache_array[i].flag = 0;
-		p_fs->buf_cache_array[i].buf_bh = NULL;
-		p_fs->buf_cache_array[i].prev = p_fs->buf_cache_array[i].next = NULL;
-		push_to_mru(&(p_fs->buf_cache_array[i]), &p_fs->buf_cache_lru_list);
+	if (opts->cache_size) {
+		num_bufs = opts->cache_size;
+	} else {
+		num_bufs = (u32) min_t(u64, BUF_CACHE_MAX_SIZE,
+			i_size_read(sb->s_bdev->bd_inode) >> BUF_CACHE_SHIFT);
+		if (num_bufs < BUF_CACHE_SIZE)
+			num_bufs = BUF_CACHE_SIZE;
 	}
 
-	/* HASH list */
-	for (i = 0; i < FAT_CACHE_HASH_SIZE; i++) {
-		p_fs->FAT_cache_hash_list[i].drv = -1;
-		p_fs->FAT_cache_hash_list[i].sec = ~0;
-		p_fs->FAT_cache_hash_list[i].hash_next = p_fs->FAT_cache_hash_list[i].hash_prev = &(p_fs->FAT_cache_hash_list[i]);
-	}
+	if (num_bufs < BUF_CACHE_MIN_SIZE)
+		num_bufs = BUF_CACHE_MIN_SIZE;
+	if (num_bufs > BUF_CACHE_MAX_SIZE)
+		num_bufs = BUF_CACHE_MAX_SIZE;
 
-	for (i = 0; i < FAT_CACHE_SIZE; i++)
-		FAT_cache_insert_hash(sb, &(p_fs->FAT_cache_array[i]));
+	if (cache_pool_init(&p_fs->FAT_cache, max_t(u32, num_bufs >> 1, FAT_CACHE_SIZE)))
+		return FFS_MEMORYERR;
 
-	for (i = 0; i < BUF_CACHE_HASH_SIZE; i++) {
-		p_fs->buf_cache_hash_list[i].drv = -1;
-		p_fs->buf_cache_hash_list[i].sec = ~0;
-		p_fs->buf_cache_hash_list[i].hash_next = p_fs->buf_cache_hash_list[i].hash_prev = &(p_fs->buf_cache_hash_list[i]);
+	if (cache_pool_init(&p_fs->buf_cache, num_bufs)) {
+		cache_pool_free(&p_fs->FAT_cache);
+		return FFS_MEMORYERR;
 	}
 
-	for (i = 0; i < BUF_CACHE_SIZE; i++)
-		buf_cache_insert_hash(sb, &(p_fs->buf_cache_array[i]));
-
 	return FFS_SUCCESS;
 } /* end of buf_init */
 
 s32 buf_shutdown(struct super_block *sb)
 {
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+
+	cache_pool_free(&p_fs->FAT_cache);
+	cache_pool_free(&p_fs->buf_cache);
+
 	return FFS_SUCCESS;
 } /* end of buf_shutdown */
 
@@ -146,6 +130,11 @@ s32 FAT_read(struct super_block *sb, u32 loc, u32 *content)
 
 	sm_V(&f_sem);
 
+	if (ret == 0) {
+		EXFAT_SB(sb)->fs_info.stats.fat_reads++;
+		trace_exfat_fat_read(sb, loc, *content);
+	}
+
 	return ret;
 } /* end of FAT_read */
 
@@ -159,6 +148,11 @@ s32 FAT_write(struct super_block *sb, u32 loc, u32 content)
 
 	sm_V(&f_sem);
 
+	if (ret == 0) {
+		EXFAT_SB(sb)->fs_info.stats.fat_writes++;
+		trace_exfat_fat_write(sb, loc, content);
+	}
+
 	return ret;
 } /* end of FAT_write */
 
@@ -386,31 +380,31 @@ u8 *FAT_getblk(struct super_block *sb, sector_t sec)
 {
 	BUF_CACHE_T *bp;
 	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+	BUF_CACHE_POOL_T *pool = &p_fs->FAT_cache;
 
-	bp = FAT_cache_find(sb, sec);
+	bp = cache_find(sb, pool, sec);
 	if (bp != NULL) {
-		move_to_mru(bp, &p_fs->FAT_cache_lru_list);
+		bp->flag |= REFBIT;
+		pool->hits++;
 		return bp->buf_bh->b_data;
 	}
 
-	bp = FAT_cache_get(sb, sec);
+	pool->misses++;
 
-	FAT_cache_remove_hash(bp);
+	bp = cache_get(pool);
+
+	cache_remove_hash(bp);
 
 	bp->drv = p_fs->drv;
 	bp->sec = sec;
 	bp->flag = 0;
 
-	FAT_cache_insert_hash(sb, bp);
+	cache_insert_hash(sb, pool, bp);
 
 	if (sector_read(sb, sec, &(bp->buf_bh), 1) != FFS_SUCCESS) {
-		FAT_cache_remove_hash(bp);
-		bp->drv = -1;
-		bp->sec = ~0;
-		bp->flag = 0;
+		cache_remove_hash(bp);
+		cache_discard(pool, bp);
 		bp->buf_bh = NULL;
-
-		move_to_lru(bp, &p_fs->FAT_cache_lru_list);
 		return NULL;
 	}
 
@@ -420,21 +414,23 @@ u8 *FAT_getblk(struct super_block *sb, sector_t sec)
 void FAT_modify(struct super_block *sb, sector_t sec)
 {
 	BUF_CACHE_T *bp;
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
 
-	bp = FAT_cache_find(sb, sec);
+	bp = cache_find(sb, &p_fs->FAT_cache, sec);
 	if (bp != NULL)
 		sector_write(sb, sec, bp->buf_bh, 0);
 } /* end of FAT_modify */
 
 void FAT_release_all(struct super_block *sb)
 {
+	u32 i;
 	BUF_CACHE_T *bp;
 	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
 
 	sm_P(&f_sem);
 
-	bp = p_fs->FAT_cache_lru_list.next;
-	while (bp != &p_fs->FAT_cache_lru_list) {
+	for (i = 0; i < p_fs->FAT_cache.size; i++) {
+		bp = &(p_fs->FAT_cache.array[i]);
 		if (bp->drv == p_fs->drv) {
 			bp->drv = -1;
 			bp->sec = ~0;
@@ -445,7 +441,6 @@ void FAT_release_all(struct super_block *sb)
 				bp->buf_bh = NULL;
 			}
 		}
-		bp = bp->next;
 	}
 
 	sm_V(&f_sem);
@@ -453,79 +448,15 @@ void FAT_release_all(struct super_block *sb)
 
 void FAT_sync(struct super_block *sb)
 {
-	BUF_CACHE_T *bp;
 	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
 
 	sm_P(&f_sem);
 
-	bp = p_fs->FAT_cache_lru_list.next;
-	while (bp != &p_fs->FAT_cache_lru_list) {
-		if ((bp->drv == p_fs->drv) && (bp->flag & DIRTYBIT)) {
-			sync_dirty_buffer(bp->buf_bh);
-			bp->flag &= ~(DIRTYBIT);
-		}
-		bp = bp->next;
-	}
+	cache_pool_sync(sb, &p_fs->FAT_cache);
 
 	sm_V(&f_sem);
 } /* end of FAT_sync */
 
-static BUF_CACHE_T *FAT_cache_find(struct super_block *sb, sector_t sec)
-{
-	s32 off;
-	BUF_CACHE_T *bp, *hp;
-	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
-
-	off = (sec + (sec >> p_fs->sectors_per_clu_bits)) & (FAT_CACHE_HASH_SIZE - 1);
-
-	hp = &(p_fs->FAT_cache_hash_list[off]);
-	for (bp = hp->hash_next; bp != hp; bp = bp->hash_next) {
-		if ((bp->drv == p_fs->drv) && (bp->sec == sec)) {
-
-			WARN(!bp->buf_bh, "[EXFAT] FAT_cache has no bh. "
-					  "It will make system panic.\n");
-
-			touch_buffer(bp->buf_bh);
-			return bp;
-		}
-	}
-	return NULL;
-} /* end of FAT_cache_find */
-
-static BUF_CACHE_T *FAT_cache_get(struct super_block *sb, sector_t sec)
-{
-	BUF_CACHE_T *bp;
-	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
-
-	bp = p_fs->FAT_cache_lru_list.prev;
-
-
-	move_to_mru(bp, &p_fs->FAT_cache_lru_list);
-	return bp;
-} /* end of FAT_cache_get */
-
-static void FAT_cache_insert_hash(struct super_block *sb, BUF_CACHE_T *bp)
-{
-	s32 off;
-	BUF_CACHE_T *hp;
-	FS_INFO_T *p_fs;
-
-	p_fs = &(EXFAT_SB(sb)->fs_info);
-	off = (bp->sec + (bp->sec >> p_fs->sectors_per_clu_bits)) & (FAT_CACHE_HASH_SIZE-1);
-
-	hp = &(p_fs->FAT_cache_hash_list[off]);
-	bp->hash_next = hp->hash_next;
-	bp->hash_prev = hp;
-	hp->hash_next->hash_prev = bp;
-	hp->hash_next = bp;
-} /* end of FAT_cache_insert_hash */
-
-static void FAT_cache_remove_hash(BUF_CACHE_T *bp)
-{
-	(bp->hash_prev)->hash_next = bp->hash_next;
-	(bp->hash_next)->hash_prev = bp->hash_prev;
-} /* end of FAT_cache_remove_hash */
-
 /*======================================================================*/
 /*  Buffer Read/Write Functions                                         */
 /*======================================================================*/
@@ -547,31 +478,33 @@ static u8 *__buf_getblk(struct super_block *sb, sector_t sec)
 {
 	BUF_CACHE_T *bp;
 	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+	BUF_CACHE_POOL_T *pool = &p_fs->buf_cache;
 
-	bp = buf_cache_find(sb, sec);
+	bp = cache_find(sb, pool, sec);
 	if (bp != NULL) {
-		move_to_mru(bp, &p_fs->buf_cache_lru_list);
+		bp->flag |= REFBIT;
+		pool->hits++;
+		trace_exfat_buf_getblk(sb, sec, 1);
 		return bp->buf_bh->b_data;
 	}
 
-	bp = buf_cache_get(sb, sec);
+	pool->misses++;
+	trace_exfat_buf_getblk(sb, sec, 0);
+
+	bp = cache_get(pool);
 
-	buf_cache_remove_hash(bp);
+	cache_remove_hash(bp);
 
 	bp->drv = p_fs->drv;
 	bp->sec = sec;
 	bp->flag = 0;
 
-	buf_cache_insert_hash(sb, bp);
+	cache_insert_hash(sb, pool, bp);
 
 	if (sector_read(sb, sec, &(bp->buf_bh), 1) != FFS_SUCCESS) {
-		buf_cache_remove_hash(bp);
-		bp->drv = -1;
-		bp->sec = ~0;
-		bp->flag = 0;
+		cache_remove_hash(bp);
+		cache_discard(pool, bp);
 		bp->buf_bh = NULL;
-
-		move_to_lru(bp, &p_fs->buf_cache_lru_list);
 		return NULL;
 	}
 
@@ -582,10 +515,11 @@ static u8 *__buf_getblk(struct super_block *sb, sector_t sec)
 void buf_modify(struct super_block *sb, sector_t sec)
 {
 	BUF_CACHE_T *bp;
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
 
 	sm_P(&b_sem);
 
-	bp = buf_cache_find(sb, sec);
+	bp = cache_find(sb, &p_fs->buf_cache, sec);
 	if (likely(bp != NULL))
 		sector_write(sb, sec, bp->buf_bh, 0);
 
@@ -598,10 +532,11 @@ void buf_modify(struct super_block *sb, sector_t sec)
 void buf_lock(struct super_block *sb, sector_t sec)
 {
 	BUF_CACHE_T *bp;
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
 
 	sm_P(&b_sem);
 
-	bp = buf_cache_find(sb, sec);
+	bp = cache_find(sb, &p_fs->buf_cache, sec);
 	if (likely(bp != NULL))
 		bp->flag |= LOCKBIT;
 
@@ -614,10 +549,11 @@ void buf_lock(struct super_block *sb, sector_t sec)
 void buf_unlock(struct super_block *sb, sector_t sec)
 {
 	BUF_CACHE_T *bp;
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
 
 	sm_P(&b_sem);
 
-	bp = buf_cache_find(sb, sec);
+	bp = cache_find(sb, &p_fs->buf_cache, sec);
 	if (likely(bp != NULL))
 		bp->flag &= ~(LOCKBIT);
 
@@ -634,18 +570,14 @@ void buf_release(struct super_block *sb, sector_t sec)
 
 	sm_P(&b_sem);
 
-	bp = buf_cache_find(sb, sec);
+	bp = cache_find(sb, &p_fs->buf_cache, sec);
 	if (likely(bp != NULL)) {
-		bp->drv = -1;
-		bp->sec = ~0;
-		bp->flag = 0;
+		cache_discard(&p_fs->buf_cache, bp);
 
 		if (bp->buf_bh) {
 			__brelse(bp->buf_bh);
 			bp->buf_bh = NULL;
 		}
-
-		move_to_lru(bp, &p_fs->buf_cache_lru_list);
 	}
 
 	sm_V(&b_sem);
@@ -653,13 +585,14 @@ void buf_release(struct super_block *sb, sector_t sec)
 
 void buf_release_all(struct super_block *sb)
 {
+	u32 i;
 	BUF_CACHE_T *bp;
 	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
 
 	sm_P(&b_sem);
 
-	bp = p_fs->buf_cache_lru_list.next;
-	while (bp != &p_fs->buf_cache_lru_list) {
+	for (i = 0; i < p_fs->buf_cache.size; i++) {
+		bp = &(p_fs->buf_cache.array[i]);
 		if (bp->drv == p_fs->drv) {
 			bp->drv = -1;
 			bp->sec = ~0;
@@ -670,7 +603,6 @@ void buf_release_all(struct super_block *sb)
 				bp->buf_bh = NULL;
 			}
 		}
-		bp = bp->next;
 	}
 
 	sm_V(&b_sem);
@@ -678,107 +610,195 @@ void buf_release_all(struct super_block *sb)
 
 void buf_sync(struct super_block *sb)
 {
-	BUF_CACHE_T *bp;
 	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
 
 	sm_P(&b_sem);
 
-	bp = p_fs->buf_cache_lru_list.next;
-	while (bp != &p_fs->buf_cache_lru_list) {
-		if ((bp->drv == p_fs->drv) && (bp->flag & DIRTYBIT)) {
-			bdev_sync_dirty_buffer(bp->buf_bh, sb, 1);
-			bp->flag &= ~(DIRTYBIT);
-		}
-		bp = bp->next;
-	}
+	cache_pool_sync(sb, &p_fs->buf_cache);
 
 	sm_V(&b_sem);
 } /* end of buf_sync */
 
-static BUF_CACHE_T *buf_cache_find(struct super_block *sb, sector_t sec)
+/*======================================================================*/
+/*  Local Function Definitions                                          */
+/*======================================================================*/
+
+static s32 cache_pool_init(BUF_CACHE_POOL_T *pool, u32 size)
+{
+	u32 i, num_buckets;
+
+	/* about two entries per hash bucket */
+	num_buckets = roundup_pow_of_two(size >> 1);
+
+	pool->array = kmalloc(sizeof(BUF_CACHE_T) * size, GFP_KERNEL);
+	if (!pool->array)
+		return FFS_MEMORYERR;
+
+	pool->hash_list = kmalloc(sizeof(BUF_CACHE_T) * num_buckets, GFP_KERNEL);
+	if (!pool->hash_list) {
+		kfree(pool->array);
+		pool->array = NULL;
+		return FFS_MEMORYERR;
+	}
+
+	pool->size = size;
+	pool->hash_mask = num_buckets - 1;
+	pool->hand = 0;
+	pool->hits = pool->misses = 0;
+
+	for (i = 0; i < num_buckets; i++) {
+		pool->hash_list[i].drv = -1;
+		pool->hash_list[i].sec = ~0;
+		pool->hash_list[i].hash_next = pool->hash_list[i].hash_prev = &(pool->hash_list[i]);
+	}
+
+	for (i = 0; i < size; i++) {
+		pool->array[i].drv = -1;
+		pool->array[i].sec = ~0;
+		pool->array[i].flag = 0;
+		pool->array[i].buf_bh = NULL;
+		pool->array[i].hash_next = pool->array[i].hash_prev = &(pool->array[i]);
+	}
+
+	return FFS_SUCCESS;
+} /* end of cache_pool_init */
+
+static void cache_pool_free(BUF_CACHE_POOL_T *pool)
+{
+	u32 i;
+
+	/* a failed mount may leave buffers behind */
+	for (i = 0; i < pool->size; i++) {
+		if (pool->array[i].buf_bh)
+			__brelse(pool->array[i].buf_bh);
+	}
+
+	kfree(pool->array);
+	kfree(pool->hash_list);
+
+	pool->array = NULL;
+	pool->hash_list = NULL;
+	pool->size = 0;
+} /* end of cache_pool_free */
+
+static BUF_CACHE_T *cache_find(struct super_block *sb, BUF_CACHE_POOL_T *pool, sector_t sec)
 {
 	s32 off;
 	BUF_CACHE_T *bp, *hp;
 	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
 
-	off = (sec + (sec >> p_fs->sectors_per_clu_bits)) & (BUF_CACHE_HASH_SIZE - 1);
+	off = (sec + (sec >> p_fs->sectors_per_clu_bits)) & pool->hash_mask;
 
-	hp = &(p_fs->buf_cache_hash_list[off]);
+	hp = &(pool->hash_list[off]);
 	for (bp = hp->hash_next; bp != hp; bp = bp->hash_next) {
 		if ((bp->drv == p_fs->drv) && (bp->sec == sec)) {
+
+			WARN(!bp->buf_bh, "[EXFAT] cached sector has no bh. "
+					  "It will make system panic.\n");
+
 			touch_buffer(bp->buf_bh);
 			return bp;
 		}
 	}
 	return NULL;
-} /* end of buf_cache_find */
+} /* end of cache_find */
 
-static BUF_CACHE_T *buf_cache_get(struct super_block *sb, sector_t sec)
+/* pick a victim by CLOCK: referenced entries lose REFBIT and are
+   skipped once, locked ones are never taken. A newly read sector
+   starts unreferenced, so a one-pass scan only recycles its own
+   entries instead of pushing hot FAT and dentry sectors out. */
+static BUF_CACHE_T *cache_get(BUF_CACHE_POOL_T *pool)
 {
 	BUF_CACHE_T *bp;
-	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
 
-	bp = p_fs->buf_cache_lru_list.prev;
-	while (bp->flag & LOCKBIT)
-		bp = bp->prev;
+	while (1) {
+		bp = &(pool->array[pool->hand]);
+		if (++pool->hand == pool->size)
+			pool->hand = 0;
 
+		if (bp->flag & LOCKBIT)
+			continue;
 
-	move_to_mru(bp, &p_fs->buf_cache_lru_list);
-	return bp;
-} /* end of buf_cache_get */
+		if (bp->flag & REFBIT) {
+			bp->flag &= ~(REFBIT);
+			continue;
+		}
 
-static void buf_cache_insert_hash(struct super_block *sb, BUF_CACHE_T *bp)
+		return bp;
+	}
+} /* end of cache_get */
+
+static void cache_insert_hash(struct super_block *sb, BUF_CACHE_POOL_T *pool, BUF_CACHE_T *bp)
 {
 	s32 off;
 	BUF_CACHE_T *hp;
 	FS_INFO_T *p_fs;
 
 	p_fs = &(EXFAT_SB(sb)->fs_info);
-	off = (bp->sec + (bp->sec >> p_fs->sectors_per_clu_bits)) & (BUF_CACHE_HASH_SIZE-1);
+	off = (bp->sec + (bp->sec >> p_fs->sectors_per_clu_bits)) & pool->hash_mask;
 
-	hp = &(p_fs->buf_cache_hash_list[off]);
+	hp = &(pool->hash_list[off]);
 	bp->hash_next = hp->hash_next;
 	bp->hash_prev = hp;
 	hp->hash_next->hash_prev = bp;
 	hp->hash_next = bp;
-} /* end of buf_cache_insert_hash */
+} /* end of cache_insert_hash */
 
-static void buf_cache_remove_hash(BUF_CACHE_T *bp)
+static void cache_remove_hash(BUF_CACHE_T *bp)
 {
 	(bp->hash_prev)->hash_next = bp->hash_next;
 	(bp->hash_next)->hash_prev = bp->hash_prev;
-} /* end of buf_cache_remove_hash */
-
-/*======================================================================*/
-/*  Local Function Definitions                                          */
-/*======================================================================*/
+	bp->hash_next = bp->hash_prev = bp;
+} /* end of cache_remove_hash */
 
-static void push_to_mru(BUF_CACHE_T *bp, BUF_CACHE_T *list)
+/* invalidate an entry and make it the next victim */
+static int cache_bh_cmp(const void *a, const void *b)
 {
-	bp->next = list->next;
-	bp->prev = list;
-	list->next->prev = bp;
-	list->next = bp;
-} /* end of buf_cache_push_to_mru */
+	sector_t sec_a = (*(struct buffer_head **) a)->b_blocknr;
+	sector_t sec_b = (*(struct buffer_head **) b)->b_blocknr;
 
-static void push_to_lru(BUF_CACHE_T *bp, BUF_CACHE_T *list)
-{
-	bp->prev = list->prev;
-	bp->next = list;
-	list->prev->next = bp;
-	list->prev = bp;
-} /* end of buf_cache_push_to_lru */
+	if (sec_a < sec_b)
+		return -1;
+	return (sec_a > sec_b) ? 1 : 0;
+}
 
-static void move_to_mru(BUF_CACHE_T *bp, BUF_CACHE_T *list)
+/* write back the dirty buffers of a pool in one sorted batch */
+static void cache_pool_sync(struct super_block *sb, BUF_CACHE_POOL_T *pool)
 {
-	bp->prev->next = bp->next;
-	bp->next->prev = bp->prev;
-	push_to_mru(bp, list);
-} /* end of buf_cache_move_to_mru */
+	u32 i, num_bhs = 0;
+	BUF_CACHE_T *bp;
+	struct buffer_head **bhs;
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+
+	bhs = kmalloc(sizeof(struct buffer_head *) * pool->size, GFP_NOFS);
+
+	for (i = 0; i < pool->size; i++) {
+		bp = &(pool->array[i]);
+		if ((bp->drv != p_fs->drv) || (bp->buf_bh == NULL))
+			continue;
+
+		bp->flag &= ~(DIRTYBIT);
+		if (!buffer_dirty(bp->buf_bh))
+			continue;
 
-static void move_to_lru(BUF_CACHE_T *bp, BUF_CACHE_T *list)
+		if (bhs)
+			bhs[num_bhs++] = bp->buf_bh;
+		else
+			bdev_sync_dirty_buffer(bp->buf_bh, sb, 1);
+	}
+
+	if (bhs) {
+		sort(bhs, num_bhs, sizeof(struct buffer_head *), cache_bh_cmp, NULL);
+		bdev_write_buffers(sb, bhs, num_bhs);
+		kfree(bhs);
+	}
+} /* end of cache_pool_sync */
+
+static void cache_discard(BUF_CACHE_POOL_T *pool, BUF_CACHE_T *bp)
 {
-	bp->prev->next = bp->next;
-	bp->next->prev = bp->prev;
-	push_to_lru(bp, list);
-} /* end of buf_cache_move_to_lru */
+	bp->drv = -1;
+	bp->sec = ~0;
+	bp->flag = 0;
+
+	pool->hand = bp - pool->array;
+} /* end of cache_discard */
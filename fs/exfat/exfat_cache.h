@@ -46,14 +46,13 @@
 
 #define LOCKBIT                 0x01
 #define DIRTYBIT                0x02
+#define REFBIT                  0x04
 
 /*----------------------------------------------------------------------*/
 /*  Type Definitions                                                    */
 /*----------------------------------------------------------------------*/
 
 typedef struct __BUF_CACHE_T {
-	struct __BUF_CACHE_T *next;
-	struct __BUF_CACHE_T *prev;
 	struct __BUF_CACHE_T *hash_next;
 	struct __BUF_CACHE_T *hash_prev;
 	s32                drv;
@@ -62,6 +61,18 @@ typedef struct __BUF_CACHE_T {
 	struct buffer_head   *buf_bh;
 } BUF_CACHE_T;
 
+/* a cache pool is replaced by CLOCK: a hit only sets REFBIT,
+   and the hand gives every referenced entry a second chance */
+typedef struct {
+	BUF_CACHE_T   *array;       /* cache entries (scanned by the hand) */
+	BUF_CACHE_T   *hash_list;   /* hash bucket heads */
+	u32           size;         /* num of entries in array */
+	u32           hash_mask;    /* num of hash buckets - 1 */
+	u32           hand;         /* next entry to be considered for eviction */
+	unsigned long hits;
+	unsigned long misses;
+} BUF_CACHE_POOL_T;
+
 /*----------------------------------------------------------------------*/
 /*  External Function Declarations                                      */
 /*----------------------------------------------------------------------*/
@@ -55,9 +55,11 @@
 #include "exfat_api.h"
 #include "exfat_super.h"
 #include "exfat_core.h"
+#include "exfat_trace.h"
 
 #include <linux/blkdev.h>
 #include <linux/slab.h>
+#include <linux/vmalloc.h>
 
 static void __set_sb_dirty(struct super_block *sb)
 {
@@ -90,37 +92,13 @@ static char *reserved_names[] = {
 	NULL
 };
 
-static u8 free_bit[] = {
-	0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0, 4, 0, 1, 0, 2, /*   0 ~  19 */
-	0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0, 5, 0, 1, 0, 2, 0, 1, 0, 3, /*  20 ~  39 */
-	0, 1, 0, 2, 0, 1, 0, 4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, /*  40 ~  59 */
-	0, 1, 0, 6, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0, 4, /*  60 ~  79 */
-	0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0, 5, 0, 1, 0, 2, /*  80 ~  99 */
-	0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0, 4, 0, 1, 0, 2, 0, 1, 0, 3, /* 100 ~ 119 */
-	0, 1, 0, 2, 0, 1, 0, 7, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, /* 120 ~ 139 */
-	0, 1, 0, 4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0, 5, /* 140 ~ 159 */
-	0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0, 4, 0, 1, 0, 2, /* 160 ~ 179 */
-	0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0, 6, 0, 1, 0, 2, 0, 1, 0, 3, /* 180 ~ 199 */
-	0, 1, 0, 2, 0, 1, 0, 4, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, /* 200 ~ 219 */
-	0, 1, 0, 5, 0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0, 4, /* 220 ~ 239 */
-	0, 1, 0, 2, 0, 1, 0, 3, 0, 1, 0, 2, 0, 1, 0                 /* 240 ~ 254 */
-};
+/*----------------------------------------------------------------------*/
+/*  Local Function Declarations                                         */
+/*----------------------------------------------------------------------*/
 
-static u8 used_bit[] = {
-	0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4, 1, 2, 2, 3, /*   0 ~  19 */
-	2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5, 1, 2, 2, 3, 2, 3, 3, 4, /*  20 ~  39 */
-	2, 3, 3, 4, 3, 4, 4, 5, 2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, /*  40 ~  59 */
-	4, 5, 5, 6, 1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, 3, 4, 4, 5, /*  60 ~  79 */
-	2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 2, 3, 3, 4, /*  80 ~  99 */
-	3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 3, 4, 4, 5, 4, 5, 5, 6, /* 100 ~ 119 */
-	4, 5, 5, 6, 5, 6, 6, 7, 1, 2, 2, 3, 2, 3, 3, 4, 2, 3, 3, 4, /* 120 ~ 139 */
-	3, 4, 4, 5, 2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, /* 140 ~ 159 */
-	2, 3, 3, 4, 3, 4, 4, 5, 3, 4, 4, 5, 4, 5, 5, 6, 3, 4, 4, 5, /* 160 ~ 179 */
-	4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7, 2, 3, 3, 4, 3, 4, 4, 5, /* 180 ~ 199 */
-	3, 4, 4, 5, 4, 5, 5, 6, 3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, /* 200 ~ 219 */
-	5, 6, 6, 7, 3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7, /* 220 ~ 239 */
-	4, 5, 5, 6, 5, 6, 6, 7, 5, 6, 6, 7, 6, 7, 7, 8              /* 240 ~ 255 */
-};
+#ifdef CONFIG_EXFAT_DISCARD
+static s32 __discard_free_runs(struct super_block *sb, u32 start, u32 end, u32 minlen, u32 *trimmed);
+#endif /* CONFIG_EXFAT_DISCARD */
 
 /*======================================================================*/
 /*  Global Function Definitions                                         */
@@ -257,8 +235,20 @@ s32 ffsUmountVol(struct super_block *sb)
 	if (p_fs->vol_type == EXFAT) {
 		free_upcase_table(sb);
 		free_alloc_bitmap(sb);
+		dir_index_release_all(sb);
 	}
 
+	if (p_fs->vol_upname)
+		kfree(p_fs->vol_upname);
+	p_fs->vol_upname = NULL;
+
+#ifdef CONFIG_EXFAT_DISCARD
+	if (p_fs->discard_list)
+		kfree(p_fs->discard_list);
+	p_fs->discard_list = NULL;
+	p_fs->discard_count = 0;
+#endif /* CONFIG_EXFAT_DISCARD */
+
 	FAT_release_all(sb);
 	buf_release_all(sb);
 
@@ -311,6 +301,71 @@ s32 ffsSyncVol(struct super_block *sb, s32 do_sync)
 	return FFS_SUCCESS;
 } /* end of ffsSyncVol */
 
+#ifdef CONFIG_EXFAT_DISCARD
+/* ffsDiscardPending : issue discards for up to max_extents queued runs
+   and return the num of runs still queued */
+s32 ffsDiscardPending(struct super_block *sb, s32 max_extents)
+{
+	s32 i, num;
+	DISCARD_EXTENT_T *ext;
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+
+	if ((p_fs->discard_list == NULL) || (p_fs->discard_count == 0))
+		return 0;
+
+	num = p_fs->discard_count;
+	if (num > max_extents)
+		num = max_extents;
+
+	/* the metadata which freed the clusters must reach the disk before
+	   their contents are thrown away, or a crash could resurrect a file
+	   with discarded data */
+	if (!p_fs->dev_ejected && EXFAT_SB(sb)->options.discard && !exfat_readonly(sb)) {
+		fs_sync(sb, 1);
+
+		for (i = 0; i < num; i++) {
+			ext = &(p_fs->discard_list[i]);
+			if (__discard_free_runs(sb, ext->clu - 2, ext->clu - 2 + ext->len, 1, NULL) != FFS_SUCCESS)
+				break;
+		}
+	}
+
+	/* runs which failed are dropped too, discard is only advisory */
+	p_fs->discard_count -= num;
+	memmove(p_fs->discard_list, p_fs->discard_list + num, p_fs->discard_count * sizeof(DISCARD_EXTENT_T));
+
+	return p_fs->discard_count;
+} /* end of ffsDiscardPending */
+
+/* ffsTrimVol : discard the free runs of at least minlen clusters in
+   [clu, clu + num_clusters) and add the num of discarded clusters to
+   *trimmed */
+s32 ffsTrimVol(struct super_block *sb, u32 clu, u32 num_clusters, u32 minlen, u32 *trimmed)
+{
+	u32 end;
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+
+	if (p_fs->vol_type != EXFAT)
+		return FFS_ERROR;
+
+	if (p_fs->dev_ejected)
+		return FFS_MEDIAERR;
+
+	if ((clu < 2) || (clu >= p_fs->num_clusters))
+		return FFS_SUCCESS;
+
+	end = clu + num_clusters;
+	if ((end > p_fs->num_clusters) || (end < clu))
+		end = p_fs->num_clusters;
+
+	/* a run is free in the in-memory bitmap as soon as it is released,
+	   so the metadata which freed it must reach the disk first */
+	fs_sync(sb, 1);
+
+	return __discard_free_runs(sb, clu - 2, end - 2, minlen, trimmed);
+} /* end of ffsTrimVol */
+#endif /* CONFIG_EXFAT_DISCARD */
+
 /*----------------------------------------------------------------------*/
 /*  File Operation Functions                                            */
 /*----------------------------------------------------------------------*/
@@ -338,6 +393,15 @@ s32 ffsLookupFile(struct inode *inode, char *path, FILE_ID_T *fid)
 	if (ret)
 		return ret;
 
+	/* find_dir_entry() compares the on-disk names against the upcased
+	   name, which is kept per volume rather than in every UNI_NAME_T */
+	if (!p_fs->vol_upname) {
+		p_fs->vol_upname = kmalloc(MAX_NAME_LENGTH * sizeof(u16), GFP_NOFS);
+		if (!p_fs->vol_upname)
+			return FFS_MEMORYERR;
+	}
+	nls_uniname_to_upname(sb, p_fs->vol_upname, &uni_name);
+
 	/* search the file name for directories */
 	dentry = p_fs->fs_func->find_dir_entry(sb, &dir, &uni_name, num_entries, &dos_name, TYPE_ALL);
 	if (dentry < -1)
@@ -790,7 +854,7 @@ s32 ffsTruncateFile(struct inode *inode, u64 old_size, u64 new_size)
 
 	/* (1) update the directory entry */
 	if (p_fs->vol_type == EXFAT) {
-		es = get_entry_set_in_dir(sb, &(fid->dir), fid->entry, ES_ALL_ENTRIES, &ep);
+		es = get_inode_entry_set(inode, &ep);
 		if (es == NULL)
 			return FFS_MEDIAERR;
 		ep2 = ep+1;
@@ -813,10 +877,18 @@ s32 ffsTruncateFile(struct inode *inode, u64 old_size, u64 new_size)
 	if (p_fs->vol_type != EXFAT)
 		buf_modify(sb, sector);
 	else {
-		update_dir_checksum_with_entry_set(sb, es);
-		release_entry_set(es);
+		es->dirty = TRUE;
+		sync_inode_entry_set(inode);
 	}
 
+	/* extent cache (dropped before the clusters can be reused,
+	   as exfat_get_block() reads it without v_sem) */
+	if (new_size == 0)
+		extent_cache_inval(&(EXFAT_I(inode)->extent_cache), 0);
+	else
+		extent_cache_inval(&(EXFAT_I(inode)->extent_cache),
+					(u32)((new_size-1) >> p_fs->cluster_size_bits) + 1);
+
 	/* (2) cut off from the FAT chain */
 	if (last_clu != CLUSTER_32(0)) {
 		if (fid->flags == 0x01)
@@ -1041,7 +1113,7 @@ s32 ffsSetAttr(struct inode *inode, u32 attr)
 
 	/* get the directory entry of given file */
 	if (p_fs->vol_type == EXFAT) {
-		es = get_entry_set_in_dir(sb, &(fid->dir), fid->entry, ES_ALL_ENTRIES, &ep);
+		es = get_inode_entry_set(inode, &ep);
 		if (es == NULL)
 			return FFS_MEDIAERR;
 	} else {
@@ -1054,15 +1126,9 @@ s32 ffsSetAttr(struct inode *inode, u32 attr)
 
 	if (((type == TYPE_FILE) && (attr & ATTR_SUBDIR)) ||
 		((type == TYPE_DIR) && (!(attr & ATTR_SUBDIR)))) {
-		s32 err;
 		if (p_fs->dev_ejected)
-			err = FFS_MEDIAERR;
-		else
-			err = FFS_ERROR;
-
-		if (p_fs->vol_type == EXFAT)
-			release_entry_set(es);
-		return err;
+			return FFS_MEDIAERR;
+		return FFS_ERROR;
 	}
 
 	fs_set_vol_flags(sb, VOL_DIRTY);
@@ -1074,8 +1140,8 @@ s32 ffsSetAttr(struct inode *inode, u32 attr)
 	if (p_fs->vol_type != EXFAT)
 		buf_modify(sb, sector);
 	else {
-		update_dir_checksum_with_entry_set(sb, es);
-		release_entry_set(es);
+		es->dirty = TRUE;
+		sync_inode_entry_set(inode);
 	}
 
 #ifdef CONFIG_EXFAT_DELAYED_SYNC
@@ -1137,6 +1203,9 @@ s32 ffsGetStat(struct inode *inode, DIR_ENTRY_T *info)
 
 	/* get the directory entry of given file or directory */
 	if (p_fs->vol_type == EXFAT) {
+		/* the entries are read from the buffer cache below */
+		sync_inode_entry_set(inode);
+
 		es = get_entry_set_in_dir(sb, &(fid->dir), fid->entry, ES_2_ENTRIES, &ep);
 		if (es == NULL)
 			return FFS_MEDIAERR;
@@ -1239,7 +1308,7 @@ s32 ffsSetStat(struct inode *inode, DIR_ENTRY_T *info)
 
 	/* get the directory entry of given file or directory */
 	if (p_fs->vol_type == EXFAT) {
-		es = get_entry_set_in_dir(sb, &(fid->dir), fid->entry, ES_ALL_ENTRIES, &ep);
+		es = get_inode_entry_set(inode, &ep);
 		if (es == NULL)
 			return FFS_MEDIAERR;
 		ep2 = ep+1;
@@ -1274,11 +1343,14 @@ s32 ffsSetStat(struct inode *inode, DIR_ENTRY_T *info)
 
 	p_fs->fs_func->set_entry_size(ep2, info->Size);
 
+	/* this is the inode write-back, so the changes the entry set has
+	   collected since the last one go out here together, and the set is
+	   read again by whoever needs it next */
 	if (p_fs->vol_type != EXFAT) {
 		buf_modify(sb, sector);
 	} else {
-		update_dir_checksum_with_entry_set(sb, es);
-		release_entry_set(es);
+		es->dirty = TRUE;
+		ffsReleaseEntrySet(inode, 1);
 	}
 
 	if (p_fs->dev_ejected)
@@ -1287,10 +1359,14 @@ s32 ffsSetStat(struct inode *inode, DIR_ENTRY_T *info)
 	return FFS_SUCCESS;
 } /* end of ffsSetStat */
 
-s32 ffsMapCluster(struct inode *inode, s32 clu_offset, u32 *clu)
+/* ffsMapCluster : map a cluster offset of the file to a cluster number.
+   if clu_count is given, it holds the max number of clusters wanted on
+   entry and returns the number of physically contiguous clusters
+   starting from *clu (always 1 when a new cluster was allocated) */
+s32 ffsMapCluster(struct inode *inode, s32 clu_offset, u32 *clu, u32 *clu_count)
 {
-	s32 num_clusters, num_alloced, modified = FALSE;
-	u32 last_clu;
+	s32 num_clusters, num_alloc, num_alloced, contig, modified = FALSE;
+	u32 last_clu, fclu = 0, walk_fclu, run_fclu, run_dclu, count, next_clu;
 	sector_t sector = 0;
 	CHAIN_T new_clu;
 	DENTRY_T *ep;
@@ -1298,6 +1374,7 @@ s32 ffsMapCluster(struct inode *inode, s32 clu_offset, u32 *clu)
 	struct super_block *sb = inode->i_sb;
 	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
 	FILE_ID_T *fid = &(EXFAT_I(inode)->fid);
+	EXTENT_CACHE_T *ec = &(EXFAT_I(inode)->extent_cache);
 
 	fid->rwoffset = (s64)(clu_offset) << p_fs->cluster_size_bits;
 
@@ -1312,25 +1389,50 @@ s32 ffsMapCluster(struct inode *inode, s32 clu_offset, u32 *clu)
 		if ((clu_offset > 0) && (*clu != CLUSTER_32(~0))) {
 			last_clu += clu_offset - 1;
 
-			if (clu_offset == num_clusters)
+			if (clu_offset >= num_clusters + (s32) EXFAT_I(inode)->prealloc_clusters)
 				*clu = CLUSTER_32(~0);
 			else
 				*clu += clu_offset;
 		}
+
+		/* let exfat_get_block() map the whole file without v_sem */
+		if ((*clu != CLUSTER_32(~0)) && (num_clusters > 0))
+			extent_cache_add(ec, 0, fid->start_clu, num_clusters);
 	} else {
+		/* extent cache */
+		if ((clu_offset > 0) && (*clu != CLUSTER_32(~0)))
+			extent_cache_lookup(ec, clu_offset, &fclu, clu);
+
 		/* hint information */
-		if ((clu_offset > 0) && (fid->hint_last_off > 0) &&
+		if ((clu_offset > 0) && (fid->hint_last_off > (s32) fclu) &&
 			(clu_offset >= fid->hint_last_off)) {
-			clu_offset -= fid->hint_last_off;
+			fclu = fid->hint_last_off;
 			*clu = fid->hint_last_clu;
 		}
 
-		while ((clu_offset > 0) && (*clu != CLUSTER_32(~0))) {
+		run_fclu = fclu;
+		run_dclu = *clu;
+		walk_fclu = fclu;
+
+		while ((fclu < (u32) clu_offset) && (*clu != CLUSTER_32(~0))) {
 			last_clu = *clu;
 			if (FAT_read(sb, *clu, clu) == -1)
 				return FFS_MEDIAERR;
-			clu_offset--;
+			fclu++;
+
+			/* remember the run walked so far when the chain jumps */
+			if (*clu != last_clu + 1) {
+				extent_cache_add(ec, run_fclu, run_dclu, fclu - run_fclu);
+				run_fclu = fclu;
+				run_dclu = *clu;
+			}
 		}
+
+		if (*clu != CLUSTER_32(~0))
+			extent_cache_add(ec, run_fclu, run_dclu, fclu - run_fclu + 1);
+
+		p_fs->stats.chain_walks += fclu - walk_fclu;
+		trace_exfat_map_cluster(inode, clu_offset, *clu, fclu - walk_fclu);
 	}
 
 	if (*clu == CLUSTER_32(~0)) {
@@ -1340,8 +1442,19 @@ s32 ffsMapCluster(struct inode *inode, s32 clu_offset, u32 *clu)
 		new_clu.size = 0;
 		new_clu.flags = fid->flags;
 
+		/* with -o prealloc, an appending writer takes a contiguous batch
+		   at once; the clusters past the one mapped here are consumed by
+		   the following calls and given back by ffsReleasePrealloc() */
+		num_alloc = 1;
+		if (EXFAT_SB(sb)->options.prealloc && (p_fs->cluster_size_bits < PREALLOC_SIZE_BITS)) {
+			num_alloc = 1 << (PREALLOC_SIZE_BITS - p_fs->cluster_size_bits);
+			if ((p_fs->used_clusters == (u32) ~0) ||
+				((p_fs->num_clusters - 2 - p_fs->used_clusters) < (u32)(num_alloc << 2)))
+				num_alloc = 1;
+		}
+
 		/* (1) allocate a cluster */
-		num_alloced = p_fs->fs_func->alloc_cluster(sb, 1, &new_clu);
+		num_alloced = p_fs->fs_func->alloc_cluster(sb, num_alloc, &new_clu);
 		if (num_alloced < 0)
 			return FFS_MEDIAERR;
 		else if (num_alloced == 0)
@@ -1353,30 +1466,37 @@ s32 ffsMapCluster(struct inode *inode, s32 clu_offset, u32 *clu)
 				fid->flags = 0x01;
 			fid->start_clu = new_clu.dir;
 			modified = TRUE;
+			fclu = 0;
 		} else {
 			if (new_clu.flags != fid->flags) {
 				exfat_chain_cont_cluster(sb, fid->start_clu, num_clusters);
+				extent_cache_add(ec, 0, fid->start_clu, num_clusters);
 				fid->flags = 0x01;
 				modified = TRUE;
+				fclu = num_clusters;
 			}
 			if (new_clu.flags == 0x01)
 				FAT_write(sb, last_clu, new_clu.dir);
 		}
 
+		/* only a NoFatChain batch is known to be contiguous */
+		if (fid->flags == 0x01)
+			extent_cache_add(ec, fclu, new_clu.dir,
+					(new_clu.flags == 0x03) ? num_alloced : 1);
+
+		EXFAT_I(inode)->prealloc_clusters = num_alloced - 1;
 		num_clusters += num_alloced;
 		*clu = new_clu.dir;
 
-		if (p_fs->vol_type == EXFAT) {
-			es = get_entry_set_in_dir(sb, &(fid->dir), fid->entry, ES_ALL_ENTRIES, &ep);
-			if (es == NULL)
-				return FFS_MEDIAERR;
-			/* get stream entry */
-			ep++;
-		}
-
 		/* (3) update directory entry */
 		if (modified) {
-			if (p_fs->vol_type != EXFAT) {
+			if (p_fs->vol_type == EXFAT) {
+				es = get_inode_entry_set(inode, &ep);
+				if (es == NULL)
+					return FFS_MEDIAERR;
+				/* get stream entry */
+				ep++;
+			} else {
 				ep = get_entry_in_dir(sb, &(fid->dir), fid->entry, &sector);
 				if (!ep)
 					return FFS_MEDIAERR;
@@ -1388,17 +1508,51 @@ s32 ffsMapCluster(struct inode *inode, s32 clu_offset, u32 *clu)
 			if (p_fs->fs_func->get_entry_clu0(ep) != fid->start_clu)
 				p_fs->fs_func->set_entry_clu0(ep, fid->start_clu);
 
-			if (p_fs->vol_type != EXFAT)
+			/* an appending writer changes the entry set on every new
+			   cluster, it is written back once with the inode */
+			if (p_fs->vol_type != EXFAT) {
 				buf_modify(sb, sector);
-		}
-
-		if (p_fs->vol_type == EXFAT) {
-			update_dir_checksum_with_entry_set(sb, es);
-			release_entry_set(es);
+			} else {
+				es->dirty = TRUE;
+				mark_inode_dirty(inode);
+			}
 		}
 
 		/* add number of new blocks to inode */
 		inode->i_blocks += num_alloced << (p_fs->cluster_size_bits - 9);
+
+		if (clu_count != NULL)
+			*clu_count = 1;
+	} else if ((clu_offset >= num_clusters) && (EXFAT_I(inode)->prealloc_clusters > 0)) {
+		/* the writer moves into a preallocated cluster */
+		EXFAT_I(inode)->prealloc_clusters--;
+
+		if (clu_count != NULL)
+			*clu_count = 1;
+	} else if ((clu_count != NULL) && (*clu_count > 1)) {
+		/* count the contiguous clusters from the mapped one */
+		if (fid->flags == 0x03) {
+			count = (u32)(num_clusters - clu_offset);
+		} else {
+			contig = extent_cache_lookup(ec, clu_offset, &fclu, &run_dclu);
+			count = ((contig > 0) && (fclu == (u32) clu_offset)) ? (u32) contig : 1;
+
+			last_clu = *clu + count - 1;
+			while (count < *clu_count) {
+				if (FAT_read(sb, last_clu, &next_clu) == -1)
+					return FFS_MEDIAERR;
+				if (next_clu != last_clu + 1)
+					break;
+				last_clu = next_clu;
+				count++;
+			}
+			extent_cache_add(ec, clu_offset, *clu, count);
+		}
+
+		if (count < *clu_count)
+			*clu_count = count;
+	} else if (clu_count != NULL) {
+		*clu_count = 1;
 	}
 
 	/* hint information */
@@ -1411,6 +1565,259 @@ s32 ffsMapCluster(struct inode *inode, s32 clu_offset, u32 *clu)
 	return FFS_SUCCESS;
 } /* end of ffsMapCluster */
 
+/* bring the first cluster and the chain flag of the directory entry in
+   line with fid (the exFAT entry set goes out with the inode) */
+static s32 update_entry_chain(struct inode *inode)
+{
+	sector_t sector = 0;
+	DENTRY_T *ep;
+	ENTRY_SET_CACHE_T *es = NULL;
+	struct super_block *sb = inode->i_sb;
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+	FILE_ID_T *fid = &(EXFAT_I(inode)->fid);
+
+	if (p_fs->vol_type == EXFAT) {
+		es = get_inode_entry_set(inode, &ep);
+		if (es == NULL)
+			return FFS_MEDIAERR;
+		/* get stream entry */
+		ep++;
+	} else {
+		ep = get_entry_in_dir(sb, &(fid->dir), fid->entry, &sector);
+		if (!ep)
+			return FFS_MEDIAERR;
+	}
+
+	if (fid->start_clu == CLUSTER_32(~0)) {
+		p_fs->fs_func->set_entry_flag(ep, 0x01);
+		p_fs->fs_func->set_entry_clu0(ep, CLUSTER_32(0));
+	} else {
+		p_fs->fs_func->set_entry_flag(ep, fid->flags);
+		p_fs->fs_func->set_entry_clu0(ep, fid->start_clu);
+	}
+
+	if (p_fs->vol_type != EXFAT) {
+		buf_modify(sb, sector);
+	} else {
+		es->dirty = TRUE;
+		mark_inode_dirty(inode);
+	}
+
+	return FFS_SUCCESS;
+}
+
+/* ffsReleasePrealloc : free the clusters preallocated past mmu_private.
+   the caller holds the super lock (or, from evict, knows that no writer
+   is left), so mmu_private cannot move while the clusters are freed */
+s32 ffsReleasePrealloc(struct inode *inode)
+{
+	s32 num_clusters;
+	u32 fclu, last_clu;
+	CHAIN_T clu;
+	struct super_block *sb = inode->i_sb;
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+	FILE_ID_T *fid = &(EXFAT_I(inode)->fid);
+	EXTENT_CACHE_T *ec = &(EXFAT_I(inode)->extent_cache);
+
+	if (EXFAT_I(inode)->prealloc_clusters == 0)
+		return FFS_SUCCESS;
+
+	if (fid->start_clu == CLUSTER_32(~0))
+		return FFS_ERROR;
+
+	/* clusters reserved by ffsReserveClusters() for an empty file; with
+	   mmu_private still 0 under the super lock, get_block has not mapped
+	   any of them, so the whole chain goes */
+	if (EXFAT_I(inode)->mmu_private == 0) {
+		clu.dir = fid->start_clu;
+		clu.size = (s32) EXFAT_I(inode)->prealloc_clusters;
+		clu.flags = fid->flags;
+
+		fid->start_clu = CLUSTER_32(~0);
+		fid->flags = (p_fs->vol_type == EXFAT) ? 0x03 : 0x01;
+		if (update_entry_chain(inode) != FFS_SUCCESS)
+			return FFS_MEDIAERR;
+
+		extent_cache_inval(ec, 0);
+		p_fs->fs_func->free_cluster(sb, &clu, 0);
+
+		inode->i_blocks -= (blkcnt_t) EXFAT_I(inode)->prealloc_clusters << (p_fs->cluster_size_bits - 9);
+		EXFAT_I(inode)->prealloc_clusters = 0;
+		fid->hint_last_off = -1;
+
+		if (p_fs->dev_ejected)
+			return FFS_MEDIAERR;
+
+		return FFS_SUCCESS;
+	}
+
+	num_clusters = (s32)((EXFAT_I(inode)->mmu_private-1) >> p_fs->cluster_size_bits) + 1;
+
+	clu.size = (s32) EXFAT_I(inode)->prealloc_clusters;
+	clu.flags = fid->flags;
+
+	if (fid->flags == 0x03) {
+		clu.dir = fid->start_clu + num_clusters;
+	} else {
+		fclu = 0;
+		last_clu = fid->start_clu;
+		extent_cache_lookup(ec, num_clusters-1, &fclu, &last_clu);
+
+		while (fclu < (u32)(num_clusters-1)) {
+			if (FAT_read(sb, last_clu, &last_clu) == -1)
+				return FFS_MEDIAERR;
+			fclu++;
+		}
+
+		if (FAT_read(sb, last_clu, &(clu.dir)) == -1)
+			return FFS_MEDIAERR;
+		if (FAT_write(sb, last_clu, CLUSTER_32(~0)) < 0)
+			return FFS_MEDIAERR;
+	}
+
+	extent_cache_inval(ec, num_clusters);
+	p_fs->fs_func->free_cluster(sb, &clu, 0);
+
+	inode->i_blocks -= (blkcnt_t) EXFAT_I(inode)->prealloc_clusters << (p_fs->cluster_size_bits - 9);
+	EXFAT_I(inode)->prealloc_clusters = 0;
+	fid->hint_last_off = -1;
+
+	if (p_fs->dev_ejected)
+		return FFS_MEDIAERR;
+
+	return FFS_SUCCESS;
+} /* end of ffsReleasePrealloc */
+
+/* ffsReserveClusters : allocate the first num_wanted clusters of a file
+   ahead of the writes (fallocate), as contiguous as the free space
+   allows. they are kept past mmu_private like a prealloc batch */
+s32 ffsReserveClusters(struct inode *inode, s32 num_wanted)
+{
+	s32 i, num_clusters, num_alloced, modified = FALSE;
+	u32 fclu, last_clu;
+	CHAIN_T new_clu;
+	struct super_block *sb = inode->i_sb;
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+	FILE_ID_T *fid = &(EXFAT_I(inode)->fid);
+	EXTENT_CACHE_T *ec = &(EXFAT_I(inode)->extent_cache);
+
+	if (EXFAT_I(inode)->mmu_private == 0)
+		num_clusters = 0;
+	else
+		num_clusters = (s32)((EXFAT_I(inode)->mmu_private-1) >> p_fs->cluster_size_bits) + 1;
+	num_clusters += (s32) EXFAT_I(inode)->prealloc_clusters;
+
+	if (num_clusters >= num_wanted)
+		return FFS_SUCCESS;
+
+	/* find the last cluster of the chain */
+	last_clu = fid->start_clu;
+	if (num_clusters == 0) {
+		last_clu = CLUSTER_32(~0);
+	} else if (fid->flags == 0x03) {
+		last_clu += num_clusters - 1;
+	} else {
+		fclu = 0;
+		extent_cache_lookup(ec, num_clusters-1, &fclu, &last_clu);
+
+		while (fclu < (u32)(num_clusters-1)) {
+			if (FAT_read(sb, last_clu, &last_clu) == -1)
+				return FFS_MEDIAERR;
+			fclu++;
+		}
+	}
+
+	fs_set_vol_flags(sb, VOL_DIRTY);
+
+	while (num_clusters < num_wanted) {
+		new_clu.dir = (last_clu == CLUSTER_32(~0)) ? CLUSTER_32(~0) : last_clu+1;
+		new_clu.size = 0;
+		new_clu.flags = fid->flags;
+
+		/* a NoFatChain file is extended in place as far as it goes,
+		   the rest comes from a free run big enough for all of it */
+		num_alloced = p_fs->fs_func->alloc_cluster(sb, num_wanted - num_clusters, &new_clu);
+		if (num_alloced < 0)
+			return FFS_MEDIAERR;
+		else if (num_alloced == 0)
+			break;
+
+		if (last_clu == CLUSTER_32(~0)) {
+			if (new_clu.flags == 0x01)
+				fid->flags = 0x01;
+			fid->start_clu = new_clu.dir;
+			modified = TRUE;
+		} else {
+			/* a NoFatChain file only stays so while the new clusters
+			   follow its last one, otherwise both become a FAT chain */
+			if ((new_clu.flags != fid->flags) ||
+				((fid->flags == 0x03) && (new_clu.dir != last_clu+1))) {
+				if (fid->flags == 0x03) {
+					exfat_chain_cont_cluster(sb, fid->start_clu, num_clusters);
+					extent_cache_add(ec, 0, fid->start_clu, num_clusters);
+					fid->flags = 0x01;
+					modified = TRUE;
+				}
+				if (new_clu.flags == 0x03) {
+					exfat_chain_cont_cluster(sb, new_clu.dir, num_alloced);
+					new_clu.flags = 0x01;
+				}
+			}
+			if (fid->flags == 0x01) {
+				if (FAT_write(sb, last_clu, new_clu.dir) < 0)
+					return FFS_MEDIAERR;
+			}
+		}
+
+		if (new_clu.flags == 0x03) {
+			last_clu = new_clu.dir + num_alloced - 1;
+		} else {
+			last_clu = new_clu.dir;
+			for (i = 1; i < num_alloced; i++) {
+				if (FAT_read(sb, last_clu, &last_clu) == -1)
+					return FFS_MEDIAERR;
+			}
+		}
+
+		num_clusters += num_alloced;
+		EXFAT_I(inode)->prealloc_clusters += num_alloced;
+		inode->i_blocks += (blkcnt_t) num_alloced << (p_fs->cluster_size_bits - 9);
+	}
+
+	if (modified && (update_entry_chain(inode) != FFS_SUCCESS))
+		return FFS_MEDIAERR;
+
+	if (p_fs->dev_ejected)
+		return FFS_MEDIAERR;
+
+	if (num_clusters < num_wanted)
+		return FFS_FULL;
+
+	return FFS_SUCCESS;
+} /* end of ffsReserveClusters */
+
+/* ffsReleaseEntrySet : drop the entry set cached for a file, after
+   writing back its changes if do_write is set */
+s32 ffsReleaseEntrySet(struct inode *inode, s32 do_write)
+{
+	struct super_block *sb = inode->i_sb;
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+
+	if (EXFAT_I(inode)->es == NULL)
+		return FFS_SUCCESS;
+
+	if (do_write)
+		sync_inode_entry_set(inode);
+
+	release_entry_set(EXFAT_I(inode)->es);
+	EXFAT_I(inode)->es = NULL;
+
+	if (p_fs->dev_ejected)
+		return FFS_MEDIAERR;
+
+	return FFS_SUCCESS;
+} /* end of ffsReleaseEntrySet */
+
 /*----------------------------------------------------------------------*/
 /*  Directory Operation Functions                                       */
 /*----------------------------------------------------------------------*/
@@ -1450,7 +1857,7 @@ s32 ffsCreateDir(struct inode *inode, char *path, FILE_ID_T *fid)
 s32 ffsReadDir(struct inode *inode, DIR_ENTRY_T *dir_entry)
 {
 	int i, dentry, clu_offset;
-	s32 dentries_per_clu, dentries_per_clu_bits = 0;
+	s32 dentries_per_clu, dentries_per_clu_bits = 0, ra_entry;
 	u32 type;
 	sector_t sector;
 	CHAIN_T dir, clu;
@@ -1459,6 +1866,7 @@ s32 ffsReadDir(struct inode *inode, DIR_ENTRY_T *dir_entry)
 	DENTRY_T *ep;
 	struct super_block *sb = inode->i_sb;
 	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+	BD_INFO_T *p_bd = &(EXFAT_SB(sb)->bd_info);
 	FILE_ID_T *fid = &(EXFAT_I(inode)->fid);
 
 	/* check if the given file ID is opened */
@@ -1525,7 +1933,14 @@ s32 ffsReadDir(struct inode *inode, DIR_ENTRY_T *dir_entry)
 		else
 			i = dentry & (dentries_per_clu-1);
 
+		/* one entry is returned per call, so only read ahead when
+		   the scan reaches the start of a window */
+		ra_entry = ALIGN(i, DIR_RA_SECTORS << (p_bd->sector_size_bits - DENTRY_SIZE_BITS));
+
 		for ( ; i < dentries_per_clu; i++, dentry++) {
+			if (i >= ra_entry)
+				ra_entry = dir_readahead(sb, &clu, i);
+
 			ep = get_entry_in_dir(sb, &clu, i, &sector);
 			if (!ep)
 				return FFS_MEDIAERR;
@@ -1579,6 +1994,16 @@ s32 ffsReadDir(struct inode *inode, DIR_ENTRY_T *dir_entry)
 
 			dir_entry->Size = p_fs->fs_func->get_entry_size(ep);
 
+			/* the same as ffsLookupFile() sets up, so that readdir
+			   can build the inode without reading the entry again */
+			if ((type == TYPE_FILE) && (dir_entry->Size == 0)) {
+				dir_entry->Flags = (p_fs->vol_type == EXFAT) ? 0x03 : 0x01;
+				dir_entry->StartClu = CLUSTER_32(~0);
+			} else {
+				dir_entry->Flags = p_fs->fs_func->get_entry_flag(ep);
+				dir_entry->StartClu = p_fs->fs_func->get_entry_clu0(ep);
+			}
+
 			/* hint information */
 			if (dir.dir == CLUSTER_32(0)) { /* FAT16 root_dir */
 			} else {
@@ -1648,6 +2073,9 @@ s32 ffsRemoveDir(struct inode *inode, FILE_ID_T *fid)
 
 	fs_set_vol_flags(sb, VOL_DIRTY);
 
+	/* its clusters may start another directory later */
+	dir_index_drop(sb, clu_to_free.dir);
+
 	/* (1) update the directory entry */
 	remove_file(inode, &dir, dentry);
 
@@ -1743,12 +2171,22 @@ void fs_set_vol_flags(struct super_block *sb, u32 new_flag)
 		else
 			sector_write(sb, p_fs->PBR_sector, p_fs->pbr_bh, 0);
 	}
+
+	/* bound how long the volume stays dirty with unwritten metadata */
+	if (new_flag == VOL_DIRTY)
+		schedule_delayed_work(&(EXFAT_SB(sb)->flush_work), msecs_to_jiffies(FLUSH_DELAY_MS));
 } /* end of fs_set_vol_flags */
 
 void fs_sync(struct super_block *sb, s32 do_sync)
 {
-	if (do_sync)
+	if (do_sync) {
+		/* the cached metadata goes out in sorted batches first, then
+		   anything else still dirty on the device */
+		FAT_sync(sb);
+		buf_sync(sb);
+		sync_alloc_bitmap(sb);
 		bdev_sync(sb);
+	}
 } /* end of fs_sync */
 
 void fs_error(struct super_block *sb)
@@ -1854,10 +2292,31 @@ s32 fat_alloc_cluster(struct super_block *sb, s32 num_alloc, CHAIN_T *p_chain)
 	return num_clusters;
 } /* end of fat_alloc_cluster */
 
+/* count an allocation and how far from its hint it landed */
+static void __alloc_cluster_stat(struct super_block *sb, u32 hint_clu, CHAIN_T *p_chain,
+				 s32 num_wanted, s32 num_clusters)
+{
+	u32 distance = 0;
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+
+	if (num_clusters > 0) {
+		if (p_chain->dir >= hint_clu)
+			distance = p_chain->dir - hint_clu;
+		else
+			distance = (p_fs->num_clusters - hint_clu) + (p_chain->dir - 2);
+	}
+
+	p_fs->stats.alloc_calls++;
+	p_fs->stats.alloc_clusters += num_clusters;
+	p_fs->stats.alloc_distance += distance;
+
+	trace_exfat_alloc_cluster(sb, hint_clu, p_chain->dir, num_wanted, num_clusters, distance);
+}
+
 s32 exfat_alloc_cluster(struct super_block *sb, s32 num_alloc, CHAIN_T *p_chain)
 {
-	s32 num_clusters = 0;
-	u32 hint_clu, new_clu, last_clu = CLUSTER_32(~0);
+	s32 num_clusters = 0, num_wanted = num_alloc;
+	u32 hint_clu, first_hint, new_clu, run_len, last_clu = CLUSTER_32(~0);
 	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
 
 	hint_clu = p_chain->dir;
@@ -1869,6 +2328,16 @@ s32 exfat_alloc_cluster(struct super_block *sb, s32 num_alloc, CHAIN_T *p_chain)
 		hint_clu = 2;
 		p_chain->flags = 0x01;
 	}
+	first_hint = hint_clu;
+
+	/* a new chain of several clusters starts from a free run that can hold
+	   the whole request; an existing chain must go on from its hint, so
+	   the loop below sees when it cannot and converts it to a FAT chain */
+	if ((num_alloc > 1) && (p_chain->dir == CLUSTER_32(~0))) {
+		new_clu = test_alloc_bitmap_run(sb, hint_clu-2, num_alloc, &run_len);
+		if ((new_clu != CLUSTER_32(~0)) && (run_len >= num_alloc))
+			hint_clu = new_clu;
+	}
 
 	__set_sb_dirty(sb);
 
@@ -1876,6 +2345,12 @@ s32 exfat_alloc_cluster(struct super_block *sb, s32 num_alloc, CHAIN_T *p_chain)
 
 	while ((new_clu = test_alloc_bitmap(sb, hint_clu-2)) != CLUSTER_32(~0)) {
 		if (new_clu != hint_clu) {
+			/* do not break a NoFatChain run in the middle of a request,
+			   return what is contiguous and let the caller ask again;
+			   the file stays chain-less unless it really grows past it */
+			if ((p_chain->flags == 0x03) && (num_clusters > 0))
+				break;
+
 			if (p_chain->flags == 0x03) {
 				exfat_chain_cont_cluster(sb, p_chain->dir, num_clusters);
 				p_chain->flags = 0x01;
@@ -1908,6 +2383,7 @@ s32 exfat_alloc_cluster(struct super_block *sb, s32 num_alloc, CHAIN_T *p_chain)
 				p_fs->used_clusters += num_clusters;
 
 			p_chain->size += num_clusters;
+			__alloc_cluster_stat(sb, first_hint, p_chain, num_wanted, num_clusters);
 			return num_clusters;
 		}
 
@@ -1927,6 +2403,7 @@ s32 exfat_alloc_cluster(struct super_block *sb, s32 num_alloc, CHAIN_T *p_chain)
 		p_fs->used_clusters += num_clusters;
 
 	p_chain->size += num_clusters;
+	__alloc_cluster_stat(sb, first_hint, p_chain, num_wanted, num_clusters);
 	return num_clusters;
 } /* end of exfat_alloc_cluster */
 
@@ -1974,6 +2451,9 @@ void exfat_free_cluster(struct super_block *sb, CHAIN_T *p_chain, s32 do_relse)
 {
 	s32 num_clusters = 0;
 	u32 clu;
+#ifdef CONFIG_EXFAT_DISCARD
+	u32 run_clu = 0, run_len = 0;
+#endif /* CONFIG_EXFAT_DISCARD */
 	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
 	int i;
 	sector_t sector;
@@ -2005,6 +2485,11 @@ void exfat_free_cluster(struct super_block *sb, CHAIN_T *p_chain, s32 do_relse)
 
 			num_clusters++;
 		} while (num_clusters < p_chain->size);
+
+#ifdef CONFIG_EXFAT_DISCARD
+		if (EXFAT_SB(sb)->options.discard && (num_clusters > 0))
+			discard_add_range(sb, p_chain->dir, num_clusters);
+#endif /* CONFIG_EXFAT_DISCARD */
 	} else {
 		do {
 			if (p_fs->dev_ejected)
@@ -2019,10 +2504,25 @@ void exfat_free_cluster(struct super_block *sb, CHAIN_T *p_chain, s32 do_relse)
 			if (clr_alloc_bitmap(sb, clu-2) != FFS_SUCCESS)
 				break;
 
+#ifdef CONFIG_EXFAT_DISCARD
+			if (clu != (run_clu + run_len)) {
+				if (run_len && EXFAT_SB(sb)->options.discard)
+					discard_add_range(sb, run_clu, run_len);
+				run_clu = clu;
+				run_len = 0;
+			}
+			run_len++;
+#endif /* CONFIG_EXFAT_DISCARD */
+
 			if (FAT_read(sb, clu, &clu) == -1)
 				break;
 			num_clusters++;
 		} while ((clu != CLUSTER_32(0)) && (clu != CLUSTER_32(~0)));
+
+#ifdef CONFIG_EXFAT_DISCARD
+		if (run_len && EXFAT_SB(sb)->options.discard)
+			discard_add_range(sb, run_clu, run_len);
+#endif /* CONFIG_EXFAT_DISCARD */
 	}
 
 	if (p_fs->used_clusters != (u32) ~0)
@@ -2093,21 +2593,15 @@ s32 fat_count_used_clusters(struct super_block *sb)
 
 s32 exfat_count_used_clusters(struct super_block *sb)
 {
-	int i, map_i, map_b, count = 0;
-	u8 k;
+	int i, count;
 	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
-	BD_INFO_T *p_bd = &(EXFAT_SB(sb)->bd_info);
 
-	map_i = map_b = 0;
+	count = p_fs->num_clusters - 2;
 
-	for (i = 2; i < p_fs->num_clusters; i += 8) {
-		k = *(((u8 *) p_fs->vol_amap[map_i]->b_data) + map_b);
-		count += used_bit[k];
-
-		if ((++map_b) >= p_bd->sector_size) {
-			map_i++;
-			map_b = 0;
-		}
+	for (i = 0; i < p_fs->map_sectors; i++) {
+		if (p_fs->amap_sum[i].free == AMAP_SUM_UNKNOWN)
+			calc_alloc_bitmap_sum(sb, i);
+		count -= p_fs->amap_sum[i].free;
 	}
 
 	return count;
@@ -2127,6 +2621,142 @@ void exfat_chain_cont_cluster(struct super_block *sb, u32 chain, s32 len)
 	FAT_write(sb, chain, CLUSTER_32(~0));
 } /* end of exfat_chain_cont_cluster */
 
+/*
+ *  Extent Cache Management Functions
+ */
+
+void extent_cache_init(EXTENT_CACHE_T *ec)
+{
+	spin_lock_init(&ec->lock);
+	ec->num_extents = 0;
+	ec->tick = 0;
+} /* end of extent_cache_init */
+
+/* find the cached run which covers fclu or lies closest before it,
+   and move start_fclu/start_dclu as far toward fclu as the run allows.
+   return the number of contiguous clusters from that point, or 0 if
+   nothing useful is cached */
+s32 extent_cache_lookup(EXTENT_CACHE_T *ec, u32 fclu, u32 *start_fclu, u32 *start_dclu)
+{
+	s32 i;
+	u32 off;
+	EXTENT_T *ext = NULL;
+
+	spin_lock(&ec->lock);
+
+	for (i = 0; i < ec->num_extents; i++) {
+		if (ec->extents[i].fclu > fclu)
+			break;
+		ext = &(ec->extents[i]);
+	}
+
+	if (ext == NULL) {
+		spin_unlock(&ec->lock);
+		return 0;
+	}
+
+	off = fclu - ext->fclu;
+	if (off >= ext->len)
+		off = ext->len - 1;
+
+	ext->age = ++ec->tick;
+
+	*start_fclu = ext->fclu + off;
+	*start_dclu = ext->dclu + off;
+	off = ext->len - off;
+
+	spin_unlock(&ec->lock);
+
+	return (s32) off;
+} /* end of extent_cache_lookup */
+
+void extent_cache_add(EXTENT_CACHE_T *ec, u32 fclu, u32 dclu, u32 len)
+{
+	s32 i, j;
+	u32 end;
+	EXTENT_T *ext;
+
+	if (len == 0)
+		return;
+
+	end = fclu + len;
+
+	spin_lock(&ec->lock);
+
+	/* merge runs which overlap or touch the new one with the same
+	   mapping, and drop overlapping runs which disagree with it */
+	for (i = 0, j = 0; i < ec->num_extents; i++) {
+		ext = &(ec->extents[i]);
+
+		if ((ext->fclu + ext->len >= fclu) && (ext->fclu <= end)) {
+			if ((ext->dclu - ext->fclu) == (dclu - fclu)) {
+				if (ext->fclu < fclu) {
+					dclu = ext->dclu;
+					fclu = ext->fclu;
+				}
+				if (ext->fclu + ext->len > end)
+					end = ext->fclu + ext->len;
+				continue;
+			}
+			if ((ext->fclu + ext->len > fclu) && (ext->fclu < end))
+				continue;
+		}
+
+		if (i != j)
+			ec->extents[j] = *ext;
+		j++;
+	}
+	ec->num_extents = j;
+
+	/* evict the least recently used run */
+	if (ec->num_extents >= EXTENT_CACHE_SIZE) {
+		j = 0;
+		for (i = 1; i < ec->num_extents; i++) {
+			if (ec->extents[i].age < ec->extents[j].age)
+				j = i;
+		}
+		for (i = j; i < ec->num_extents - 1; i++)
+			ec->extents[i] = ec->extents[i+1];
+		ec->num_extents--;
+	}
+
+	for (i = ec->num_extents; (i > 0) && (ec->extents[i-1].fclu > fclu); i--)
+		ec->extents[i] = ec->extents[i-1];
+
+	ext = &(ec->extents[i]);
+	ext->fclu = fclu;
+	ext->dclu = dclu;
+	ext->len = end - fclu;
+	ext->age = ++ec->tick;
+
+	ec->num_extents++;
+
+	spin_unlock(&ec->lock);
+} /* end of extent_cache_add */
+
+/* forget every mapping at or beyond the given cluster offset */
+void extent_cache_inval(EXTENT_CACHE_T *ec, u32 fclu)
+{
+	s32 i;
+	EXTENT_T *ext;
+
+	spin_lock(&ec->lock);
+
+	for (i = 0; i < ec->num_extents; i++) {
+		ext = &(ec->extents[i]);
+		if (ext->fclu >= fclu)
+			break;
+		if (ext->fclu + ext->len > fclu) {
+			ext->len = fclu - ext->fclu;
+			i++;
+			break;
+		}
+	}
+	ec->num_extents = i;
+
+	spin_unlock(&ec->lock);
+} /* end of extent_cache_inval */
+
 /*
  *  Allocation Bitmap Management Functions
  */
@@ -2173,6 +2803,11 @@ s32 load_alloc_bitmap(struct super_block *sb)
 
 				sector = START_SECTOR(p_fs->map_clu);
 
+				/* get the whole bitmap in flight in large requests, so
+				   that the reads below mostly wait on cached sectors */
+				for (j = 0; j < p_fs->map_sectors; j += BITMAP_RA_SECTORS)
+					bdev_readahead(sb, sector+j, min_t(u32, BITMAP_RA_SECTORS, p_fs->map_sectors - j));
+
 				for (j = 0; j < p_fs->map_sectors; j++) {
 					p_fs->vol_amap[j] = NULL;
 					ret = sector_read(sb, sector+j, &(p_fs->vol_amap[j]), 1);
@@ -2189,6 +2824,26 @@ s32 load_alloc_bitmap(struct super_block *sb)
 					}
 				}
 
+				p_fs->amap_sum = (AMAP_SUM_T *) kmalloc(sizeof(AMAP_SUM_T) * p_fs->map_sectors, GFP_KERNEL);
+				if (p_fs->amap_sum == NULL) {
+					for (j = 0; j < p_fs->map_sectors; j++)
+						brelse(p_fs->vol_amap[j]);
+
+					kfree(p_fs->vol_amap);
+					p_fs->vol_amap = NULL;
+					return FFS_MEMORYERR;
+				}
+
+				/* the summaries and the used cluster count are computed
+				   later by exfat_count_used_clusters() (from a work item
+				   queued at mount, or by statfs), until then the
+				   allocator treats an unknown summary as "maybe" */
+				for (j = 0; j < p_fs->map_sectors; j++) {
+					p_fs->amap_sum[j].free = AMAP_SUM_UNKNOWN;
+					p_fs->amap_sum[j].max_run = AMAP_SUM_UNKNOWN;
+				}
+				p_fs->used_clusters = (u32) ~0;
+
 				p_fs->pbr_bh = NULL;
 				return FFS_SUCCESS;
 			}
@@ -2214,6 +2869,10 @@ void free_alloc_bitmap(struct super_block *sb)
 	if (p_fs->vol_amap)
 		kfree(p_fs->vol_amap);
 	p_fs->vol_amap = NULL;
+
+	if (p_fs->amap_sum)
+		kfree(p_fs->amap_sum);
+	p_fs->amap_sum = NULL;
 } /* end of free_alloc_bitmap */
 
 s32 set_alloc_bitmap(struct super_block *sb, u32 clu)
@@ -2228,6 +2887,13 @@ s32 set_alloc_bitmap(struct super_block *sb, u32 clu)
 
 	sector = START_SECTOR(p_fs->map_clu) + i;
 
+	if (!exfat_bitmap_test((u8 *) p_fs->vol_amap[i]->b_data, b) &&
+		(p_fs->amap_sum[i].free != AMAP_SUM_UNKNOWN)) {
+		p_fs->amap_sum[i].free--;
+		if (p_fs->amap_sum[i].max_run > p_fs->amap_sum[i].free)
+			p_fs->amap_sum[i].max_run = p_fs->amap_sum[i].free;
+	}
+
 	exfat_bitmap_set((u8 *) p_fs->vol_amap[i]->b_data, b);
 
 	return sector_write(sb, sector, p_fs->vol_amap[i], 0);
@@ -2237,11 +2903,6 @@ s32 clr_alloc_bitmap(struct super_block *sb, u32 clu)
 {
 	int i, b;
 	sector_t sector;
-#ifdef CONFIG_EXFAT_DISCARD
-	struct exfat_sb_info *sbi = EXFAT_SB(sb);
-	struct exfat_mount_options *opts = &sbi->options;
-	int ret;
-#endif /* CONFIG_EXFAT_DISCARD */
 	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
 	BD_INFO_T *p_bd = &(EXFAT_SB(sb)->bd_info);
 
@@ -2250,83 +2911,308 @@ s32 clr_alloc_bitmap(struct super_block *sb, u32 clu)
 
 	sector = START_SECTOR(p_fs->map_clu) + i;
 
+	/* the freed cluster may join two runs; keep max_run an upper bound */
+	if (exfat_bitmap_test((u8 *) p_fs->vol_amap[i]->b_data, b) &&
+		(p_fs->amap_sum[i].free != AMAP_SUM_UNKNOWN)) {
+		p_fs->amap_sum[i].free++;
+		p_fs->amap_sum[i].max_run = p_fs->amap_sum[i].free;
+	}
+
 	exfat_bitmap_clear((u8 *) p_fs->vol_amap[i]->b_data, b);
 
 	return sector_write(sb, sector, p_fs->vol_amap[i], 0);
+} /* end of clr_alloc_bitmap */
 
-#ifdef CONFIG_EXFAT_DISCARD
-	if (opts->discard) {
-#if LINUX_VERSION_CODE < KERNEL_VERSION(2,6,37)
-		ret = sb_issue_discard(sb, START_SECTOR(clu), (1 << p_fs->sectors_per_clu_bits));
-#else
-		ret = sb_issue_discard(sb, START_SECTOR(clu), (1 << p_fs->sectors_per_clu_bits), GFP_NOFS, 0);
-#endif
-		if (ret == -EOPNOTSUPP) {
-			printk(KERN_WARNING "discard not supported by device, disabling");
-			opts->discard = 0;
+/* recompute the free count and the longest free run of a bitmap sector */
+void calc_alloc_bitmap_sum(struct super_block *sb, s32 map_i)
+{
+	u32 start, stop, limit, max_run = 0, num_free = 0;
+	u8 *bitmap;
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+	BD_INFO_T *p_bd = &(EXFAT_SB(sb)->bd_info);
+
+	bitmap = (u8 *) p_fs->vol_amap[map_i]->b_data;
+
+	/* bits beyond the last cluster are not part of the volume */
+	limit = (p_fs->num_clusters - 2) - ((u32) map_i << (p_bd->sector_size_bits + 3));
+	if (limit > (p_bd->sector_size << 3))
+		limit = p_bd->sector_size << 3;
+
+	start = 0;
+	while (start < limit) {
+		start = exfat_bitmap_find_zero(bitmap, limit, start);
+		if (start >= limit)
+			break;
+		stop = exfat_bitmap_find_one(bitmap, limit, start);
+
+		num_free += stop - start;
+		if ((stop - start) > max_run)
+			max_run = stop - start;
+		start = stop + 1;
+	}
+
+	p_fs->amap_sum[map_i].free = (u16) num_free;
+	p_fs->amap_sum[map_i].max_run = (u16) max_run;
+} /* end of calc_alloc_bitmap_sum */
+
+/* find the first free (or used) bit of the allocation bitmap in
+   [clu, end), a whole bitmap sector at a time.
+   return end if there is no such bit */
+static u32 __find_alloc_bitmap(struct super_block *sb, u32 clu, u32 end, s32 used)
+{
+	int map_i, map_b, b;
+	u32 base, limit, bits_per_sector;
+	u8 *bitmap;
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+	BD_INFO_T *p_bd = &(EXFAT_SB(sb)->bd_info);
+
+	bits_per_sector = p_bd->sector_size << 3;
+
+	while (clu < end) {
+		map_i = clu >> (p_bd->sector_size_bits + 3);
+		map_b = clu & (bits_per_sector - 1);
+		base = clu - map_b;
+
+		limit = end - base;
+		if (limit > bits_per_sector)
+			limit = bits_per_sector;
+
+		/* skip the sectors which are entirely used (or free) */
+		if ((!used && (p_fs->amap_sum[map_i].free == 0)) ||
+			(used && (p_fs->amap_sum[map_i].free == bits_per_sector))) {
+			clu = base + bits_per_sector;
+			continue;
 		}
+
+		bitmap = (u8 *) p_fs->vol_amap[map_i]->b_data;
+		if (used)
+			b = exfat_bitmap_find_one(bitmap, limit, map_b);
+		else
+			b = exfat_bitmap_find_zero(bitmap, limit, map_b);
+
+		if (b < limit)
+			return base + b;
+
+		clu = base + bits_per_sector;
 	}
-#endif /* CONFIG_EXFAT_DISCARD */
-} /* end of clr_alloc_bitmap */
 
+	return end;
+} /* end of __find_alloc_bitmap */
+
+/* return the first free cluster at or after the given bitmap index
+   (wrapping around to the start of the volume) */
 u32 test_alloc_bitmap(struct super_block *sb, u32 clu)
 {
-	int i, map_i, map_b;
-	u32 clu_base, clu_free;
-	u8 k, clu_mask;
+	u32 clu_free, num_bits;
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+
+	num_bits = p_fs->num_clusters - 2;
+	if (clu >= num_bits)
+		clu = 0;
+
+	clu_free = __find_alloc_bitmap(sb, clu, num_bits, 0);
+	if (clu_free < num_bits)
+		return clu_free + 2;
+
+	clu_free = __find_alloc_bitmap(sb, 0, clu, 0);
+	if (clu_free < clu)
+		return clu_free + 2;
+
+	return CLUSTER_32(~0);
+} /* end of test_alloc_bitmap */
+
+/* find a run of num_alloc free clusters at or after the given bitmap
+   index (wrapping around).  return its first cluster, or the first
+   cluster of the longest run seen if no run is long enough, and store
+   the length of the returned run (at most num_alloc) in *run_len */
+u32 test_alloc_bitmap_run(struct super_block *sb, u32 clu, u32 num_alloc, u32 *run_len)
+{
+	u32 start, stop, end, limit, num_bits, base;
+	u32 best_clu = CLUSTER_32(~0), best_len = 0;
+	s32 pass, i, map_i;
 	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
 	BD_INFO_T *p_bd = &(EXFAT_SB(sb)->bd_info);
 
-	clu_base = (clu & ~(0x7)) + 2;
-	clu_mask = (1 << (clu - clu_base + 2)) - 1;
+	num_bits = p_fs->num_clusters - 2;
+	if (clu >= num_bits)
+		clu = 0;
 
-	map_i = clu >> (p_bd->sector_size_bits + 3);
-	map_b = (clu >> 3) & p_bd->sector_size_mask;
+	/* a run which fits in one bitmap sector: only visit the sectors
+	   whose summary says it can be there, and refresh their summary */
+	if (num_alloc <= (p_bd->sector_size << 3)) {
+		map_i = clu >> (p_bd->sector_size_bits + 3);
 
-	for (i = 2; i < p_fs->num_clusters; i += 8) {
-		k = *(((u8 *) p_fs->vol_amap[map_i]->b_data) + map_b);
-		if (clu_mask > 0) {
-			k |= clu_mask;
-			clu_mask = 0;
-		}
-		if (k < 0xFF) {
-			clu_free = clu_base + free_bit[k];
-			if (clu_free < p_fs->num_clusters)
-				return clu_free;
+		for (i = 0; i < p_fs->map_sectors; i++, map_i++) {
+			if (map_i >= p_fs->map_sectors)
+				map_i = 0;
+
+			if (p_fs->amap_sum[map_i].max_run < num_alloc)
+				continue;
+
+			base = (u32) map_i << (p_bd->sector_size_bits + 3);
+			end = base + (p_bd->sector_size << 3);
+			if (end > num_bits)
+				end = num_bits;
+
+			for (start = base; start < end; start = stop + 1) {
+				start = __find_alloc_bitmap(sb, start, end, 0);
+				if (start >= end)
+					break;
+				stop = __find_alloc_bitmap(sb, start, end, 1);
+
+				if ((stop - start) >= num_alloc) {
+					*run_len = num_alloc;
+					return start + 2;
+				}
+			}
+
+			calc_alloc_bitmap_sum(sb, map_i);
 		}
-		clu_base += 8;
+	}
 
-		if (((++map_b) >= p_bd->sector_size) || (clu_base >= p_fs->num_clusters)) {
-			if ((++map_i) >= p_fs->map_sectors) {
-				clu_base = 2;
-				map_i = 0;
+	for (pass = 0; pass < 2; pass++) {
+		start = (pass == 0) ? clu : 0;
+		end = (pass == 0) ? num_bits : clu;
+
+		while (start < end) {
+			start = __find_alloc_bitmap(sb, start, end, 0);
+			if (start >= end)
+				break;
+
+			limit = ((num_bits - start) > num_alloc) ? (start + num_alloc) : num_bits;
+			stop = __find_alloc_bitmap(sb, start, limit, 1);
+
+			if ((stop - start) > best_len) {
+				best_clu = start + 2;
+				best_len = stop - start;
+				if (best_len >= num_alloc)
+					goto out;
 			}
-			map_b = 0;
+			start = stop + 1;
 		}
 	}
 
-	return CLUSTER_32(~0);
-} /* end of test_alloc_bitmap */
+out:
+	*run_len = best_len;
+	return best_clu;
+} /* end of test_alloc_bitmap_run */
 
 void sync_alloc_bitmap(struct super_block *sb)
 {
-	int i;
 	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
 
-	if (p_fs->vol_amap == NULL)
-		return;
+	if (p_fs->vol_amap == NULL)
+		return;
+
+	/* the bitmap sectors are contiguous and already in order */
+	bdev_write_buffers(sb, p_fs->vol_amap, p_fs->map_sectors);
+} /* end of sync_alloc_bitmap */
+
+#ifdef CONFIG_EXFAT_DISCARD
+/* queue a run of freed clusters for the discard worker, merging it
+   with the last queued run when they are adjacent */
+void discard_add_range(struct super_block *sb, u32 clu, u32 len)
+{
+	DISCARD_EXTENT_T *ext;
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+
+	if (p_fs->discard_list == NULL) {
+		p_fs->discard_list = (DISCARD_EXTENT_T *) kmalloc(DISCARD_MAX_EXTENTS * sizeof(DISCARD_EXTENT_T), GFP_NOFS);
+		if (p_fs->discard_list == NULL)
+			return;
+		p_fs->discard_count = 0;
+	}
+
+	if (p_fs->discard_count > 0) {
+		ext = &(p_fs->discard_list[p_fs->discard_count - 1]);
+		if ((ext->clu + ext->len) == clu) {
+			ext->len += len;
+			goto out;
+		}
+		if ((clu + len) == ext->clu) {
+			ext->clu = clu;
+			ext->len += len;
+			goto out;
+		}
+	}
+
+	/* the worker is behind: the run stays undiscarded until FITRIM */
+	if (p_fs->discard_count >= DISCARD_MAX_EXTENTS)
+		goto out;
+
+	ext = &(p_fs->discard_list[p_fs->discard_count++]);
+	ext->clu = clu;
+	ext->len = len;
+out:
+	schedule_delayed_work(&(EXFAT_SB(sb)->discard_work), msecs_to_jiffies(DISCARD_DELAY_MS));
+} /* end of discard_add_range */
+
+/* discard the free clusters of the bitmap range [start, end) in runs of
+   at least minlen clusters.  the caller holds the volume lock, so none of
+   them can be reallocated and written before its discard completes */
+static s32 __discard_free_runs(struct super_block *sb, u32 start, u32 end, u32 minlen, u32 *trimmed)
+{
+	int ret;
+	u32 stop;
+	struct exfat_mount_options *opts = &(EXFAT_SB(sb)->options);
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+
+	while (start < end) {
+		start = __find_alloc_bitmap(sb, start, end, 0);
+		if (start >= end)
+			break;
+		stop = __find_alloc_bitmap(sb, start, end, 1);
+
+		if ((stop - start) >= minlen) {
+#if LINUX_VERSION_CODE < KERNEL_VERSION(2,6,37)
+			ret = sb_issue_discard(sb, START_SECTOR(start + 2),
+					(sector_t) (stop - start) << p_fs->sectors_per_clu_bits);
+#else
+			ret = sb_issue_discard(sb, START_SECTOR(start + 2),
+					(sector_t) (stop - start) << p_fs->sectors_per_clu_bits, GFP_NOFS, 0);
+#endif
+			if (ret == -EOPNOTSUPP) {
+				printk(KERN_WARNING "[EXFAT] discard not supported by device, disabling\n");
+				opts->discard = 0;
+				return FFS_ERROR;
+			}
+			if (ret)
+				return FFS_MEDIAERR;
+
+			if (trimmed)
+				*trimmed += stop - start;
+		}
+		start = stop;
+	}
+
+	return FFS_SUCCESS;
+} /* end of __discard_free_runs */
+#endif /* CONFIG_EXFAT_DISCARD */
+
+/*
+ *  Upcase table Management Functions
+ */
+
+/* the table is kept flat so that nls_upper() is a single load; entries
+   which the volume does not map are filled with their own code unit */
+static u16 *alloc_upcase_table(void)
+{
+	u32 i;
+	u16 *upcase_table;
+
+	upcase_table = (u16 *) vmalloc(UTBL_COUNT * sizeof(u16));
+	if (upcase_table == NULL)
+		return NULL;
+
+	for (i = 0; i < UTBL_COUNT; i++)
+		upcase_table[i] = (u16) i;
 
-	for (i = 0; i < p_fs->map_sectors; i++)
-		bdev_sync_dirty_buffer(p_fs->vol_amap[i], sb, 1);
-} /* end of sync_alloc_bitmap */
+	return upcase_table;
+}
 
-/*
- *  Upcase table Management Functions
- */
 s32 __load_upcase_table(struct super_block *sb, sector_t sector, u32 num_sectors, u32 utbl_checksum)
 {
 	int i, ret = FFS_ERROR;
-	u32 j;
 	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
 	BD_INFO_T *p_bd = &(EXFAT_SB(sb)->bd_info);
 	struct buffer_head *tmp_bh = NULL;
@@ -2335,14 +3221,13 @@ s32 __load_upcase_table(struct super_block *sb, sector_t sector, u32 num_sectors
 	u8	skip = FALSE;
 	u32	index = 0;
 	u16	uni = 0;
-	u16 **upcase_table;
+	u16 *upcase_table;
 
 	u32 checksum = 0;
 
-	upcase_table = p_fs->vol_utbl = (u16 **) kmalloc(UTBL_COL_COUNT * sizeof(u16 *), GFP_KERNEL);
+	upcase_table = p_fs->vol_utbl = alloc_upcase_table();
 	if (upcase_table == NULL)
 		return FFS_MEMORYERR;
-	memset(upcase_table, 0, UTBL_COL_COUNT * sizeof(u16 *));
 
 	while (sector < end_sector) {
 		ret = sector_read(sb, sector, &tmp_bh, 1);
@@ -2368,21 +3253,7 @@ s32 __load_upcase_table(struct super_block *sb, sector_t sector, u32 num_sectors
 			else if (uni == 0xFFFF)
 				skip = TRUE;
 			else { /* uni != index , uni != 0xFFFF */
-				u16 col_index = get_col_index(index);
-
-				if (upcase_table[col_index] == NULL) {
-					DPRINTK("alloc = 0x%X\n", col_index);
-					upcase_table[col_index] = (u16 *) kmalloc(UTBL_ROW_COUNT * sizeof(u16), GFP_KERNEL);
-					if (upcase_table[col_index] == NULL) {
-						ret = FFS_MEMORYERR;
-						goto error;
-					}
-
-					for (j = 0; j < UTBL_ROW_COUNT; j++)
-						upcase_table[col_index][j] = (col_index << LOW_INDEX_BIT) | j;
-				}
-
-				upcase_table[col_index][get_row_index(index)] = uni;
+				upcase_table[index] = uni;
 				index++;
 			}
 		}
@@ -2403,18 +3274,16 @@ error:
 s32 __load_default_upcase_table(struct super_block *sb)
 {
 	int i, ret = FFS_ERROR;
-	u32 j;
 	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
 
 	u8	skip = FALSE;
 	u32	index = 0;
 	u16	uni = 0;
-	u16 **upcase_table;
+	u16 *upcase_table;
 
-	upcase_table = p_fs->vol_utbl = (u16 **) kmalloc(UTBL_COL_COUNT * sizeof(u16 *), GFP_KERNEL);
+	upcase_table = p_fs->vol_utbl = alloc_upcase_table();
 	if (upcase_table == NULL)
 		return FFS_MEMORYERR;
-	memset(upcase_table, 0, UTBL_COL_COUNT * sizeof(u16 *));
 
 	for (i = 0; index <= 0xFFFF && i < NUM_UPCASE*2; i += 2) {
 		uni = GET16(uni_upcase + i);
@@ -2428,21 +3297,7 @@ s32 __load_default_upcase_table(struct super_block *sb)
 		else if (uni == 0xFFFF)
 			skip = TRUE;
 		else { /* uni != index , uni != 0xFFFF */
-			u16 col_index = get_col_index(index);
-
-			if (upcase_table[col_index] == NULL) {
-				DPRINTK("alloc = 0x%X\n", col_index);
-				upcase_table[col_index] = (u16 *) kmalloc(UTBL_ROW_COUNT * sizeof(u16), GFP_KERNEL);
-				if (upcase_table[col_index] == NULL) {
-					ret = FFS_MEMORYERR;
-					goto error;
-				}
-
-				for (j = 0; j < UTBL_ROW_COUNT; j++)
-					upcase_table[col_index][j] = (col_index << LOW_INDEX_BIT) | j;
-			}
-
-			upcase_table[col_index][get_row_index(index)] = uni;
+			upcase_table[index] = uni;
 			index++;
 		}
 	}
@@ -2450,7 +3305,6 @@ s32 __load_default_upcase_table(struct super_block *sb)
 	if (index >= 0xFFFF)
 		return FFS_SUCCESS;
 
-error:
 	/* FATAL error: default upcase table has error */
 	free_upcase_table(sb);
 	return ret;
@@ -2505,18 +3359,10 @@ s32 load_upcase_table(struct super_block *sb)
 
 void free_upcase_table(struct super_block *sb)
 {
-	u32 i;
 	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
-	u16 **upcase_table;
-
-	upcase_table = p_fs->vol_utbl;
-	for (i = 0; i < UTBL_COL_COUNT; i++) {
-		if (upcase_table[i])
-			kfree(upcase_table[i]);
-	}
 
 	if (p_fs->vol_utbl)
-		kfree(p_fs->vol_utbl);
+		vfree(p_fs->vol_utbl);
 	p_fs->vol_utbl = NULL;
 } /* end of free_upcase_table */
 
@@ -2942,10 +3788,14 @@ s32 exfat_init_ext_entry(struct super_block *sb, CHAIN_T *p_dir, s32 entry, s32
 	if (!strm_ep)
 		return FFS_MEDIAERR;
 
+	dir_index_del_entry(sb, p_dir, GET16_A(strm_ep->name_hash), entry);
+
 	strm_ep->name_len = p_uniname->name_len;
 	SET16_A(strm_ep->name_hash, p_uniname->name_hash);
 	buf_modify(sb, sector);
 
+	dir_index_add_entry(sb, p_dir, p_uniname->name_hash, entry);
+
 	for (i = 2; i < num_entries; i++) {
 		name_ep = (NAME_DENTRY_T *) get_entry_in_dir(sb, p_dir, entry+i, &sector);
 		if (!name_ep)
@@ -3088,6 +3938,12 @@ void exfat_delete_dir_entry(struct super_block *sb, CHAIN_T *p_dir, s32 entry, s
 	DENTRY_T *ep;
 	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
 
+	if ((order == 0) && (num_entries > 1)) {
+		ep = get_entry_in_dir(sb, p_dir, entry+1, NULL);
+		if (ep && (p_fs->fs_func->get_entry_type(ep) == TYPE_STREAM))
+			dir_index_del_entry(sb, p_dir, GET16_A(((STRM_DENTRY_T *) ep)->name_hash), entry);
+	}
+
 	for (i = order; i < num_entries; i++) {
 		ep = get_entry_in_dir(sb, p_dir, entry+i, &sector);
 		if (!ep)
@@ -3113,7 +3969,7 @@ void update_dir_checksum(struct super_block *sb, CHAIN_T *p_dir, s32 entry)
 	buf_lock(sb, sector);
 
 	num_entries = (s32) file_ep->num_ext + 1;
-	chksum = calc_checksum_2byte((void *) file_ep, DENTRY_SIZE, 0, CS_DIR_ENTRY);
+	chksum = calc_dentry_checksum((DENTRY_T *) file_ep, 0, CS_DIR_ENTRY);
 
 	for (i = 1; i < num_entries; i++) {
 		ep = get_entry_in_dir(sb, p_dir, entry+i, NULL);
@@ -3122,7 +3978,7 @@ void update_dir_checksum(struct super_block *sb, CHAIN_T *p_dir, s32 entry)
 			return;
 		}
 
-		chksum = calc_checksum_2byte((void *) ep, DENTRY_SIZE, chksum, CS_DEFAULT);
+		chksum = calc_dentry_checksum(ep, chksum, CS_DEFAULT);
 	}
 
 	SET16_A(file_ep->checksum, chksum);
@@ -3133,18 +3989,11 @@ void update_dir_checksum(struct super_block *sb, CHAIN_T *p_dir, s32 entry)
 void update_dir_checksum_with_entry_set(struct super_block *sb, ENTRY_SET_CACHE_T *es)
 {
 	DENTRY_T *ep;
-	u16 chksum = 0;
-	s32 chksum_type = CS_DIR_ENTRY, i;
+	u16 chksum;
 
 	ep = (DENTRY_T *)&(es->__buf);
-	for (i = 0; i < es->num_entries; i++) {
-		DPRINTK("update_dir_checksum_with_entry_set ep %p\n", ep);
-		chksum = calc_checksum_2byte((void *) ep, DENTRY_SIZE, chksum, chksum_type);
-		ep++;
-		chksum_type = CS_DEFAULT;
-	}
+	chksum = calc_entry_set_checksum(ep, es->num_entries);
 
-	ep = (DENTRY_T *)&(es->__buf);
 	SET16_A(((FILE_DENTRY_T *)ep)->checksum, chksum);
 	write_whole_entry_set(sb, es);
 }
@@ -3230,6 +4079,44 @@ DENTRY_T *get_entry_in_dir(struct super_block *sb, CHAIN_T *p_dir, s32 entry, se
 	return (DENTRY_T *)(buf + off);
 } /* end of get_entry_in_dir */
 
+/* start reading the window of DIR_RA_SECTORS sectors which holds the given
+   entry of p_clu (one cluster of a directory, or the FAT16 root), from the
+   entry's sector to the end of the window. A contiguous directory is read
+   ahead past the end of the cluster. Returns the first entry of the next
+   window, so a scan calls this again only once it gets there */
+s32 dir_readahead(struct super_block *sb, CHAIN_T *p_clu, s32 entry)
+{
+	s32 ra_bits, num_secs;
+	u32 off, num_avail;
+	sector_t sec;
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+	BD_INFO_T *p_bd = &(EXFAT_SB(sb)->bd_info);
+
+	off = (u32) entry >> (p_bd->sector_size_bits - DENTRY_SIZE_BITS);
+	ra_bits = ilog2(DIR_RA_SECTORS) + p_bd->sector_size_bits - DENTRY_SIZE_BITS;
+
+	if (p_clu->dir == CLUSTER_32(0)) { /* FAT16 root_dir */
+		sec = p_fs->root_start_sector + off;
+		num_avail = (u32) p_fs->dentries_in_root >> (p_bd->sector_size_bits - DENTRY_SIZE_BITS);
+	} else {
+		sec = START_SECTOR(p_clu->dir) + off;
+		num_avail = p_fs->sectors_per_clu;
+		if ((p_clu->flags == 0x03) && (p_clu->size > 1))
+			num_avail += (u32) min_t(s32, p_clu->size - 1, DIR_RA_SECTORS) << p_fs->sectors_per_clu_bits;
+	}
+
+	num_secs = DIR_RA_SECTORS - (off & (DIR_RA_SECTORS - 1));
+	if (off >= num_avail)
+		num_secs = 0;
+	else if (num_secs > (s32)(num_avail - off))
+		num_secs = (s32)(num_avail - off);
+
+	if (num_secs > 1)
+		sector_readahead(sb, sec, num_secs);
+
+	return ((entry >> ra_bits) + 1) << ra_bits;
+} /* end of dir_readahead */
+
 
 /* returns a set of dentries for a file or dir.
  * Note that this is a copy (dump) of dentries so that user should call write_entry_set()
@@ -3301,6 +4188,7 @@ ENTRY_SET_CACHE_T *get_entry_set_in_dir(struct super_block *sb, CHAIN_T *p_dir,
 		goto err_out;
 
 	es->num_entries = num_entries;
+	es->dirty = FALSE;
 	es->sector = sec;
 	es->offset = off;
 	es->alloc_flag = p_dir->flags;
@@ -3406,6 +4294,40 @@ void release_entry_set(ENTRY_SET_CACHE_T *es)
 		kfree(es);
 }
 
+/* the entry set of an open file is kept in its inode: callers change it
+   in memory and set es->dirty, sync_inode_entry_set() writes it back
+   (from ffsSetStat() at inode write-back, or on release). ffsSetStat()
+   drops it after the write-back, and so must anyone changing the entries
+   in the buffer cache, or the stale set is written back over them */
+ENTRY_SET_CACHE_T *get_inode_entry_set(struct inode *inode, DENTRY_T **file_ep)
+{
+	FILE_ID_T *fid = &(EXFAT_I(inode)->fid);
+	ENTRY_SET_CACHE_T *es = EXFAT_I(inode)->es;
+
+	if (es == NULL) {
+		es = get_entry_set_in_dir(inode->i_sb, &(fid->dir), fid->entry, ES_ALL_ENTRIES, NULL);
+		if (es == NULL)
+			return NULL;
+		EXFAT_I(inode)->es = es;
+	}
+
+	if (file_ep)
+		*file_ep = (DENTRY_T *)&(es->__buf);
+
+	return es;
+}
+
+void sync_inode_entry_set(struct inode *inode)
+{
+	ENTRY_SET_CACHE_T *es = EXFAT_I(inode)->es;
+
+	if ((es == NULL) || !es->dirty)
+		return;
+
+	update_dir_checksum_with_entry_set(inode->i_sb, es);
+	es->dirty = FALSE;
+}
+
 
 static s32 __write_partial_entries_in_entry_set(struct super_block *sb, ENTRY_SET_CACHE_T *es, sector_t sec, s32 off, u32 count)
 {
@@ -3653,6 +4575,11 @@ s32 find_empty_entry(struct inode *inode, CHAIN_T *p_dir, s32 num_entries)
 			if (p_dir->dir != p_fs->root_dir) {
 				size += p_fs->cluster_size;
 
+				/* the stream entry is changed in the buffer cache
+				   below, so a set cached for the directory would
+				   write its old size and flags back over it */
+				ffsReleaseEntrySet(inode, 1);
+
 				ep = get_entry_in_dir(sb, &(fid->dir), fid->entry+1, &sector);
 				if (!ep)
 					return -1;
@@ -3677,14 +4604,15 @@ s32 find_empty_entry(struct inode *inode, CHAIN_T *p_dir, s32 num_entries)
 /* return values of fat_find_dir_entry()
    >= 0 : return dir entiry position with the name in dir
    -1 : (root dir, ".") it is the root dir itself
-   -2 : entry with the name does not exist */
+   -2 : entry with the name does not exist
+   the caller has upcased the name into p_fs->vol_upname */
 s32 fat_find_dir_entry(struct super_block *sb, CHAIN_T *p_dir, UNI_NAME_T *p_uniname, s32 num_entries, DOS_NAME_T *p_dosname, u32 type)
 {
 	int i, dentry = 0, lossy = FALSE, len;
 	s32 order = 0, is_feasible_entry = TRUE, has_ext_entry = FALSE;
-	s32 dentries_per_clu;
+	s32 dentries_per_clu, ra_entry;
 	u32 entry_type;
-	u16 entry_uniname[14], *uniname = NULL, unichar;
+	u16 entry_uniname[14], *uniname = NULL;
 	CHAIN_T clu;
 	DENTRY_T *ep;
 	DOS_DENTRY_T *dos_ep;
@@ -3709,7 +4637,10 @@ s32 fat_find_dir_entry(struct super_block *sb, CHAIN_T *p_dir, UNI_NAME_T *p_uni
 		if (p_fs->dev_ejected)
 			break;
 
-		for (i = 0; i < dentries_per_clu; i++, dentry++) {
+		for (i = 0, ra_entry = 0; i < dentries_per_clu; i++, dentry++) {
+			if (i >= ra_entry)
+				ra_entry = dir_readahead(sb, &clu, i);
+
 			ep = get_entry_in_dir(sb, &clu, i, NULL);
 			if (!ep)
 				return -2;
@@ -3732,7 +4663,7 @@ s32 fat_find_dir_entry(struct super_block *sb, CHAIN_T *p_dir, UNI_NAME_T *p_uni
 					ext_ep = (EXT_DENTRY_T *) ep;
 					if (ext_ep->order > 0x40) {
 						order = (s32)(ext_ep->order - 0x40);
-						uniname = p_uniname->name + 13 * (order-1);
+						uniname = p_fs->vol_upname + 13 * (order-1);
 					} else {
 						order = (s32) ext_ep->order;
 						uniname -= 13;
@@ -3740,13 +4671,8 @@ s32 fat_find_dir_entry(struct super_block *sb, CHAIN_T *p_dir, UNI_NAME_T *p_uni
 
 					len = extract_uni_name_from_ext_entry(ext_ep, entry_uniname, order);
 
-					unichar = *(uniname+len);
-					*(uniname+len) = 0x0;
-
-					if (nls_uniname_cmp(sb, uniname, entry_uniname))
+					if (nls_upname_cmp(sb, uniname, entry_uniname, len))
 						is_feasible_entry = FALSE;
-
-					*(uniname+len) = unichar;
 				}
 				has_ext_entry = TRUE;
 			} else if (entry_type == TYPE_UNUSED) {
@@ -3770,14 +4696,15 @@ s32 fat_find_dir_entry(struct super_block *sb, CHAIN_T *p_dir, UNI_NAME_T *p_uni
 /* return values of exfat_find_dir_entry()
    >= 0 : return dir entiry position with the name in dir
    -1 : (root dir, ".") it is the root dir itself
-   -2 : entry with the name does not exist */
+   -2 : entry with the name does not exist
+   the caller has upcased the name into p_fs->vol_upname */
 s32 exfat_find_dir_entry(struct super_block *sb, CHAIN_T *p_dir, UNI_NAME_T *p_uniname, s32 num_entries, DOS_NAME_T *p_dosname, u32 type)
 {
 	int i = 0, dentry = 0, num_ext_entries = 0, len, step;
 	s32 order = 0, is_feasible_entry = FALSE;
-	s32 dentries_per_clu, num_empty = 0;
+	s32 dentries_per_clu, num_empty = 0, ra_entry;
 	u32 entry_type;
-	u16 entry_uniname[16], *uniname = NULL, unichar;
+	u16 entry_uniname[16], *uniname = NULL;
 	CHAIN_T clu;
 	DENTRY_T *ep;
 	FILE_DENTRY_T *file_ep;
@@ -3803,11 +4730,25 @@ s32 exfat_find_dir_entry(struct super_block *sb, CHAIN_T *p_dir, UNI_NAME_T *p_u
 	p_fs->hint_uentry.dir = p_dir->dir;
 	p_fs->hint_uentry.entry = -1;
 
+	/* large directories are looked up through the name hash index */
+	if (dir_index_lookup(sb, p_dir, p_uniname, type, &dentry) == FFS_SUCCESS) {
+		if (dentry >= 0) {
+			p_fs->hint_uentry.dir = CLUSTER_32(~0);
+			p_fs->hint_uentry.entry = -1;
+		}
+		return dentry;
+	}
+
 	while (clu.dir != CLUSTER_32(~0)) {
 		if (p_fs->dev_ejected)
 			break;
 
+		ra_entry = 0;
+
 		while (i < dentries_per_clu) {
+			if (i >= ra_entry)
+				ra_entry = dir_readahead(sb, &clu, i);
+
 			ep = get_entry_in_dir(sb, &clu, i, NULL);
 			if (!ep)
 				return -2;
@@ -3860,16 +4801,13 @@ s32 exfat_find_dir_entry(struct super_block *sb, CHAIN_T *p_dir, UNI_NAME_T *p_u
 						name_ep = (NAME_DENTRY_T *) ep;
 
 						if ((++order) == 2)
-							uniname = p_uniname->name;
+							uniname = p_fs->vol_upname;
 						else
 							uniname += 15;
 
 						len = extract_uni_name_from_name_entry(name_ep, entry_uniname, order);
 
-						unichar = *(uniname+len);
-						*(uniname+len) = 0x0;
-
-						if (nls_uniname_cmp(sb, uniname, entry_uniname)) {
+						if (nls_upname_cmp(sb, uniname, entry_uniname, len)) {
 							is_feasible_entry = FALSE;
 							step = num_ext_entries - order + 1;
 						} else if (order == num_ext_entries) {
@@ -3877,8 +4815,6 @@ s32 exfat_find_dir_entry(struct super_block *sb, CHAIN_T *p_dir, UNI_NAME_T *p_u
 							p_fs->hint_uentry.entry = -1;
 							return dentry - (num_ext_entries);
 						}
-
-						*(uniname+len) = unichar;
 					}
 				} else {
 					is_feasible_entry = FALSE;
@@ -4078,6 +5014,347 @@ bool is_dir_empty(struct super_block *sb, CHAIN_T *p_dir)
 	return TRUE;
 } /* end of is_dir_empty */
 
+/*
+ *  Directory Entry Index Functions
+ */
+
+/* the slot table is kept at most 3/4 full (including deleted slots) */
+#define DIR_INDEX_FULL(idx)     (((idx)->num_used + 1) * 4 > (idx)->num_slots * 3)
+
+static u32 __dir_index_slot(DIR_INDEX_T *idx, u16 name_hash)
+{
+	return ((u32) name_hash * 0x9E3779B1) & (idx->num_slots - 1);
+}
+
+static void __dir_index_free(DIR_INDEX_T *idx)
+{
+	if (idx->slots)
+		vfree(idx->slots);
+	kfree(idx);
+} /* end of __dir_index_free */
+
+static s32 __dir_index_resize(DIR_INDEX_T *idx, u32 num_slots)
+{
+	u32 i, j, old_num_slots = idx->num_slots;
+	DIR_INDEX_SLOT_T *old_slots = idx->slots;
+
+	/* called with v_sem held, reclaim must not come back into the fs */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,8,0)
+	idx->slots = (DIR_INDEX_SLOT_T *) __vmalloc(sizeof(DIR_INDEX_SLOT_T) * num_slots, GFP_NOFS);
+#else
+	idx->slots = (DIR_INDEX_SLOT_T *) __vmalloc(sizeof(DIR_INDEX_SLOT_T) * num_slots, GFP_NOFS, PAGE_KERNEL);
+#endif
+	if (idx->slots == NULL) {
+		idx->slots = old_slots;
+		return FFS_MEMORYERR;
+	}
+
+	idx->num_slots = num_slots;
+	idx->num_used = 0;
+
+	for (i = 0; i < num_slots; i++)
+		idx->slots[i].entry = -1;
+
+	for (i = 0; i < old_num_slots; i++) {
+		if (old_slots[i].entry < 0)
+			continue;
+
+		j = __dir_index_slot(idx, old_slots[i].name_hash);
+		while (idx->slots[j].entry != -1)
+			j = (j + 1) & (num_slots - 1);
+
+		idx->slots[j] = old_slots[i];
+		idx->num_used++;
+	}
+
+	if (old_slots)
+		vfree(old_slots);
+
+	return FFS_SUCCESS;
+} /* end of __dir_index_resize */
+
+static s32 __dir_index_insert(DIR_INDEX_T *idx, u16 name_hash, s32 entry)
+{
+	u32 i;
+
+	if (DIR_INDEX_FULL(idx)) {
+		if (__dir_index_resize(idx, idx->num_slots << 1) != FFS_SUCCESS)
+			return FFS_MEMORYERR;
+	}
+
+	i = __dir_index_slot(idx, name_hash);
+	while (idx->slots[i].entry >= 0)
+		i = (i + 1) & (idx->num_slots - 1);
+
+	if (idx->slots[i].entry == -1)
+		idx->num_used++;
+
+	idx->slots[i].name_hash = name_hash;
+	idx->slots[i].entry = entry;
+
+	return FFS_SUCCESS;
+} /* end of __dir_index_insert */
+
+static void __dir_index_remove(DIR_INDEX_T *idx, u16 name_hash, s32 entry)
+{
+	u32 i;
+
+	i = __dir_index_slot(idx, name_hash);
+	while (idx->slots[i].entry != -1) {
+		if ((idx->slots[i].entry == entry) && (idx->slots[i].name_hash == name_hash)) {
+			idx->slots[i].entry = -2;
+			return;
+		}
+		i = (i + 1) & (idx->num_slots - 1);
+	}
+} /* end of __dir_index_remove */
+
+static DIR_INDEX_T *__dir_index_find(struct super_block *sb, u32 dir)
+{
+	DIR_INDEX_T *idx, *prev = NULL;
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+
+	for (idx = p_fs->dir_index_list; idx != NULL; prev = idx, idx = idx->next) {
+		if (idx->dir != dir)
+			continue;
+
+		/* move to MRU */
+		if (prev != NULL) {
+			prev->next = idx->next;
+			idx->next = p_fs->dir_index_list;
+			p_fs->dir_index_list = idx;
+		}
+		return idx;
+	}
+
+	return NULL;
+} /* end of __dir_index_find */
+
+/* scan the whole directory once and index every file entry set
+   by the name hash in its stream entry */
+static DIR_INDEX_T *__dir_index_build(struct super_block *sb, CHAIN_T *p_dir)
+{
+	s32 i, n, dentry = 0, file_dentry = -1, ra_entry;
+	u32 entry_type;
+	CHAIN_T clu;
+	DENTRY_T *ep;
+	DIR_INDEX_T *idx, *old_idx, **pp;
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+
+	idx = (DIR_INDEX_T *) kmalloc(sizeof(DIR_INDEX_T), GFP_NOFS);
+	if (idx == NULL)
+		return NULL;
+
+	idx->dir = p_dir->dir;
+	idx->num_slots = 0;
+	idx->num_used = 0;
+	idx->slots = NULL;
+
+	/* the table grows as entries are found */
+	if (__dir_index_resize(idx, 256) != FFS_SUCCESS)
+		goto err_out;
+
+	clu.dir = p_dir->dir;
+	clu.size = p_dir->size;
+	clu.flags = p_dir->flags;
+
+	while (clu.dir != CLUSTER_32(~0)) {
+		if (p_fs->dev_ejected)
+			goto err_out;
+
+		for (i = 0, ra_entry = 0; i < p_fs->dentries_per_clu; i++, dentry++) {
+			if (i >= ra_entry)
+				ra_entry = dir_readahead(sb, &clu, i);
+
+			ep = get_entry_in_dir(sb, &clu, i, NULL);
+			if (!ep)
+				goto err_out;
+
+			entry_type = p_fs->fs_func->get_entry_type(ep);
+
+			if (entry_type == TYPE_UNUSED)
+				goto out;
+
+			if ((entry_type == TYPE_STREAM) && (file_dentry == dentry - 1)) {
+				if (__dir_index_insert(idx, GET16_A(((STRM_DENTRY_T *) ep)->name_hash),
+							file_dentry) != FFS_SUCCESS)
+					goto err_out;
+			}
+
+			if ((entry_type == TYPE_FILE) || (entry_type == TYPE_DIR))
+				file_dentry = dentry;
+		}
+
+		if (clu.flags == 0x03) {
+			if ((--clu.size) > 0)
+				clu.dir++;
+			else
+				clu.dir = CLUSTER_32(~0);
+		} else {
+			if (FAT_read(sb, clu.dir, &(clu.dir)) != 0)
+				goto err_out;
+		}
+	}
+
+out:
+	/* drop the least recently used indexes if there are too many */
+	for (n = 1, pp = &(p_fs->dir_index_list); *pp != NULL; n++) {
+		if (n >= DIR_INDEX_MAX_DIRS) {
+			old_idx = *pp;
+			*pp = old_idx->next;
+			__dir_index_free(old_idx);
+			continue;
+		}
+		pp = &((*pp)->next);
+	}
+
+	idx->next = p_fs->dir_index_list;
+	p_fs->dir_index_list = idx;
+
+	return idx;
+
+err_out:
+	__dir_index_free(idx);
+	return NULL;
+} /* end of __dir_index_build */
+
+/* compare the name of the entry set at the given dentry (which has
+   the right name hash) with the given name */
+static s32 __dir_index_match(struct super_block *sb, CHAIN_T *p_dir, s32 entry,
+							 UNI_NAME_T *p_uniname, u32 type)
+{
+	s32 order, len, num_ext_entries;
+	u32 entry_type;
+	u16 entry_uniname[16], *uniname;
+	DENTRY_T *ep;
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+
+	uniname = p_fs->vol_upname;
+
+	ep = get_entry_in_dir(sb, p_dir, entry, NULL);
+	if (!ep)
+		return FALSE;
+
+	entry_type = p_fs->fs_func->get_entry_type(ep);
+	if ((entry_type != TYPE_FILE) && (entry_type != TYPE_DIR))
+		return FALSE;
+	if ((type != TYPE_ALL) && (type != entry_type))
+		return FALSE;
+
+	num_ext_entries = ((FILE_DENTRY_T *) ep)->num_ext;
+
+	ep = get_entry_in_dir(sb, p_dir, entry+1, NULL);
+	if (!ep || (p_fs->fs_func->get_entry_type(ep) != TYPE_STREAM))
+		return FALSE;
+
+	if ((p_uniname->name_hash != GET16_A(((STRM_DENTRY_T *) ep)->name_hash)) ||
+		(p_uniname->name_len != ((STRM_DENTRY_T *) ep)->name_len))
+		return FALSE;
+
+	for (order = 2; order <= num_ext_entries; order++) {
+		ep = get_entry_in_dir(sb, p_dir, entry+order, NULL);
+		if (!ep || (p_fs->fs_func->get_entry_type(ep) != TYPE_EXTEND))
+			return FALSE;
+
+		len = extract_uni_name_from_name_entry((NAME_DENTRY_T *) ep, entry_uniname, order);
+
+		if (nls_upname_cmp(sb, uniname, entry_uniname, len))
+			return FALSE;
+
+		uniname += 15;
+	}
+
+	return (order > 2) ? TRUE : FALSE;
+} /* end of __dir_index_match */
+
+/* look up a name through the index of the directory, building the index
+   first if the directory is large enough.  return FFS_SUCCESS with
+   *dentry set (-2 if the name does not exist), or FFS_ERROR if the
+   directory is not indexed and must be scanned */
+s32 dir_index_lookup(struct super_block *sb, CHAIN_T *p_dir, UNI_NAME_T *p_uniname, u32 type, s32 *dentry)
+{
+	u32 i;
+	DIR_INDEX_T *idx;
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+
+	if (p_fs->vol_type != EXFAT)
+		return FFS_ERROR;
+
+	idx = __dir_index_find(sb, p_dir->dir);
+	if (idx == NULL) {
+		if (((u32) p_dir->size * p_fs->dentries_per_clu) < DIR_INDEX_MIN_ENTRIES)
+			return FFS_ERROR;
+
+		idx = __dir_index_build(sb, p_dir);
+		if (idx == NULL)
+			return FFS_ERROR;
+	}
+
+	i = __dir_index_slot(idx, p_uniname->name_hash);
+	while (idx->slots[i].entry != -1) {
+		if ((idx->slots[i].entry >= 0) &&
+			(idx->slots[i].name_hash == p_uniname->name_hash) &&
+			__dir_index_match(sb, p_dir, idx->slots[i].entry, p_uniname, type)) {
+			*dentry = idx->slots[i].entry;
+			return FFS_SUCCESS;
+		}
+		i = (i + 1) & (idx->num_slots - 1);
+	}
+
+	*dentry = -2;
+	return FFS_SUCCESS;
+} /* end of dir_index_lookup */
+
+void dir_index_add_entry(struct super_block *sb, CHAIN_T *p_dir, u16 name_hash, s32 entry)
+{
+	DIR_INDEX_T *idx;
+
+	idx = __dir_index_find(sb, p_dir->dir);
+	if (idx == NULL)
+		return;
+
+	/* an index which missed an entry is worse than none */
+	if (__dir_index_insert(idx, name_hash, entry) != FFS_SUCCESS)
+		dir_index_drop(sb, p_dir->dir);
+} /* end of dir_index_add_entry */
+
+void dir_index_del_entry(struct super_block *sb, CHAIN_T *p_dir, u16 name_hash, s32 entry)
+{
+	DIR_INDEX_T *idx;
+
+	idx = __dir_index_find(sb, p_dir->dir);
+	if (idx == NULL)
+		return;
+
+	__dir_index_remove(idx, name_hash, entry);
+} /* end of dir_index_del_entry */
+
+void dir_index_drop(struct super_block *sb, u32 dir)
+{
+	DIR_INDEX_T *idx;
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+
+	idx = __dir_index_find(sb, dir);
+	if (idx == NULL)
+		return;
+
+	/* __dir_index_find() moved it to the head */
+	p_fs->dir_index_list = idx->next;
+	__dir_index_free(idx);
+} /* end of dir_index_drop */
+
+void dir_index_release_all(struct super_block *sb)
+{
+	DIR_INDEX_T *idx;
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+
+	while (p_fs->dir_index_list != NULL) {
+		idx = p_fs->dir_index_list;
+		p_fs->dir_index_list = idx->next;
+		__dir_index_free(idx);
+	}
+} /* end of dir_index_release_all */
+
 /*
  *  Name Conversion Functions
  */
@@ -4416,18 +5693,60 @@ u16 calc_checksum_2byte(void *data, s32 len, u16 chksum, s32 type)
 		for (i = 0; i < len; i++, c++) {
 			if ((i == 2) || (i == 3))
 				continue;
-			chksum = (((chksum & 1) << 15) | ((chksum & 0xFFFE) >> 1)) + (u16) *c;
+			chksum = chksum_2byte_add(chksum, *c);
 		}
 		break;
 	default
 			:
 		for (i = 0; i < len; i++, c++)
-			chksum = (((chksum & 1) << 15) | ((chksum & 0xFFFE) >> 1)) + (u16) *c;
+			chksum = chksum_2byte_add(chksum, *c);
 	}
 
 	return chksum;
 } /* end of calc_checksum_2byte */
 
+static inline u16 __chksum_2byte_add_word(u16 chksum, u32 w)
+{
+	chksum = chksum_2byte_add(chksum, (u8) w);
+	chksum = chksum_2byte_add(chksum, (u8) (w >> 8));
+	chksum = chksum_2byte_add(chksum, (u8) (w >> 16));
+	return chksum_2byte_add(chksum, (u8) (w >> 24));
+}
+
+/* same as calc_checksum_2byte() over one directory entry, but reading
+   the (4-byte aligned) entry a word at a time without per-byte tests */
+u16 calc_dentry_checksum(DENTRY_T *ep, u16 chksum, s32 type)
+{
+	int i;
+	u8 *c = (u8 *) ep;
+
+	if (type == CS_DIR_ENTRY) {
+		/* bytes 2 and 3 hold the checksum itself */
+		chksum = chksum_2byte_add(chksum, c[0]);
+		chksum = chksum_2byte_add(chksum, c[1]);
+	} else {
+		chksum = __chksum_2byte_add_word(chksum, GET32_A(c));
+	}
+
+	for (i = 4; i < DENTRY_SIZE; i += 4)
+		chksum = __chksum_2byte_add_word(chksum, GET32_A(c + i));
+
+	return chksum;
+} /* end of calc_dentry_checksum */
+
+/* checksum of a whole entry set, starting with its file entry */
+u16 calc_entry_set_checksum(DENTRY_T *ep, s32 num_entries)
+{
+	s32 i;
+	u16 chksum;
+
+	chksum = calc_dentry_checksum(ep, 0, CS_DIR_ENTRY);
+	for (i = 1; i < num_entries; i++)
+		chksum = calc_dentry_checksum(ep + i, chksum, CS_DEFAULT);
+
+	return chksum;
+} /* end of calc_entry_set_checksum */
+
 u32 calc_checksum_4byte(void *data, s32 len, u32 chksum, s32 type)
 {
 	int i;
@@ -5114,6 +6433,19 @@ s32 multi_sector_read(struct super_block *sb, sector_t sec, struct buffer_head *
 	return ret;
 } /* end of multi_sector_read */
 
+s32 sector_readahead(struct super_block *sb, sector_t sec, s32 num_secs)
+{
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+
+	if ((sec+num_secs) > (p_fs->PBR_sector+p_fs->num_sectors) && (p_fs->num_sectors > 0))
+		num_secs = (s32)(p_fs->PBR_sector + p_fs->num_sectors - sec);
+
+	if ((num_secs <= 0) || p_fs->dev_ejected)
+		return FFS_MEDIAERR;
+
+	return bdev_readahead(sb, sec, num_secs);
+} /* end of sector_readahead */
+
 s32 multi_sector_write(struct super_block *sb, sector_t sec, struct buffer_head *bh, s32 num_secs, s32 sync)
 {
 	s32 ret = FFS_MEDIAERR;
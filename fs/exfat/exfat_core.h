@@ -188,11 +188,7 @@
 #endif
 
 /* Upcase tabel mecro */
-#define HIGH_INDEX_BIT (8)
-#define HIGH_INDEX_MASK (0xFF00)
-#define LOW_INDEX_BIT (16-HIGH_INDEX_BIT)
-#define UTBL_ROW_COUNT (1<<LOW_INDEX_BIT)
-#define UTBL_COL_COUNT (1<<HIGH_INDEX_BIT)
+#define UTBL_COUNT     (0x10000)
 
 #if CONFIG_EXFAT_DEBUG_MSG
 #define DPRINTK(...)			\
@@ -203,14 +199,19 @@
 #define DPRINTK(...)
 #endif
 
-static inline u16 get_col_index(u16 i)
+/* fold one byte into a 2-byte checksum (entry sets and name hashes) */
+static inline u16 chksum_2byte_add(u16 chksum, u8 c)
 {
-	return i >> LOW_INDEX_BIT;
+	return (u16) (((chksum << 15) | (chksum >> 1)) + c);
 }
-static inline u16 get_row_index(u16 i)
+
+/* fold one UTF-16 code unit, in on-disk byte order */
+static inline u16 chksum_2byte_add_char(u16 chksum, u16 uni)
 {
-	return i & ~HIGH_INDEX_MASK;
+	chksum = chksum_2byte_add(chksum, (u8) uni);
+	return chksum_2byte_add(chksum, (u8) (uni >> 8));
 }
+
 /*----------------------------------------------------------------------*/
 /*  Type Definitions                                                    */
 /*----------------------------------------------------------------------*/
@@ -415,6 +416,65 @@ typedef struct {
 	CHAIN_T     clu;
 } UENTRY_T;
 
+/* directory entry index (name hash -> file dentry) */
+typedef struct {
+	u16      name_hash;
+	s32       entry;                  /* -1 : empty, -2 : deleted */
+} DIR_INDEX_SLOT_T;
+
+typedef struct __DIR_INDEX_T {
+	struct __DIR_INDEX_T *next;
+	u32      dir;                    /* start cluster of the directory */
+	u32      num_slots;              /* power of 2 */
+	u32      num_used;               /* num of live and deleted slots */
+	DIR_INDEX_SLOT_T *slots;
+} DIR_INDEX_T;
+
+/* allocation bitmap summary (per bitmap sector) */
+typedef struct {
+	u16      free;                   /* num of free clusters */
+	u16      max_run;                /* upper bound of the longest free run */
+} AMAP_SUM_T;
+
+/* per volume activity counters (approximate, not locked) */
+typedef struct {
+	unsigned long fat_reads;         /* FAT entries read */
+	unsigned long fat_writes;        /* FAT entries written */
+	unsigned long alloc_calls;       /* exfat_alloc_cluster() calls */
+	unsigned long alloc_clusters;    /* clusters they allocated */
+	unsigned long alloc_distance;    /* clusters skipped from the hints */
+	unsigned long chain_walks;       /* FAT links followed by ffsMapCluster() */
+	unsigned long bdev_reads;        /* bdev_read() requests */
+	unsigned long bdev_read_secs;    /* sectors they covered */
+	unsigned long bdev_writes;       /* bdev_write() requests */
+	unsigned long bdev_write_secs;   /* sectors they covered */
+} FS_STATS_T;
+
+/* summary not computed yet (both fields), see load_alloc_bitmap() */
+#define AMAP_SUM_UNKNOWN         0xFFFF
+
+/* run of freed clusters waiting to be discarded */
+typedef struct {
+	u32      clu;                    /* first cluster */
+	u32      len;                    /* num of clusters */
+} DISCARD_EXTENT_T;
+
+/* extent cache information (file cluster offset -> disk cluster run) */
+typedef struct {
+	u32      fclu;                   /* cluster offset in the file */
+	u32      dclu;                   /* cluster number on the volume */
+	u32      len;                    /* num of contiguous clusters */
+	u32      age;                    /* last access stamp */
+} EXTENT_T;
+
+typedef struct {
+	spinlock_t  lock;       /* taken inside extent_cache_*() so that
+				   cached mappings can be read without v_sem */
+	s32       num_extents;
+	u32      tick;
+	EXTENT_T    extents[EXTENT_CACHE_SIZE]; /* sorted by fclu */
+} EXTENT_CACHE_T;
+
 typedef struct {
 	s32       (*alloc_cluster)(struct super_block *sb, s32 num_alloc, CHAIN_T *p_chain);
 	void        (*free_cluster)(struct super_block *sb, CHAIN_T *p_chain, s32 do_relse);
@@ -473,12 +533,19 @@ typedef struct __FS_INFO_T {
 	u32      map_clu;                /* allocation bitmap start cluster */
 	u32      map_sectors;            /* num of allocation bitmap sectors */
 	struct buffer_head **vol_amap;      /* allocation bitmap */
+	AMAP_SUM_T  *amap_sum;              /* allocation bitmap summary */
 
-	u16      **vol_utbl;               /* upcase table */
+	u16      *vol_utbl;                /* upcase table (flat, one entry per code unit) */
+	u16      *vol_upname;              /* upcased name of the current lookup */
 
 	u32      clu_srch_ptr;           /* cluster search pointer */
 	u32      used_clusters;          /* number of used clusters */
 	UENTRY_T    hint_uentry;         /* unused entry hint information */
+	DIR_INDEX_T *dir_index_list;     /* indexed directories (MRU first) */
+#ifdef CONFIG_EXFAT_DISCARD
+	DISCARD_EXTENT_T *discard_list;  /* freed runs waiting for discard */
+	s32      discard_count;          /* num of queued runs */
+#endif /* CONFIG_EXFAT_DISCARD */
 
 	u32      dev_ejected;            /* block device operation error flag */
 
@@ -486,14 +553,13 @@ typedef struct __FS_INFO_T {
 	struct semaphore v_sem;
 
 	/* FAT cache */
-	BUF_CACHE_T FAT_cache_array[FAT_CACHE_SIZE];
-	BUF_CACHE_T FAT_cache_lru_list;
-	BUF_CACHE_T FAT_cache_hash_list[FAT_CACHE_HASH_SIZE];
+	BUF_CACHE_POOL_T FAT_cache;
 
 	/* buf cache */
-	BUF_CACHE_T buf_cache_array[BUF_CACHE_SIZE];
-	BUF_CACHE_T buf_cache_lru_list;
-	BUF_CACHE_T buf_cache_hash_list[BUF_CACHE_HASH_SIZE];
+	BUF_CACHE_POOL_T buf_cache;
+
+	/* activity counters, see /sys/fs/exfat/<dev>/ */
+	FS_STATS_T stats;
 } FS_INFO_T;
 
 #define ES_2_ENTRIES		2
@@ -505,6 +571,7 @@ typedef struct {
 	s32	offset;		/* byte offset in the sector */
 	s32	alloc_flag;	/* flag in stream entry. 01 for cluster chain, 03 for contig. clusteres. */
 	u32 num_entries;
+	s32	dirty;		/* changed since written back (inode cached sets) */
 
 	/* __buf should be the last member */
 	void *__buf;
@@ -536,7 +603,14 @@ s32 ffsRemoveFile(struct inode *inode, FILE_ID_T *fid);
 s32 ffsSetAttr(struct inode *inode, u32 attr);
 s32 ffsGetStat(struct inode *inode, DIR_ENTRY_T *info);
 s32 ffsSetStat(struct inode *inode, DIR_ENTRY_T *info);
-s32 ffsMapCluster(struct inode *inode, s32 clu_offset, u32 *clu);
+s32 ffsMapCluster(struct inode *inode, s32 clu_offset, u32 *clu, u32 *clu_count);
+s32 ffsReleasePrealloc(struct inode *inode);
+s32 ffsReserveClusters(struct inode *inode, s32 num_wanted);
+s32 ffsReleaseEntrySet(struct inode *inode, s32 do_write);
+#ifdef CONFIG_EXFAT_DISCARD
+s32 ffsDiscardPending(struct super_block *sb, s32 max_extents);
+s32 ffsTrimVol(struct super_block *sb, u32 clu, u32 num_clusters, u32 minlen, u32 *trimmed);
+#endif /* CONFIG_EXFAT_DISCARD */
 
 /* directory management functions */
 s32 ffsCreateDir(struct inode *inode, char *path, FILE_ID_T *fid);
@@ -566,13 +640,24 @@ s32  fat_count_used_clusters(struct super_block *sb);
 s32  exfat_count_used_clusters(struct super_block *sb);
 void   exfat_chain_cont_cluster(struct super_block *sb, u32 chain, s32 len);
 
+/* extent cache management functions */
+void   extent_cache_init(EXTENT_CACHE_T *ec);
+s32  extent_cache_lookup(EXTENT_CACHE_T *ec, u32 fclu, u32 *start_fclu, u32 *start_dclu);
+void   extent_cache_add(EXTENT_CACHE_T *ec, u32 fclu, u32 dclu, u32 len);
+void   extent_cache_inval(EXTENT_CACHE_T *ec, u32 fclu);
+
 /* allocation bitmap management functions */
 s32  load_alloc_bitmap(struct super_block *sb);
 void   free_alloc_bitmap(struct super_block *sb);
 s32   set_alloc_bitmap(struct super_block *sb, u32 clu);
 s32   clr_alloc_bitmap(struct super_block *sb, u32 clu);
 u32 test_alloc_bitmap(struct super_block *sb, u32 clu);
+u32 test_alloc_bitmap_run(struct super_block *sb, u32 clu, u32 num_alloc, u32 *run_len);
+void   calc_alloc_bitmap_sum(struct super_block *sb, s32 map_i);
 void   sync_alloc_bitmap(struct super_block *sb);
+#ifdef CONFIG_EXFAT_DISCARD
+void   discard_add_range(struct super_block *sb, u32 clu, u32 len);
+#endif /* CONFIG_EXFAT_DISCARD */
 
 /* upcase table management functions */
 s32  load_upcase_table(struct super_block *sb);
@@ -615,11 +700,21 @@ void   init_name_entry(NAME_DENTRY_T *ep, u16 *uniname);
 void   fat_delete_dir_entry(struct super_block *sb, CHAIN_T *p_dir, s32 entry, s32 order, s32 num_entries);
 void   exfat_delete_dir_entry(struct super_block *sb, CHAIN_T *p_dir, s32 entry, s32 order, s32 num_entries);
 
+/* directory entry index functions */
+s32  dir_index_lookup(struct super_block *sb, CHAIN_T *p_dir, UNI_NAME_T *p_uniname, u32 type, s32 *dentry);
+void   dir_index_add_entry(struct super_block *sb, CHAIN_T *p_dir, u16 name_hash, s32 entry);
+void   dir_index_del_entry(struct super_block *sb, CHAIN_T *p_dir, u16 name_hash, s32 entry);
+void   dir_index_drop(struct super_block *sb, u32 dir);
+void   dir_index_release_all(struct super_block *sb);
+
 s32   find_location(struct super_block *sb, CHAIN_T *p_dir, s32 entry, sector_t *sector, s32 *offset);
 DENTRY_T *get_entry_with_sector(struct super_block *sb, sector_t sector, s32 offset);
 DENTRY_T *get_entry_in_dir(struct super_block *sb, CHAIN_T *p_dir, s32 entry, sector_t *sector);
+s32  dir_readahead(struct super_block *sb, CHAIN_T *p_clu, s32 entry);
 ENTRY_SET_CACHE_T *get_entry_set_in_dir(struct super_block *sb, CHAIN_T *p_dir, s32 entry, u32 type, DENTRY_T **file_ep);
 void release_entry_set(ENTRY_SET_CACHE_T *es);
+ENTRY_SET_CACHE_T *get_inode_entry_set(struct inode *inode, DENTRY_T **file_ep);
+void sync_inode_entry_set(struct inode *inode);
 s32 write_whole_entry_set(struct super_block *sb, ENTRY_SET_CACHE_T *es);
 s32 write_partial_entries_in_entry_set(struct super_block *sb, ENTRY_SET_CACHE_T *es, DENTRY_T *ep, u32 count);
 s32  search_deleted_or_unused_entry(struct super_block *sb, CHAIN_T *p_dir, s32 num_entries);
@@ -646,6 +741,8 @@ s32  fat_calc_num_entries(UNI_NAME_T *p_uniname);
 s32  exfat_calc_num_entries(UNI_NAME_T *p_uniname);
 u8  calc_checksum_1byte(void *data, s32 len, u8 chksum);
 u16 calc_checksum_2byte(void *data, s32 len, u16 chksum, s32 type);
+u16 calc_dentry_checksum(DENTRY_T *ep, u16 chksum, s32 type);
+u16 calc_entry_set_checksum(DENTRY_T *ep, s32 num_entries);
 u32 calc_checksum_4byte(void *data, s32 len, u32 chksum, s32 type);
 
 /* name resolution functions */
@@ -666,6 +763,7 @@ s32  move_file(struct inode *inode, CHAIN_T *p_olddir, s32 oldentry, CHAIN_T *p_
 s32   sector_read(struct super_block *sb, sector_t sec, struct buffer_head **bh, s32 read);
 s32   sector_write(struct super_block *sb, sector_t sec, struct buffer_head *bh, s32 sync);
 s32   multi_sector_read(struct super_block *sb, sector_t sec, struct buffer_head **bh, s32 num_secs, s32 read);
+s32   sector_readahead(struct super_block *sb, sector_t sec, s32 num_secs);
 s32   multi_sector_write(struct super_block *sb, sector_t sec, struct buffer_head *bh, s32 num_secs, s32 sync);
 
 #endif /* _EXFAT_H */
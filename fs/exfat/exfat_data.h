@@ -49,10 +49,49 @@
 #define MAX_DENTRY              512
 
 /* cache size (in number of sectors)                */
-/* (should be an exponential value of 2)            */
+/* buf cache gets one sector per 2^BUF_CACHE_SHIFT  */
+/* bytes of volume, clamped to [BUF_CACHE_SIZE,     */
+/* BUF_CACHE_MAX_SIZE] unless set by -o cache_size; */
+/* FAT cache is half of it, at least FAT_CACHE_SIZE */
 #define FAT_CACHE_SIZE          128
-#define FAT_CACHE_HASH_SIZE     64
 #define BUF_CACHE_SIZE          256
-#define BUF_CACHE_HASH_SIZE     64
+#define BUF_CACHE_MIN_SIZE      32
+#define BUF_CACHE_MAX_SIZE      4096
+#define BUF_CACHE_SHIFT         24
+
+/* directory readahead window (in number of sectors) */
+/* (should be an exponential value of 2)            */
+#define DIR_RA_SECTORS          64
+
+/* allocation bitmap sectors read ahead per request */
+/* at mount                                         */
+#define BITMAP_RA_SECTORS       256
+
+/* size of a cluster batch preallocated for an     */
+/* appending writer with -o prealloc (1MB)          */
+#define PREALLOC_SIZE_BITS      20
+
+/* freed cluster runs queued for discard per volume */
+/* (-o discard), the delay before the worker issues */
+/* them, and the runs issued per hold of the volume */
+/* lock; FITRIM scans TRIM_MAP_SECTORS bitmap       */
+/* sectors per hold of the lock                     */
+#define DISCARD_MAX_EXTENTS     256
+#define DISCARD_DELAY_MS        1000
+#define DISCARD_BATCH_EXTENTS   16
+#define TRIM_MAP_SECTORS        16
+
+/* delay after the volume gets dirty before its    */
+/* metadata is written back and it is marked clean  */
+#define FLUSH_DELAY_MS          5000
+
+/* max number of cached extents per inode          */
+#define EXTENT_CACHE_SIZE       8
+
+/* directory entry index: min num of dentries in a  */
+/* directory to build an index, and max num of      */
+/* directories indexed at a time per volume         */
+#define DIR_INDEX_MIN_ENTRIES   1024
+#define DIR_INDEX_MAX_DIRS      4
 
 #endif /* _EXFAT_DATA_H */
@@ -79,12 +79,9 @@ u16 nls_upper(struct super_block *sb, u16 a)
 {
 	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
 
-	if (EXFAT_SB(sb)->options.casesensitive)
-		return a;
-	if (p_fs->vol_utbl != NULL && (p_fs->vol_utbl)[get_col_index(a)] != NULL)
-		return (p_fs->vol_utbl)[get_col_index(a)][get_row_index(a)];
-	else
+	if (EXFAT_SB(sb)->options.casesensitive || (p_fs->vol_utbl == NULL))
 		return a;
+	return p_fs->vol_utbl[a];
 }
 
 u16 *nls_wstrchr(u16 *str, u16 wchar)
@@ -107,7 +104,8 @@ s32 nls_uniname_cmp(struct super_block *sb, u16 *a, u16 *b)
 	int i;
 
 	for (i = 0; i < MAX_NAME_LENGTH; i++, a++, b++) {
-		if (nls_upper(sb, *a) != nls_upper(sb, *b))
+		/* names mostly differ in case only, if at all */
+		if ((*a != *b) && (nls_upper(sb, *a) != nls_upper(sb, *b)))
 			return 1;
 		if (*a == 0x0)
 			return 0;
@@ -115,6 +113,30 @@ s32 nls_uniname_cmp(struct super_block *sb, u16 *a, u16 *b)
 	return 0;
 } /* end of nls_uniname_cmp */
 
+/* compare len characters of an upcased name (see nls_uniname_to_upname) with b */
+s32 nls_upname_cmp(struct super_block *sb, u16 *upname, u16 *b, s32 len)
+{
+	int i;
+
+	for (i = 0; i < len; i++) {
+		if ((upname[i] != b[i]) && (upname[i] != nls_upper(sb, b[i])))
+			return 1;
+	}
+	return 0;
+} /* end of nls_upname_cmp */
+
+/* upcase the name of p_uniname into upname (MAX_NAME_LENGTH entries) */
+void nls_uniname_to_upname(struct super_block *sb, u16 *upname, UNI_NAME_T *p_uniname)
+{
+	int i;
+
+	for (i = 0; i < p_uniname->name_len; i++)
+		upname[i] = nls_upper(sb, p_uniname->name[i]);
+
+	if (i < MAX_NAME_LENGTH)
+		upname[i] = (u16) '\0';
+} /* end of nls_uniname_to_upname */
+
 void nls_uniname_to_dosname(struct super_block *sb, DOS_NAME_T *p_dosname, UNI_NAME_T *p_uniname, s32 *p_lossy)
 {
 	int i, j, len, lossy = FALSE;
@@ -330,7 +352,7 @@ void nls_cstring_to_uniname(struct super_block *sb, UNI_NAME_T *p_uniname, u8 *p
 {
 	int i, j, lossy = FALSE;
 	u8 *end_of_name;
-	u8 upname[MAX_NAME_LENGTH * 2];
+	u16 chksum = 0;
 	u16 *uniname = p_uniname->name;
 	struct nls_table *nls = EXFAT_SB(sb)->nls_io;
 
@@ -364,8 +386,9 @@ void nls_cstring_to_uniname(struct super_block *sb, UNI_NAME_T *p_uniname, u8 *p
 		i = utf8s_to_utf16s(p_cstring, MAX_NAME_LENGTH * MAX_CHARSET_SIZE,
 			UTF16_HOST_ENDIAN, uniname, MAX_NAME_LENGTH);
 #endif
-		for (j = 0; j < i; j++)
-			SET16_A(upname + j * 2, nls_upper(sb, uniname[j]));
+		for (j = 0; j < i; j++) {
+			chksum = chksum_2byte_add_char(chksum, nls_upper(sb, uniname[j]));
+		}
 
 		if (i >= 0 && i < MAX_NAME_LENGTH)
 			uniname[i] = '\0';
@@ -383,7 +406,7 @@ void nls_cstring_to_uniname(struct super_block *sb, UNI_NAME_T *p_uniname, u8 *p
 			if ((*uniname < 0x0020) || nls_wstrchr(bad_uni_chars, *uniname))
 				lossy = TRUE;
 
-			SET16_A(upname + j * 2, nls_upper(sb, *uniname));
+			chksum = chksum_2byte_add_char(chksum, nls_upper(sb, *uniname));
 
 			uniname++;
 			j++;
@@ -395,7 +418,7 @@ void nls_cstring_to_uniname(struct super_block *sb, UNI_NAME_T *p_uniname, u8 *p
 	}
 
 	p_uniname->name_len = j;
-	p_uniname->name_hash = calc_checksum_2byte((void *) upname, j<<1, 0, CS_DEFAULT);
+	p_uniname->name_hash = chksum;
 
 	if (p_lossy != NULL)
 		*p_lossy = lossy;
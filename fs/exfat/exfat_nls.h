@@ -83,6 +83,8 @@ typedef struct {
 u16 nls_upper(struct super_block *sb, u16 a);
 s32  nls_dosname_cmp(struct super_block *sb, u8 *a, u8 *b);
 s32  nls_uniname_cmp(struct super_block *sb, u16 *a, u16 *b);
+s32  nls_upname_cmp(struct super_block *sb, u16 *upname, u16 *b, s32 len);
+void   nls_uniname_to_upname(struct super_block *sb, u16 *upname, UNI_NAME_T *p_uniname);
 void   nls_uniname_to_dosname(struct super_block *sb, DOS_NAME_T *p_dosname, UNI_NAME_T *p_uniname, s32 *p_lossy);
 void   nls_dosname_to_uniname(struct super_block *sb, UNI_NAME_T *p_uniname, DOS_NAME_T *p_dosname);
 void   nls_uniname_to_cstring(struct super_block *sb, u8 *p_cstring, UNI_NAME_T *p_uniname);
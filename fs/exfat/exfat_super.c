@@ -73,6 +73,11 @@
 #include <linux/fs_struct.h>
 #include <linux/namei.h>
 #include <linux/genhd.h>
+#include <linux/blkdev.h>
+#include <linux/uaccess.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,38)
+#include <linux/falloc.h>
+#endif
 #include <asm/current.h>
 #include <asm/unaligned.h>
 
@@ -89,6 +94,9 @@
 
 #include "exfat_super.h"
 
+#define CREATE_TRACE_POINTS
+#include "exfat_trace.h"
+
 static struct kmem_cache *exfat_inode_cachep;
 
 static int exfat_default_codepage = CONFIG_EXFAT_DEFAULT_CODEPAGE;
@@ -132,6 +140,8 @@ static time_t accum_days_in_year[] = {
 };
 
 static void _exfat_truncate(struct inode *inode, loff_t old_size);
+static void exfat_sysfs_unregister(struct super_block *sb);
+static void exfat_write_super(struct super_block *sb);
 
 static void exfat_sbi_uevent_work(struct work_struct *work)
 {
@@ -141,6 +151,35 @@ static void exfat_sbi_uevent_work(struct work_struct *work)
 	kobject_uevent(&disk_to_dev(sbi->sb->s_bdev->bd_disk)->kobj, KOBJ_CHANGE);
 }
 
+static void exfat_flush_work(struct work_struct *work)
+{
+	struct exfat_sb_info *sbi = container_of(to_delayed_work(work),
+						 struct exfat_sb_info, flush_work);
+
+	if (!exfat_readonly(sbi->sb))
+		exfat_write_super(sbi->sb);
+}
+
+static void exfat_count_work(struct work_struct *work)
+{
+	struct exfat_sb_info *sbi = container_of(work, struct exfat_sb_info,
+						 count_work);
+	VOL_INFO_T info;
+
+	/* fills in the used cluster count left unknown by the mount */
+	FsGetVolInfo(sbi->sb, &info);
+}
+
+#ifdef CONFIG_EXFAT_DISCARD
+static void exfat_discard_work(struct work_struct *work)
+{
+	struct exfat_sb_info *sbi = container_of(to_delayed_work(work),
+						 struct exfat_sb_info, discard_work);
+
+	FsDiscardPending(sbi->sb);
+}
+#endif /* CONFIG_EXFAT_DISCARD */
+
 /* Convert a FAT time/date pair to a UNIX date (seconds since 1 1 70). */
 void exfat_time_fat2unix(struct exfat_sb_info *sbi, struct timespec *ts,
 						 DATE_TIME_T *tp)
@@ -228,6 +267,7 @@ static long exfat_generic_ioctl(struct file *filp, unsigned int cmd, unsigned lo
 #endif
 static int exfat_sync_inode(struct inode *inode);
 static struct inode *exfat_build_inode(struct super_block *sb, FILE_ID_T *fid, loff_t i_pos);
+static struct inode *exfat_readdir_inode(struct inode *dir, DIR_ENTRY_T *de, loff_t i_pos);
 static void exfat_detach(struct inode *inode);
 static void exfat_attach(struct inode *inode, loff_t i_pos);
 static inline unsigned long exfat_hash(loff_t i_pos);
@@ -236,7 +276,6 @@ static int exfat_write_inode(struct inode *inode, int wait);
 #else
 static int exfat_write_inode(struct inode *inode, struct writeback_control *wbc);
 #endif
-static void exfat_write_super(struct super_block *sb);
 
 static void __lock_super(struct super_block *sb)
 {
@@ -278,9 +317,21 @@ static void __set_sb_clean(struct super_block *sb)
 #endif
 }
 
+/*
+ * A negative dentry stays valid as long as its parent has not changed.
+ * Every operation which adds or renames a name in a directory bumps the
+ * directory's i_version, and lookup stamps the dentry with it in d_time,
+ * so repeated lookups of missing names do not rescan the directory.
+ */
 static int __exfat_revalidate(struct dentry *dentry)
 {
-	return 0;
+	int ret = 1;
+
+	spin_lock(&dentry->d_lock);
+	if (dentry->d_time != dentry->d_parent->d_inode->i_version)
+		ret = 0;
+	spin_unlock(&dentry->d_lock);
+	return ret;
 }
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(3,7,00)
@@ -584,8 +635,16 @@ get_new:
 		loff_t i_pos = ((loff_t) EXFAT_I(inode)->fid.start_clu << 32) |
 					   ((EXFAT_I(inode)->fid.rwoffset-1) & 0xffffffff);
 
-		struct inode *tmp = exfat_iget(sb, i_pos);
-		if (tmp) {
+		struct inode *tmp;
+
+		/* the stat that follows getdents then finds the inode of a
+		   file in the inode cache instead of reading its entry again */
+		if (de.Attr & ATTR_SUBDIR)
+			tmp = exfat_iget(sb, i_pos);
+		else
+			tmp = exfat_readdir_inode(inode, &de, i_pos);
+
+		if (tmp && !IS_ERR(tmp)) {
 			inum = tmp->i_ino;
 			iput(tmp);
 		} else {
@@ -629,6 +688,65 @@ static int exfat_ioctl_volume_id(struct inode *dir)
 	return p_fs->vol_id;
 }
 
+#ifdef CONFIG_EXFAT_DISCARD
+/* FITRIM: the range is a byte range of the cluster heap */
+static int exfat_ioctl_fitrim(struct inode *inode, struct fstrim_range __user *user_range)
+{
+	struct super_block *sb = inode->i_sb;
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+	struct fstrim_range range;
+	u64 heap_size, num_clusters, minlen;
+	u32 clu, trimmed;
+	int err;
+
+	if (!capable(CAP_SYS_ADMIN))
+		return -EPERM;
+
+	if (p_fs->vol_type != EXFAT)
+		return -EOPNOTSUPP;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,19,0)
+	if (!bdev_max_discard_sectors(sb->s_bdev))
+#else
+	if (!blk_queue_discard(bdev_get_queue(sb->s_bdev)))
+#endif
+		return -EOPNOTSUPP;
+
+	if (exfat_readonly(sb))
+		return -EROFS;
+
+	if (copy_from_user(&range, user_range, sizeof(range)))
+		return -EFAULT;
+
+	heap_size = (u64) (p_fs->num_clusters - 2) << p_fs->cluster_size_bits;
+	if ((range.start >= heap_size) || (range.len < p_fs->cluster_size))
+		return -EINVAL;
+
+	clu = (u32) (range.start >> p_fs->cluster_size_bits) + 2;
+	num_clusters = range.len >> p_fs->cluster_size_bits;
+	if (num_clusters > (p_fs->num_clusters - clu))
+		num_clusters = p_fs->num_clusters - clu;
+
+	minlen = (range.minlen + p_fs->cluster_size - 1) >> p_fs->cluster_size_bits;
+	if (minlen == 0)
+		minlen = 1;
+	if (minlen > num_clusters)
+		return -EINVAL;
+
+	err = FsTrimVol(sb, clu, (u32) num_clusters, (u32) minlen, &trimmed);
+	if (err == FFS_MEDIAERR)
+		return -EIO;
+	else if (err)
+		return -EOPNOTSUPP;
+
+	range.len = (u64) trimmed << p_fs->cluster_size_bits;
+	if (copy_to_user(user_range, &range, sizeof(range)))
+		return -EFAULT;
+
+	return 0;
+}
+#endif /* CONFIG_EXFAT_DISCARD */
+
 #if LINUX_VERSION_CODE < KERNEL_VERSION(2,6,36)
 static int exfat_generic_ioctl(struct inode *inode, struct file *filp,
 							   unsigned int cmd, unsigned long arg)
@@ -651,6 +769,10 @@ static long exfat_generic_ioctl(struct file *filp,
 	switch (cmd) {
 	case EXFAT_IOCTL_GET_VOLUME_ID:
 		return exfat_ioctl_volume_id(inode);
+#ifdef CONFIG_EXFAT_DISCARD
+	case FITRIM:
+		return exfat_ioctl_fitrim(inode, (struct fstrim_range __user *) arg);
+#endif /* CONFIG_EXFAT_DISCARD */
 #ifdef CONFIG_EXFAT_KERNEL_DEBUG
 	case EXFAT_IOC_GET_DEBUGFLAGS: {
 		struct super_block *sb = inode->i_sb;
@@ -896,6 +1018,8 @@ static int exfat_unlink(struct inode *dir, struct dentry *dentry)
 	DPRINTK("exfat_unlink entered\n");
 
 	EXFAT_I(inode)->fid.size = i_size_read(inode);
+	FsReleasePrealloc(inode);
+	FsReleaseEntrySet(inode, 1);
 
 	err = FsRemoveFile(dir, &(EXFAT_I(inode)->fid));
 	if (err) {
@@ -914,8 +1038,11 @@ static int exfat_unlink(struct inode *dir, struct dentry *dentry)
 
 	clear_nlink(inode);
 	inode->i_mtime = inode->i_atime = current_time(inode);
+	extent_cache_inval(&(EXFAT_I(inode)->extent_cache), 0);
 	exfat_detach(inode);
 	remove_inode_hash(inode);
+	/* the dentry turns negative and is known to be right */
+	dentry->d_time = dir->i_version;
 
 out:
 	__unlock_super(sb);
@@ -1065,6 +1192,7 @@ static int exfat_rmdir(struct inode *dir, struct dentry *dentry)
 	DPRINTK("exfat_rmdir entered\n");
 
 	EXFAT_I(inode)->fid.size = i_size_read(inode);
+	FsReleaseEntrySet(inode, 1);
 
 	err = FsRemoveDir(dir, &(EXFAT_I(inode)->fid));
 	if (err) {
@@ -1092,6 +1220,7 @@ static int exfat_rmdir(struct inode *dir, struct dentry *dentry)
 	inode->i_mtime = inode->i_atime = current_time(inode);
 	exfat_detach(inode);
 	remove_inode_hash(inode);
+	dentry->d_time = dir->i_version;
 
 out:
 	__unlock_super(sb);
@@ -1126,6 +1255,12 @@ static int exfat_rename(struct inode *old_dir, struct dentry *old_dentry,
 	new_inode = new_dentry->d_inode;
 
 	EXFAT_I(old_inode)->fid.size = i_size_read(old_inode);
+	/* the entries are moved as they are in the buffer cache */
+	FsReleaseEntrySet(old_inode, 1);
+	if (new_inode) {
+		FsReleasePrealloc(new_inode);
+		FsReleaseEntrySet(new_inode, 1);
+	}
 
 	err = FsMoveFile(old_dir, &(EXFAT_I(old_inode)->fid), new_dir, new_dentry);
 	if (err) {
@@ -1174,6 +1309,7 @@ static int exfat_rename(struct inode *old_dir, struct dentry *old_dentry,
 		mark_inode_dirty(old_dir);
 
 	if (new_inode) {
+		extent_cache_inval(&(EXFAT_I(new_inode)->extent_cache), 0);
 		exfat_detach(new_inode);
 		drop_nlink(new_inode);
 		if (S_ISDIR(new_inode->i_mode))
@@ -1436,11 +1572,78 @@ static int exfat_file_release(struct inode *inode, struct file *filp)
 {
 	struct super_block *sb = inode->i_sb;
 
-	EXFAT_I(inode)->fid.size = i_size_read(inode);
+	/* the prealloc belongs to all the writers of the inode, so it is kept
+	   until the last of them goes away; this one is still counted here.
+	   exfat_get_block() advances mmu_private under the same lock, so
+	   the clusters released here are never ones just handed to a writer */
+	if ((filp->f_mode & FMODE_WRITE) &&
+	    (atomic_read(&inode->i_writecount) == 1)) {
+		__lock_super(sb);
+		EXFAT_I(inode)->fid.size = i_size_read(inode);
+		FsReleasePrealloc(inode);
+		__unlock_super(sb);
+	}
+	FsReleaseEntrySet(inode, 1);
 	FsSyncVol(sb, 0);
 	return 0;
 }
 
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,38)
+static long exfat_fallocate(struct file *filp, int mode, loff_t offset, loff_t len)
+{
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(3,9,0)
+	struct inode *inode = file_inode(filp);
+#else
+	struct inode *inode = filp->f_path.dentry->d_inode;
+#endif
+	struct super_block *sb = inode->i_sb;
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+	loff_t end = offset + len;
+	int err;
+
+	/* FAT has neither holes nor unwritten extents */
+	if (mode & ~FALLOC_FL_KEEP_SIZE)
+		return -EOPNOTSUPP;
+
+	if (((end - 1) >> p_fs->cluster_size_bits) >= (loff_t)(p_fs->num_clusters - 2))
+		return -ENOSPC;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,5,0)
+	inode_lock(inode);
+#else
+	mutex_lock(&inode->i_mutex);
+#endif
+
+	/*
+	 * The clusters are taken at once, as contiguous as the volume
+	 * allows, and kept past mmu_private like a prealloc batch. A FAT
+	 * chain cannot be longer than the file on disk, so with KEEP_SIZE
+	 * the reservation only lasts until the file is closed.
+	 */
+	__lock_super(sb);
+	err = FsReserveClusters(inode, (s32)((end - 1) >> p_fs->cluster_size_bits) + 1);
+	__unlock_super(sb);
+
+	if (err) {
+		err = (err == FFS_FULL) ? -ENOSPC : -EIO;
+		goto out;
+	}
+
+	/* the new size is zeroed through the page cache, into the
+	   reserved clusters, as for a truncate up */
+	if (!(mode & FALLOC_FL_KEEP_SIZE) && (end > i_size_read(inode)))
+		err = exfat_cont_expand(inode, end);
+
+out:
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4,5,0)
+	inode_unlock(inode);
+#else
+	mutex_unlock(&inode->i_mutex);
+#endif
+	return err;
+}
+#endif
+
 const struct file_operations exfat_file_operations = {
 	.llseek      = generic_file_llseek,
 #if LINUX_VERSION_CODE < KERNEL_VERSION(3,16,0)
@@ -1466,6 +1669,9 @@ const struct file_operations exfat_file_operations = {
 	.fsync       = generic_file_fsync,
 #endif
 	.splice_read = generic_file_splice_read,
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,38)
+	.fallocate   = exfat_fallocate,
+#endif
 };
 
 static void _exfat_truncate(struct inode *inode, loff_t old_size)
@@ -1477,6 +1683,9 @@ static void _exfat_truncate(struct inode *inode, loff_t old_size)
 
 	__lock_super(sb);
 
+	/* give back the preallocated clusters before the chain is cut */
+	FsReleasePrealloc(inode);
+
 	/*
 	 * This protects against truncating a file bigger than it was then
 	 * trying to write into the hole.
@@ -1523,7 +1732,8 @@ const struct inode_operations exfat_file_inode_operations = {
 /*======================================================================*/
 
 static int exfat_bmap(struct inode *inode, sector_t sector, sector_t *phys,
-					  unsigned long *mapped_blocks, int *create)
+					  unsigned long max_blocks, unsigned long *mapped_blocks,
+					  int *create)
 {
 	struct super_block *sb = inode->i_sb;
 	struct exfat_sb_info *sbi = EXFAT_SB(sb);
@@ -1533,7 +1743,7 @@ static int exfat_bmap(struct inode *inode, sector_t sector, sector_t *phys,
 	const unsigned char blocksize_bits = sb->s_blocksize_bits;
 	sector_t last_block;
 	int err, clu_offset, sec_offset;
-	unsigned int cluster;
+	unsigned int cluster, num_clu;
 
 	*phys = 0;
 	*mapped_blocks = 0;
@@ -1561,7 +1771,17 @@ static int exfat_bmap(struct inode *inode, sector_t sector, sector_t *phys,
 
 	EXFAT_I(inode)->fid.size = i_size_read(inode);
 
-	err = FsMapCluster(inode, clu_offset, &cluster);
+	/* map as many contiguous clusters as the caller can use, unless a
+	   cluster has to be allocated (mmu_private grows one cluster at a time) */
+	num_clu = 1;
+	if ((*create == 0) && (max_blocks > (p_fs->sectors_per_clu - sec_offset))) {
+		if (max_blocks > ((unsigned long) p_fs->num_clusters << p_fs->sectors_per_clu_bits))
+			max_blocks = (unsigned long) p_fs->num_clusters << p_fs->sectors_per_clu_bits;
+		num_clu = (sec_offset + max_blocks + (p_fs->sectors_per_clu - 1))
+					>> p_fs->sectors_per_clu_bits;
+	}
+
+	err = FsMapCluster(inode, clu_offset, &cluster, &num_clu);
 
 	if (err) {
 		if (err == FFS_FULL)
@@ -1570,12 +1790,46 @@ static int exfat_bmap(struct inode *inode, sector_t sector, sector_t *phys,
 			return -EIO;
 	} else if (cluster != CLUSTER_32(~0)) {
 		*phys = START_SECTOR(cluster) + sec_offset;
-		*mapped_blocks = p_fs->sectors_per_clu - sec_offset;
+		*mapped_blocks = ((unsigned long) num_clu << p_fs->sectors_per_clu_bits) - sec_offset;
 	}
 
 	return 0;
 }
 
+/* map a block inside i_size from the extent cache alone. This needs
+   neither __lock_super nor v_sem, so reads and overwrites of blocks
+   that are already mapped do not serialize on the volume. Returns 0
+   when the caller has to take the locks and go through exfat_bmap */
+static int exfat_bmap_cached(struct inode *inode, sector_t sector, sector_t *phys,
+							 unsigned long *mapped_blocks)
+{
+	struct super_block *sb = inode->i_sb;
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+	sector_t last_block;
+	u32 clu_offset, sec_offset, fclu, cluster;
+	s32 contig;
+
+	if ((inode->i_ino == EXFAT_ROOT_INO) && (p_fs->vol_type != EXFAT))
+		return 0;
+
+	last_block = (i_size_read(inode) + (sb->s_blocksize - 1)) >> sb->s_blocksize_bits;
+	if (sector >= last_block)
+		return 0;
+
+	clu_offset = sector >> p_fs->sectors_per_clu_bits;
+	sec_offset = sector & (p_fs->sectors_per_clu - 1);
+
+	contig = extent_cache_lookup(&(EXFAT_I(inode)->extent_cache), clu_offset,
+								 &fclu, &cluster);
+	if ((contig <= 0) || (fclu != clu_offset))
+		return 0;
+
+	*phys = START_SECTOR(cluster) + sec_offset;
+	*mapped_blocks = ((unsigned long) contig << p_fs->sectors_per_clu_bits) - sec_offset;
+
+	return 1;
+}
+
 static int exfat_get_block(struct inode *inode, sector_t iblock,
 						   struct buffer_head *bh_result, int create)
 {
@@ -1585,9 +1839,17 @@ static int exfat_get_block(struct inode *inode, sector_t iblock,
 	unsigned long mapped_blocks;
 	sector_t phys;
 
+	if (exfat_bmap_cached(inode, iblock, &phys, &mapped_blocks)) {
+		max_blocks = min(mapped_blocks, max_blocks);
+		map_bh(bh_result, sb, phys);
+		bh_result->b_private = sb;
+		bh_result->b_size = max_blocks << sb->s_blocksize_bits;
+		return 0;
+	}
+
 	__lock_super(sb);
 
-	err = exfat_bmap(inode, iblock, &phys, &mapped_blocks, &create);
+	err = exfat_bmap(inode, iblock, &phys, max_blocks, &mapped_blocks, &create);
 	if (err) {
 		__unlock_super(sb);
 		return err;
@@ -1871,16 +2133,20 @@ static void exfat_detach(struct inode *inode)
 	spin_unlock(&sbi->inode_hash_lock);
 }
 
-/* doesn't deal with root inode */
-static int exfat_fill_inode(struct inode *inode, FILE_ID_T *fid)
+/* doesn't deal with root inode
+   info: the entry as decoded by readdir, or NULL to read it here */
+static int exfat_fill_inode(struct inode *inode, FILE_ID_T *fid, DIR_ENTRY_T *info)
 {
 	struct exfat_sb_info *sbi = EXFAT_SB(inode->i_sb);
 	FS_INFO_T *p_fs = &(sbi->fs_info);
-	DIR_ENTRY_T info;
+	DIR_ENTRY_T stat;
 
 	memcpy(&(EXFAT_I(inode)->fid), fid, sizeof(FILE_ID_T));
 
-	FsReadStat(inode, &info);
+	if (!info) {
+		FsReadStat(inode, &stat);
+		info = &stat;
+	}
 
 	EXFAT_I(inode)->i_pos = 0;
 	EXFAT_I(inode)->target = NULL;
@@ -1889,51 +2155,52 @@ static int exfat_fill_inode(struct inode *inode, FILE_ID_T *fid)
 	inode->i_version++;
 	inode->i_generation = get_seconds();
 
-	if (info.Attr & ATTR_SUBDIR) { /* directory */
+	if (info->Attr & ATTR_SUBDIR) { /* directory */
 		inode->i_generation &= ~1;
-		inode->i_mode = exfat_make_mode(sbi, info.Attr, S_IRWXUGO);
+		inode->i_mode = exfat_make_mode(sbi, info->Attr, S_IRWXUGO);
 		inode->i_op = &exfat_dir_inode_operations;
 		inode->i_fop = &exfat_dir_operations;
 
-		i_size_write(inode, info.Size);
+		i_size_write(inode, info->Size);
 		EXFAT_I(inode)->mmu_private = i_size_read(inode);
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(3,2,00)
-		set_nlink(inode, info.NumSubdirs);
+		set_nlink(inode, info->NumSubdirs);
 #else
-		inode->i_nlink = info.NumSubdirs;
+		inode->i_nlink = info->NumSubdirs;
 #endif
-	} else if (info.Attr & ATTR_SYMLINK) { /* symbolic link */
+	} else if (info->Attr & ATTR_SYMLINK) { /* symbolic link */
 		inode->i_generation |= 1;
-		inode->i_mode = exfat_make_mode(sbi, info.Attr, S_IRWXUGO);
+		inode->i_mode = exfat_make_mode(sbi, info->Attr, S_IRWXUGO);
 		inode->i_op = &exfat_symlink_inode_operations;
 
-		i_size_write(inode, info.Size);
+		i_size_write(inode, info->Size);
 		EXFAT_I(inode)->mmu_private = i_size_read(inode);
 	} else { /* regular file */
 		inode->i_generation |= 1;
-		inode->i_mode = exfat_make_mode(sbi, info.Attr, S_IRWXUGO);
+		inode->i_mode = exfat_make_mode(sbi, info->Attr, S_IRWXUGO);
 		inode->i_op = &exfat_file_inode_operations;
 		inode->i_fop = &exfat_file_operations;
 		inode->i_mapping->a_ops = &exfat_aops;
 		inode->i_mapping->nrpages = 0;
 
-		i_size_write(inode, info.Size);
+		i_size_write(inode, info->Size);
 		EXFAT_I(inode)->mmu_private = i_size_read(inode);
 	}
-	exfat_save_attr(inode, info.Attr);
+	exfat_save_attr(inode, info->Attr);
 
 	inode->i_blocks = ((i_size_read(inode) + (p_fs->cluster_size - 1))
 					   & ~((loff_t)p_fs->cluster_size - 1)) >> 9;
 
-	exfat_time_fat2unix(sbi, &inode->i_mtime, &info.ModifyTimestamp);
-	exfat_time_fat2unix(sbi, &inode->i_ctime, &info.CreateTimestamp);
-	exfat_time_fat2unix(sbi, &inode->i_atime, &info.AccessTimestamp);
+	exfat_time_fat2unix(sbi, &inode->i_mtime, &info->ModifyTimestamp);
+	exfat_time_fat2unix(sbi, &inode->i_ctime, &info->CreateTimestamp);
+	exfat_time_fat2unix(sbi, &inode->i_atime, &info->AccessTimestamp);
 
 	return 0;
 }
 
-static struct inode *exfat_build_inode(struct super_block *sb,
-									   FILE_ID_T *fid, loff_t i_pos) {
+static struct inode *__exfat_build_inode(struct super_block *sb, FILE_ID_T *fid,
+										 DIR_ENTRY_T *info, loff_t i_pos)
+{
 	struct inode *inode;
 	int err;
 
@@ -1947,7 +2214,7 @@ static struct inode *exfat_build_inode(struct super_block *sb,
 	}
 	inode->i_ino = iunique(sb, EXFAT_ROOT_INO);
 	inode->i_version = 1;
-	err = exfat_fill_inode(inode, fid);
+	err = exfat_fill_inode(inode, fid, info);
 	if (err) {
 		iput(inode);
 		inode = ERR_PTR(err);
@@ -1959,6 +2226,37 @@ out:
 	return inode;
 }
 
+static struct inode *exfat_build_inode(struct super_block *sb,
+									   FILE_ID_T *fid, loff_t i_pos) {
+	return __exfat_build_inode(sb, fid, NULL, i_pos);
+}
+
+/* build the inode of a file from the entry readdir has just decoded,
+   the file ID is the one ffsLookupFile() would return for it.
+   not for directories, their link count needs a scan of the directory */
+static struct inode *exfat_readdir_inode(struct inode *dir, DIR_ENTRY_T *de, loff_t i_pos)
+{
+	struct super_block *sb = dir->i_sb;
+	FS_INFO_T *p_fs = &(EXFAT_SB(sb)->fs_info);
+	FILE_ID_T *dir_fid = &(EXFAT_I(dir)->fid);
+	FILE_ID_T fid;
+
+	fid.dir.dir = dir_fid->start_clu;
+	fid.dir.size = (s32)(dir_fid->size >> p_fs->cluster_size_bits);
+	fid.dir.flags = dir_fid->flags;
+	fid.entry = (s32)(dir_fid->rwoffset - 1);
+
+	fid.type = TYPE_FILE;
+	fid.rwoffset = 0;
+	fid.hint_last_off = -1;
+	fid.attr = de->Attr;
+	fid.size = de->Size;
+	fid.flags = de->Flags;
+	fid.start_clu = de->StartClu;
+
+	return __exfat_build_inode(sb, &fid, de, i_pos);
+}
+
 static int exfat_sync_inode(struct inode *inode)
 {
 #if LINUX_VERSION_CODE < KERNEL_VERSION(2,6,34)
@@ -1979,6 +2277,9 @@ static struct inode *exfat_alloc_inode(struct super_block *sb)
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(3,4,00)
 	init_rwsem(&ei->truncate_lock);
 #endif
+	extent_cache_init(&ei->extent_cache);
+	ei->prealloc_clusters = 0;
+	ei->es = NULL;
 
 	return &ei->vfs_inode;
 }
@@ -2026,6 +2327,7 @@ static void exfat_delete_inode(struct inode *inode)
 
 static void exfat_clear_inode(struct inode *inode)
 {
+	FsReleaseEntrySet(inode, inode->i_nlink);
 	exfat_detach(inode);
 	remove_inode_hash(inode);
 }
@@ -2034,8 +2336,13 @@ static void exfat_evict_inode(struct inode *inode)
 {
 	truncate_inode_pages(&inode->i_data, 0);
 
+	/* no writer is left to race with, and iput() may be called with the
+	   super lock held, so the prealloc is released without taking it */
 	if (!inode->i_nlink)
 		i_size_write(inode, 0);
+	else
+		FsReleasePrealloc(inode);
+	FsReleaseEntrySet(inode, inode->i_nlink);
 	invalidate_inode_buffers(inode);
 #if LINUX_VERSION_CODE < KERNEL_VERSION(3,5,0)
 	end_writeback(inode);
@@ -2069,10 +2376,19 @@ static void exfat_put_super(struct super_block *sb)
 
 	sbi->disable_uevent = 1;
 	cancel_work_sync(&sbi->uevent_work);
+	cancel_delayed_work_sync(&sbi->flush_work);
+	cancel_work_sync(&sbi->count_work);
+
+#ifdef CONFIG_EXFAT_DISCARD
+	/* issue what is still queued rather than dropping it */
+	cancel_delayed_work_sync(&sbi->discard_work);
+	FsDiscardPending(sb);
+#endif /* CONFIG_EXFAT_DISCARD */
 
 	if (__is_sb_dirty(sb))
 		exfat_write_super(sb);
 
+	exfat_sysfs_unregister(sb);
 	FsUmountVol(sb);
 
 	sb->s_fs_info = NULL;
@@ -2181,6 +2497,10 @@ static int exfat_show_options(struct seq_file *m, struct vfsmount *mnt)
 		seq_puts(m, ",errors=panic");
 	else
 		seq_puts(m, ",errors=remount-ro");
+	if (opts->cache_size)
+		seq_printf(m, ",cache_size=%u", opts->cache_size);
+	if (opts->prealloc)
+		seq_puts(m, ",prealloc");
 #ifdef CONFIG_EXFAT_DISCARD
 	if (opts->discard)
 		seq_printf(m, ",discard");
@@ -2247,6 +2567,133 @@ const struct export_operations exfat_export_ops = {
 	.fh_to_parent   = exfat_fh_to_parent,
 };
 
+/*======================================================================*/
+/*  Sysfs Interface                                                     */
+/*======================================================================*/
+
+static struct kset *exfat_kset;
+
+struct exfat_attr {
+	struct attribute attr;
+	ssize_t (*show)(struct exfat_sb_info *sbi, char *buf);
+};
+
+#define EXFAT_CACHE_ATTR(_name, _pool, _field)				\
+static ssize_t _name##_show(struct exfat_sb_info *sbi, char *buf)	\
+{									\
+	return snprintf(buf, PAGE_SIZE, "%lu\n",			\
+			(unsigned long) sbi->fs_info._pool._field);	\
+}									\
+static struct exfat_attr exfat_attr_##_name = __ATTR_RO(_name)
+
+EXFAT_CACHE_ATTR(fat_cache_size, FAT_cache, size);
+EXFAT_CACHE_ATTR(fat_cache_hits, FAT_cache, hits);
+EXFAT_CACHE_ATTR(fat_cache_misses, FAT_cache, misses);
+EXFAT_CACHE_ATTR(buf_cache_size, buf_cache, size);
+EXFAT_CACHE_ATTR(buf_cache_hits, buf_cache, hits);
+EXFAT_CACHE_ATTR(buf_cache_misses, buf_cache, misses);
+
+#define EXFAT_STAT_ATTR(_name)						\
+static ssize_t _name##_show(struct exfat_sb_info *sbi, char *buf)	\
+{									\
+	return snprintf(buf, PAGE_SIZE, "%lu\n",			\
+			sbi->fs_info.stats._name);			\
+}									\
+static struct exfat_attr exfat_attr_##_name = __ATTR_RO(_name)
+
+EXFAT_STAT_ATTR(fat_reads);
+EXFAT_STAT_ATTR(fat_writes);
+EXFAT_STAT_ATTR(alloc_calls);
+EXFAT_STAT_ATTR(alloc_clusters);
+EXFAT_STAT_ATTR(alloc_distance);
+EXFAT_STAT_ATTR(chain_walks);
+EXFAT_STAT_ATTR(bdev_reads);
+EXFAT_STAT_ATTR(bdev_read_secs);
+EXFAT_STAT_ATTR(bdev_writes);
+EXFAT_STAT_ATTR(bdev_write_secs);
+
+static struct attribute *exfat_attrs[] = {
+	&exfat_attr_fat_cache_size.attr,
+	&exfat_attr_fat_cache_hits.attr,
+	&exfat_attr_fat_cache_misses.attr,
+	&exfat_attr_buf_cache_size.attr,
+	&exfat_attr_buf_cache_hits.attr,
+	&exfat_attr_buf_cache_misses.attr,
+	&exfat_attr_fat_reads.attr,
+	&exfat_attr_fat_writes.attr,
+	&exfat_attr_alloc_calls.attr,
+	&exfat_attr_alloc_clusters.attr,
+	&exfat_attr_alloc_distance.attr,
+	&exfat_attr_chain_walks.attr,
+	&exfat_attr_bdev_reads.attr,
+	&exfat_attr_bdev_read_secs.attr,
+	&exfat_attr_bdev_writes.attr,
+	&exfat_attr_bdev_write_secs.attr,
+	NULL,
+};
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,2,0)
+ATTRIBUTE_GROUPS(exfat);
+#endif
+
+static ssize_t exfat_attr_show(struct kobject *kobj,
+			       struct attribute *attr, char *buf)
+{
+	struct exfat_sb_info *sbi = container_of(kobj, struct exfat_sb_info,
+						 s_kobj);
+	struct exfat_attr *a = container_of(attr, struct exfat_attr, attr);
+
+	return a->show ? a->show(sbi, buf) : 0;
+}
+
+static void exfat_sb_release(struct kobject *kobj)
+{
+	struct exfat_sb_info *sbi = container_of(kobj, struct exfat_sb_info,
+						 s_kobj);
+
+	complete(&sbi->s_kobj_unregister);
+}
+
+static const struct sysfs_ops exfat_attr_ops = {
+	.show = exfat_attr_show,
+};
+
+static struct kobj_type exfat_sb_ktype = {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,2,0)
+	.default_groups = exfat_groups,
+#else
+	.default_attrs = exfat_attrs,
+#endif
+	.sysfs_ops     = &exfat_attr_ops,
+	.release       = exfat_sb_release,
+};
+
+/* statistics of a mounted volume appear under /sys/fs/exfat/<dev>/ */
+static int exfat_sysfs_register(struct super_block *sb)
+{
+	struct exfat_sb_info *sbi = EXFAT_SB(sb);
+	int err;
+
+	sbi->s_kobj.kset = exfat_kset;
+	init_completion(&sbi->s_kobj_unregister);
+	err = kobject_init_and_add(&sbi->s_kobj, &exfat_sb_ktype, NULL,
+				   "%s", sb->s_id);
+	if (err) {
+		kobject_put(&sbi->s_kobj);
+		wait_for_completion(&sbi->s_kobj_unregister);
+	}
+
+	return err;
+}
+
+static void exfat_sysfs_unregister(struct super_block *sb)
+{
+	struct exfat_sb_info *sbi = EXFAT_SB(sb);
+
+	kobject_del(&sbi->s_kobj);
+	kobject_put(&sbi->s_kobj);
+	wait_for_completion(&sbi->s_kobj_unregister);
+}
+
 /*======================================================================*/
 /*  Super Block Read Operations                                         */
 /*======================================================================*/
@@ -2266,6 +2713,8 @@ enum {
 	Opt_err_panic,
 	Opt_err_ro,
 	Opt_utf8_hack,
+	Opt_cache_size,
+	Opt_prealloc,
 	Opt_err,
 #ifdef CONFIG_EXFAT_DISCARD
 	Opt_discard,
@@ -2287,6 +2736,8 @@ static const match_table_t exfat_tokens = {
 	{Opt_err_panic, "errors=panic"},
 	{Opt_err_ro, "errors=remount-ro"},
 	{Opt_utf8_hack, "utf8"},
+	{Opt_cache_size, "cache_size=%u"},
+	{Opt_prealloc, "prealloc"},
 #ifdef CONFIG_EXFAT_DISCARD
 	{Opt_discard, "discard"},
 #endif /* CONFIG_EXFAT_DISCARD */
@@ -2309,6 +2760,8 @@ static int parse_options(char *options, int silent, int *debug,
 	opts->iocharset = exfat_default_iocharset;
 	opts->casesensitive = 0;
 	opts->errors = EXFAT_ERRORS_RO;
+	opts->cache_size = 0;
+	opts->prealloc = 0;
 #ifdef CONFIG_EXFAT_DISCARD
 	opts->discard = 0;
 #endif
@@ -2394,6 +2847,14 @@ static int parse_options(char *options, int silent, int *debug,
 #endif /* CONFIG_EXFAT_DISCARD */
 		case Opt_utf8_hack:
 			break;
+		case Opt_cache_size:
+			if (match_int(&args[0], &option))
+				return 0;
+			opts->cache_size = option;
+			break;
+		case Opt_prealloc:
+			opts->prealloc = 1;
+			break;
 		default:
 			if (!silent)
 				printk(KERN_ERR "[EXFAT] Unrecognized mount option %s or missing value\n", p);
@@ -2495,6 +2956,11 @@ static int exfat_fill_super(struct super_block *sb, void *data, int silent)
 #endif
 	sbi->sb = sb;
 	INIT_WORK(&sbi->uevent_work, exfat_sbi_uevent_work);
+	INIT_DELAYED_WORK(&sbi->flush_work, exfat_flush_work);
+	INIT_WORK(&sbi->count_work, exfat_count_work);
+#ifdef CONFIG_EXFAT_DISCARD
+	INIT_DELAYED_WORK(&sbi->discard_work, exfat_discard_work);
+#endif /* CONFIG_EXFAT_DISCARD */
 
 	sb->s_fs_info = sbi;
 	sb->s_flags |= MS_NODIRATIME;
@@ -2522,6 +2988,13 @@ static int exfat_fill_super(struct super_block *sb, void *data, int silent)
 		goto out_fail;
 	}
 
+	if (sbi->fs_info.used_clusters == (u32) ~0)
+		schedule_work(&sbi->count_work);
+
+	error = exfat_sysfs_register(sb);
+	if (error)
+		goto out_fail2;
+
 	/* set up enough so that it can read an inode */
 	exfat_hash_init(sb);
 
@@ -2540,7 +3013,7 @@ static int exfat_fill_super(struct super_block *sb, void *data, int silent)
 		sbi->nls_disk = load_nls(buf);
 		if (!sbi->nls_disk) {
 			printk(KERN_ERR "[EXFAT] Codepage %s not found\n", buf);
-			goto out_fail2;
+			goto out_fail3;
 		}
 	}
 
@@ -2549,12 +3022,12 @@ static int exfat_fill_super(struct super_block *sb, void *data, int silent)
 	error = -ENOMEM;
 	root_inode = new_inode(sb);
 	if (!root_inode)
-		goto out_fail2;
+		goto out_fail3;
 	root_inode->i_ino = EXFAT_ROOT_INO;
 	root_inode->i_version = 1;
 	error = exfat_read_root(root_inode);
 	if (error < 0)
-		goto out_fail2;
+		goto out_fail3;
 	error = -ENOMEM;
 	exfat_attach(root_inode, EXFAT_I(root_inode)->i_pos);
 	insert_inode_hash(root_inode);
@@ -2565,12 +3038,15 @@ static int exfat_fill_super(struct super_block *sb, void *data, int silent)
 #endif
 	if (!sb->s_root) {
 		printk(KERN_ERR "[EXFAT] Getting the root inode failed\n");
-		goto out_fail2;
+		goto out_fail3;
 	}
 
 	return 0;
 
+out_fail3:
+	exfat_sysfs_unregister(sb);
 out_fail2:
+	cancel_work_sync(&sbi->count_work);
 	FsUmountVol(sb);
 out_fail:
 	if (root_inode)
@@ -2614,7 +3090,7 @@ static int __init exfat_init_inodecache(void)
 	return 0;
 }
 
-static void __exit exfat_destroy_inodecache(void)
+static void exfat_destroy_inodecache(void)
 {
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(3,6,0)
 	/*
@@ -2687,11 +3163,21 @@ static int __init init_exfat(void)
 	if (err)
 		goto out;
 
+	exfat_kset = kset_create_and_add("exfat", NULL, fs_kobj);
+	if (!exfat_kset) {
+		err = -ENOMEM;
+		goto out_inodecache;
+	}
+
 	err = register_filesystem(&exfat_fs_type);
 	if (err)
-		goto out;
+		goto out_kset;
 
 	return 0;
+out_kset:
+	kset_unregister(exfat_kset);
+out_inodecache:
+	exfat_destroy_inodecache();
 out:
 	FsShutdown();
 	return err;
@@ -2701,6 +3187,7 @@ static void __exit exit_exfat(void)
 {
 	exfat_destroy_inodecache();
 	unregister_filesystem(&exfat_fs_type);
+	kset_unregister(exfat_kset);
 	FsShutdown();
 }
 
@@ -27,6 +27,8 @@
 #include <linux/fs.h>
 #include <linux/mutex.h>
 #include <linux/swap.h>
+#include <linux/kobject.h>
+#include <linux/completion.h>
 
 #include "exfat_config.h"
 #include "exfat_data.h"
@@ -60,6 +62,8 @@ struct exfat_mount_options {
 	char *iocharset;            /* charset for filename input/display */
 	unsigned char casesensitive;
 	unsigned char errors;       /* on error: continue, panic, remount-ro */
+	unsigned int cache_size;    /* num of buf cache sectors, 0 for auto */
+	unsigned char prealloc;     /* allocate clusters for appending writes in batches */
 #ifdef CONFIG_EXFAT_DISCARD
 	unsigned char discard;      /* flag on if -o dicard specified and device support discard() */
 #endif /* CONFIG_EXFAT_DISCARD */
@@ -94,6 +98,14 @@ struct exfat_sb_info {
 	struct super_block *sb;
 	struct work_struct uevent_work;
 	int disable_uevent;
+	struct delayed_work flush_work;     /* writes back dirty metadata */
+	struct work_struct count_work;      /* counts used clusters after mount */
+#ifdef CONFIG_EXFAT_DISCARD
+	struct delayed_work discard_work;   /* issues the queued discards */
+#endif /* CONFIG_EXFAT_DISCARD */
+
+	struct kobject s_kobj;              /* /sys/fs/exfat/<dev> */
+	struct completion s_kobj_unregister;
 };
 
 /*
@@ -105,6 +117,9 @@ struct exfat_inode_info {
 	/* NOTE: mmu_private is 64bits, so must hold ->i_mutex to access */
 	loff_t mmu_private;         /* physically allocated size */
 	loff_t i_pos;               /* on-disk position of directory entry or 0 */
+	EXTENT_CACHE_T extent_cache; /* cached runs of the cluster chain */
+	u32 prealloc_clusters;      /* clusters allocated past mmu_private */
+	ENTRY_SET_CACHE_T *es;      /* exFAT entry set, see get_inode_entry_set() */
 	struct hlist_node i_hash_fat;	/* hash by i_location */
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(3,4,00)
 	struct rw_semaphore truncate_lock;
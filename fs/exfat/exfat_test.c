@@ -0,0 +1,167 @@
+/*
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ */
+
+/************************************************************************/
+/*                                                                      */
+/*  PROJECT : exFAT & FAT12/16/32 File System                           */
+/*  FILE    : exfat_test.c                                              */
+/*  PURPOSE : KUnit tests of the entry set checksum and name hash       */
+/*                                                                      */
+/*----------------------------------------------------------------------*/
+/*  NOTES                                                               */
+/*                                                                      */
+/*  The word-wise checksums must stay bit-exact with the byte-wise      */
+/*  loop the on-disk format is defined by, which is kept here as the    */
+/*  reference.                                                          */
+/*                                                                      */
+/************************************************************************/
+
+#include <kunit/test.h>
+
+#include "exfat_config.h"
+#include "exfat_data.h"
+
+#include "exfat_nls.h"
+#include "exfat_api.h"
+#include "exfat_super.h"
+#include "exfat_core.h"
+
+#define TEST_ROUNDS             1000
+#define TEST_MAX_ENTRIES        19          /* file + stream + 17 names */
+
+/*----------------------------------------------------------------------*/
+/*  Local Function Definitions                                          */
+/*----------------------------------------------------------------------*/
+
+/* the original byte-wise checksum, as it was before the word-wise one */
+static u16 ref_checksum_2byte(u8 *c, s32 len, u16 chksum, s32 type)
+{
+	int i;
+
+	for (i = 0; i < len; i++, c++) {
+		if ((type == CS_DIR_ENTRY) && ((i == 2) || (i == 3)))
+			continue;
+		chksum = (((chksum & 1) << 15) | ((chksum & 0xFFFE) >> 1)) + (u16) *c;
+	}
+	return chksum;
+}
+
+/* xorshift32, so that a failing round can be reproduced from its seed */
+static u32 test_rand(u32 *state)
+{
+	u32 x = *state;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return *state = x;
+}
+
+static void test_fill(u8 *buf, s32 len, u32 *state)
+{
+	s32 i;
+
+	for (i = 0; i < len; i++)
+		buf[i] = (u8) test_rand(state);
+}
+
+/*----------------------------------------------------------------------*/
+/*  Test Cases                                                          */
+/*----------------------------------------------------------------------*/
+
+static void exfat_test_dentry_checksum(struct kunit *test)
+{
+	u32 state = 0x2545F491;
+	u16 seed;
+	s32 round;
+	DENTRY_T *ep;
+
+	ep = kunit_kzalloc(test, DENTRY_SIZE, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, ep);
+
+	for (round = 0; round < TEST_ROUNDS; round++) {
+		test_fill((u8 *) ep, DENTRY_SIZE, &state);
+		seed = (u16) test_rand(&state);
+
+		KUNIT_EXPECT_EQ(test,
+			calc_dentry_checksum(ep, seed, CS_DIR_ENTRY),
+			ref_checksum_2byte((u8 *) ep, DENTRY_SIZE, seed, CS_DIR_ENTRY));
+		KUNIT_EXPECT_EQ(test,
+			calc_dentry_checksum(ep, seed, CS_DEFAULT),
+			ref_checksum_2byte((u8 *) ep, DENTRY_SIZE, seed, CS_DEFAULT));
+		KUNIT_EXPECT_EQ(test,
+			calc_checksum_2byte(ep, DENTRY_SIZE, seed, CS_DIR_ENTRY),
+			ref_checksum_2byte((u8 *) ep, DENTRY_SIZE, seed, CS_DIR_ENTRY));
+	}
+}
+
+static void exfat_test_entry_set_checksum(struct kunit *test)
+{
+	u32 state = 0x6B8B4567;
+	u16 chksum;
+	s32 round, num_entries, i;
+	DENTRY_T *es;
+
+	es = kunit_kzalloc(test, TEST_MAX_ENTRIES * DENTRY_SIZE, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, es);
+
+	for (round = 0; round < TEST_ROUNDS; round++) {
+		num_entries = 2 + (s32)(test_rand(&state) % (TEST_MAX_ENTRIES - 1));
+		test_fill((u8 *) es, num_entries * DENTRY_SIZE, &state);
+
+		chksum = ref_checksum_2byte((u8 *) es, DENTRY_SIZE, 0, CS_DIR_ENTRY);
+		for (i = 1; i < num_entries; i++)
+			chksum = ref_checksum_2byte((u8 *)(es + i), DENTRY_SIZE, chksum, CS_DEFAULT);
+
+		KUNIT_EXPECT_EQ(test, calc_entry_set_checksum(es, num_entries), chksum);
+	}
+}
+
+static void exfat_test_name_hash(struct kunit *test)
+{
+	u32 state = 0x327B23C6;
+	u16 chksum, uni;
+	s32 round, len, i;
+	u8 *buf;
+
+	buf = kunit_kzalloc(test, MAX_NAME_LENGTH * 2, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, buf);
+
+	for (round = 0; round < TEST_ROUNDS; round++) {
+		len = 1 + (s32)(test_rand(&state) % (MAX_NAME_LENGTH - 1));
+
+		/* the hash is defined over the upcased name in on-disk order */
+		chksum = 0;
+		for (i = 0; i < len; i++) {
+			uni = (u16) test_rand(&state);
+			buf[2*i] = (u8) uni;
+			buf[2*i+1] = (u8) (uni >> 8);
+			chksum = chksum_2byte_add_char(chksum, uni);
+		}
+
+		KUNIT_EXPECT_EQ(test, chksum, ref_checksum_2byte(buf, len << 1, 0, CS_DEFAULT));
+	}
+}
+
+static struct kunit_case exfat_test_cases[] = {
+	KUNIT_CASE(exfat_test_dentry_checksum),
+	KUNIT_CASE(exfat_test_entry_set_checksum),
+	KUNIT_CASE(exfat_test_name_hash),
+	{}
+};
+
+static struct kunit_suite exfat_test_suite = {
+	.name = "exfat",
+	.test_cases = exfat_test_cases,
+};
+
+kunit_test_suite(exfat_test_suite);
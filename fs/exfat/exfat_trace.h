@@ -0,0 +1,204 @@
+/*
+ *  This program is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU General Public License
+ *  as published by the Free Software Foundation; either version 2
+ *  of the License, or (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ */
+
+/************************************************************************/
+/*                                                                      */
+/*  PROJECT : exFAT & FAT12/16/32 File System                           */
+/*  FILE    : exfat_trace.h                                             */
+/*  PURPOSE : Tracepoints of the FAT, bitmap, cache and block accesses  */
+/*            (events/exfat/ in tracefs, defined in exfat_super.c)      */
+/*                                                                      */
+/************************************************************************/
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM exfat
+
+#if !defined(_EXFAT_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _EXFAT_TRACE_H
+
+#include <linux/tracepoint.h>
+
+DECLARE_EVENT_CLASS(exfat_fat_access,
+
+	TP_PROTO(struct super_block *sb, u32 loc, u32 content),
+
+	TP_ARGS(sb, loc, content),
+
+	TP_STRUCT__entry(
+		__field(dev_t,	dev)
+		__field(u32,	loc)
+		__field(u32,	content)
+	),
+
+	TP_fast_assign(
+		__entry->dev		= sb->s_dev;
+		__entry->loc		= loc;
+		__entry->content	= content;
+	),
+
+	TP_printk("dev %d,%d clu %u next 0x%08x",
+		  MAJOR(__entry->dev), MINOR(__entry->dev),
+		  __entry->loc, __entry->content)
+);
+
+DEFINE_EVENT(exfat_fat_access, exfat_fat_read,
+
+	TP_PROTO(struct super_block *sb, u32 loc, u32 content),
+
+	TP_ARGS(sb, loc, content)
+);
+
+DEFINE_EVENT(exfat_fat_access, exfat_fat_write,
+
+	TP_PROTO(struct super_block *sb, u32 loc, u32 content),
+
+	TP_ARGS(sb, loc, content)
+);
+
+TRACE_EVENT(exfat_buf_getblk,
+
+	TP_PROTO(struct super_block *sb, sector_t sec, int hit),
+
+	TP_ARGS(sb, sec, hit),
+
+	TP_STRUCT__entry(
+		__field(dev_t,	dev)
+		__field(u64,	sec)
+		__field(int,	hit)
+	),
+
+	TP_fast_assign(
+		__entry->dev	= sb->s_dev;
+		__entry->sec	= sec;
+		__entry->hit	= hit;
+	),
+
+	TP_printk("dev %d,%d sector %llu %s",
+		  MAJOR(__entry->dev), MINOR(__entry->dev),
+		  (unsigned long long) __entry->sec,
+		  __entry->hit ? "hit" : "miss")
+);
+
+TRACE_EVENT(exfat_alloc_cluster,
+
+	TP_PROTO(struct super_block *sb, u32 hint, u32 first, s32 wanted,
+		 s32 alloced, u32 distance),
+
+	TP_ARGS(sb, hint, first, wanted, alloced, distance),
+
+	TP_STRUCT__entry(
+		__field(dev_t,	dev)
+		__field(u32,	hint)
+		__field(u32,	first)
+		__field(s32,	wanted)
+		__field(s32,	alloced)
+		__field(u32,	distance)
+	),
+
+	TP_fast_assign(
+		__entry->dev		= sb->s_dev;
+		__entry->hint		= hint;
+		__entry->first		= first;
+		__entry->wanted		= wanted;
+		__entry->alloced	= alloced;
+		__entry->distance	= distance;
+	),
+
+	TP_printk("dev %d,%d hint %u first %u wanted %d alloced %d distance %u",
+		  MAJOR(__entry->dev), MINOR(__entry->dev),
+		  __entry->hint, __entry->first, __entry->wanted,
+		  __entry->alloced, __entry->distance)
+);
+
+TRACE_EVENT(exfat_map_cluster,
+
+	TP_PROTO(struct inode *inode, s32 clu_offset, u32 clu, u32 walked),
+
+	TP_ARGS(inode, clu_offset, clu, walked),
+
+	TP_STRUCT__entry(
+		__field(dev_t,		dev)
+		__field(unsigned long,	ino)
+		__field(s32,		clu_offset)
+		__field(u32,		clu)
+		__field(u32,		walked)
+	),
+
+	TP_fast_assign(
+		__entry->dev		= inode->i_sb->s_dev;
+		__entry->ino		= inode->i_ino;
+		__entry->clu_offset	= clu_offset;
+		__entry->clu		= clu;
+		__entry->walked		= walked;
+	),
+
+	TP_printk("dev %d,%d ino %lu offset %d clu 0x%08x walked %u",
+		  MAJOR(__entry->dev), MINOR(__entry->dev),
+		  __entry->ino, __entry->clu_offset, __entry->clu,
+		  __entry->walked)
+);
+
+DECLARE_EVENT_CLASS(exfat_bdev_access,
+
+	TP_PROTO(struct super_block *sb, sector_t secno, u32 num_secs, s32 flag),
+
+	TP_ARGS(sb, secno, num_secs, flag),
+
+	TP_STRUCT__entry(
+		__field(dev_t,	dev)
+		__field(u64,	secno)
+		__field(u32,	num_secs)
+		__field(s32,	flag)
+	),
+
+	TP_fast_assign(
+		__entry->dev		= sb->s_dev;
+		__entry->secno		= secno;
+		__entry->num_secs	= num_secs;
+		__entry->flag		= flag;
+	),
+
+	TP_printk("dev %d,%d sector %llu count %u flag %d",
+		  MAJOR(__entry->dev), MINOR(__entry->dev),
+		  (unsigned long long) __entry->secno,
+		  __entry->num_secs, __entry->flag)
+);
+
+/* flag: 1 if the sectors are read, 0 if only the buffer is set up */
+DEFINE_EVENT(exfat_bdev_access, exfat_bdev_read,
+
+	TP_PROTO(struct super_block *sb, sector_t secno, u32 num_secs, s32 flag),
+
+	TP_ARGS(sb, secno, num_secs, flag)
+);
+
+/* flag: 1 for a synchronous write */
+DEFINE_EVENT(exfat_bdev_access, exfat_bdev_write,
+
+	TP_PROTO(struct super_block *sb, sector_t secno, u32 num_secs, s32 flag),
+
+	TP_ARGS(sb, secno, num_secs, flag)
+);
+
+#endif /* _EXFAT_TRACE_H */
+
+/* this header lives next to the sources, not in include/trace/events */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE exfat_trace
+
+#include <trace/define_trace.h>
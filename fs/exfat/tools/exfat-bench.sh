@@ -0,0 +1,196 @@
+#!/bin/bash
+#
+# exfat-bench.sh - run the exfat benchmark workloads on loop images
+#
+# usage: exfat-bench.sh [-m exfat.ko] [-c "4K 32K 128K"] [-s image_size]
+#                       [-d workdir] [-o results]
+#
+# For every cluster size, a fresh image is made with mkfs.exfat,
+# loop-mounted and put through the workloads below. One line is written
+# to the results file per measurement:
+#
+#	<cluster size>.<metric> <value>
+#
+# Metrics ending in _mbs or _ops are rates, metrics ending in _ms are
+# elapsed times, and the others are counts: fragments reported by filefrag,
+# or deltas of the per-volume counters in /sys/fs/exfat/<dev>. A metric the
+# module cannot provide, such as a counter an older module lacks, is n/a.
+# exfat-compare.sh checks a results file against a baseline and the limits
+# in thresholds.conf.
+#
+# Needs root, mkfs.exfat, losetup, filefrag and fallocate. The page cache
+# is dropped before every workload that has to read from the device.
+
+set -e
+
+MODULE=
+CLUSTERS="4K 32K 128K"
+SIZE=2G
+WORKDIR=/tmp/exfat-bench
+RESULTS=exfat-bench.results
+
+SEQ_MB=512
+SMALL_FILES=5000
+LOOKUPS=20000
+APPEND_MB=64
+
+while getopts "m:c:s:d:o:" opt; do
+	case $opt in
+	m) MODULE=$OPTARG ;;
+	c) CLUSTERS=$OPTARG ;;
+	s) SIZE=$OPTARG ;;
+	d) WORKDIR=$OPTARG ;;
+	o) RESULTS=$OPTARG ;;
+	*) sed -n '5,6p' "$0" >&2; exit 2 ;;
+	esac
+done
+
+IMG=$WORKDIR/exfat.img
+MNT=$WORKDIR/mnt
+LOOP=
+
+cleanup() {
+	mountpoint -q "$MNT" && umount "$MNT"
+	[ -n "$LOOP" ] && losetup -d "$LOOP"
+	rm -f "$IMG"
+}
+trap cleanup EXIT
+
+now_ms() {
+	echo $(( $(date +%s%N) / 1000000 ))
+}
+
+drop_caches() {
+	sync
+	echo 3 > /proc/sys/vm/drop_caches
+}
+
+# counter <name>, n/a on a module without the counter
+counter() {
+	local file=/sys/fs/exfat/$DEV/$1
+
+	if [ -r "$file" ]; then
+		cat "$file"
+	else
+		echo n/a
+	fi
+}
+
+# result <metric> <value>
+result() {
+	echo "$CLU.$1 $2" | tee -a "$RESULTS"
+}
+
+# delta <metric> <counter> <value before>
+delta() {
+	local now=$(counter "$2")
+
+	if [ "$3" = n/a ] || [ "$now" = n/a ]; then
+		result "$1" n/a
+	else
+		result "$1" $(( now - $3 ))
+	fi
+}
+
+# rate <metric> <amount> <start ms> <end ms>
+rate() {
+	local ms=$(( $4 - $3 ))
+	[ $ms -gt 0 ] || ms=1
+	result "$1" $(( $2 * 1000 / ms ))
+}
+
+extents() {
+	filefrag "$1" | sed -n 's/.*: \([0-9]*\) extents\{0,1\} found/\1/p'
+}
+
+if [ -n "$MODULE" ]; then
+	rmmod exfat 2>/dev/null || true
+	insmod "$MODULE"
+fi
+
+mkdir -p "$MNT"
+: > "$RESULTS"
+
+for CLU in $CLUSTERS; do
+	rm -f "$IMG"
+	truncate -s "$SIZE" "$IMG"
+	mkfs.exfat -c "$CLU" "$IMG" > /dev/null
+	LOOP=$(losetup -f --show "$IMG")
+	mount -t exfat "$LOOP" "$MNT"
+	DEV=$(basename "$LOOP")
+
+	# sequential write and read of one large file
+	t0=$(now_ms)
+	dd if=/dev/zero of="$MNT/seq" bs=1M count=$SEQ_MB conv=fsync 2> /dev/null
+	t1=$(now_ms)
+	rate seq_write_mbs $SEQ_MB $t0 $t1
+	result seq_extents "$(extents "$MNT/seq")"
+
+	drop_caches
+	t0=$(now_ms)
+	dd if="$MNT/seq" of=/dev/null bs=1M 2> /dev/null
+	t1=$(now_ms)
+	rate seq_read_mbs $SEQ_MB $t0 $t1
+
+	# many small files in one directory
+	mkdir "$MNT/small"
+	t0=$(now_ms)
+	for i in $(seq $SMALL_FILES); do
+		head -c 4096 /dev/zero > "$MNT/small/file$i"
+	done
+	sync
+	t1=$(now_ms)
+	rate create_ops $SMALL_FILES $t0 $t1
+
+	# ls -l of the large directory right after the cache is dropped
+	drop_caches
+	reads=$(counter bdev_reads)
+	t0=$(now_ms)
+	ls -l "$MNT/small" > /dev/null
+	t1=$(now_ms)
+	result ls_l_ms $(( t1 - t0 ))
+	delta ls_l_bdev_reads bdev_reads "$reads"
+
+	# repeated lookups of names that do not exist
+	reads=$(counter bdev_reads)
+	t0=$(now_ms)
+	for i in $(seq $LOOKUPS); do
+		[ -e "$MNT/small/missing$(( i % 100 ))" ] || true
+	done
+	t1=$(now_ms)
+	rate negative_lookup_ops $LOOKUPS $t0 $t1
+	delta negative_lookup_bdev_reads bdev_reads "$reads"
+
+	t0=$(now_ms)
+	rm -rf "$MNT/small"
+	sync
+	t1=$(now_ms)
+	rate unlink_ops $SMALL_FILES $t0 $t1
+
+	# two appending writers interleaving their allocations
+	walks=$(counter chain_walks)
+	for f in a b; do
+		(for i in $(seq $APPEND_MB); do
+			dd if=/dev/zero bs=1M count=1 2> /dev/null
+		done > "$MNT/append_$f") &
+	done
+	wait
+	sync
+	result append_extents $(( $(extents "$MNT/append_a") + $(extents "$MNT/append_b") ))
+	delta append_chain_walks chain_walks "$walks"
+
+	# a reserved file must stay in one run on a fresh volume
+	if fallocate -l $(( APPEND_MB * 1024 * 1024 )) "$MNT/reserved" 2> /dev/null; then
+		result fallocate_extents "$(extents "$MNT/reserved")"
+	else
+		result fallocate_extents n/a
+	fi
+
+	result fat_cache_misses "$(counter fat_cache_misses)"
+	result buf_cache_misses "$(counter buf_cache_misses)"
+	result alloc_distance "$(counter alloc_distance)"
+
+	umount "$MNT"
+	losetup -d "$LOOP"
+	LOOP=
+done
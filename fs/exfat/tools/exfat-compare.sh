@@ -0,0 +1,91 @@
+#!/bin/bash
+#
+# exfat-compare.sh - check benchmark results against a baseline
+#
+# usage: exfat-compare.sh baseline results [thresholds.conf]
+#
+# Both result files are written by exfat-bench.sh. Each line of the
+# thresholds file is
+#
+#	<metric pattern> <kind> <limit>
+#
+# where the pattern is a shell glob matched against the metric names and
+# the first matching line applies. The kinds are
+#
+#	higher	larger is better, fail if more than <limit> % below baseline
+#	lower	smaller is better, fail if more than <limit> % above baseline
+#	max	fail if the value is above <limit>, whatever the baseline
+#
+# Metrics without a matching line, or which the results report as n/a, are
+# reported but never fail. Against an n/a baseline only max limits apply. The exit
+# status is 1 if any metric failed.
+
+if [ $# -lt 2 ]; then
+	sed -n '5p' "$0" >&2
+	exit 2
+fi
+
+BASELINE=$1
+RESULTS=$2
+THRESHOLDS=${3:-$(dirname "$0")/thresholds.conf}
+
+declare -A base
+while read -r metric value; do
+	base[$metric]=$value
+done < "$BASELINE"
+
+failed=0
+
+printf "%-36s %12s %12s %8s  %s\n" metric baseline result change verdict
+
+while read -r metric value; do
+	kind=
+	limit=
+	while read -r pattern k l; do
+		case $pattern in
+		''|'#'*) continue ;;
+		esac
+		if [[ $metric == $pattern ]]; then
+			kind=$k
+			limit=$l
+			break
+		fi
+	done < "$THRESHOLDS"
+
+	old=${base[$metric]}
+	change=-
+	if [ "$value" = n/a ]; then
+		kind=
+	elif [ -n "$old" ] && [ "$old" != n/a ] && [ "$old" -ne 0 ]; then
+		change=$(( (value - old) * 100 / old ))
+	fi
+
+	verdict=info
+	case $kind in
+	higher)
+		verdict=pass
+		if [ "$change" != - ] && [ "$change" -lt $(( -limit )) ]; then
+			verdict=FAIL
+		fi
+		;;
+	lower)
+		verdict=pass
+		if [ "$change" != - ] && [ "$change" -gt "$limit" ]; then
+			verdict=FAIL
+		fi
+		;;
+	max)
+		verdict=pass
+		if [ "$value" -gt "$limit" ]; then
+			verdict=FAIL
+		fi
+		;;
+	esac
+
+	[ $verdict = FAIL ] && failed=1
+	[ "$change" != - ] && change="$change%"
+
+	printf "%-36s %12s %12s %8s  %s\n" "$metric" "${old:--}" "$value" "$change" $verdict
+done < "$RESULTS"
+
+exit $failed